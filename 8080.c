@@ -4,8 +4,8 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <SDL2/SDL.h>
 #include "8080.h"
+#include "8080Ops.h"
 
 // number of cycles per instruction, indexed by opcode
 static const int cycles[] = {
@@ -27,7 +27,7 @@ static const int cycles[] = {
     // lengths for conditional jump/call assumes branch taken
 	11, 10, 10, 10, 17, 11, 7, 11, 11, 10, 10, 10, 17, 17, 7, 11,
 	11, 10, 10, 10, 17, 11, 7, 11, 11, 10, 10, 10, 17, 17, 7, 11, 
-	11, 10, 10, 18, 17, 11, 7, 11, 11, 5, 10, 5, 17, 17, 7, 11, 
+	11, 10, 10, 18, 17, 11, 7, 11, 11, 5, 10, 4, 17, 17, 7, 11, 
 	11, 10, 10, 4, 17, 11, 7, 11, 11, 5, 10, 4, 17, 17, 7, 11,
 };
 
@@ -51,12 +51,32 @@ static const int notTakenCycles[] = {
     // lengths for conditional jump/call assumes branch not taken
 	5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11,
 	5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11, 
-	5, 10, 10, 18, 11, 11, 7, 11, 5, 5, 10, 5, 11, 17, 7, 11, 
+	5, 10, 10, 18, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11, 
 	5, 10, 10, 4, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11,
 };
 
+// bytes per instruction, indexed by opcode (undocumented copies included)
+static const uint8_t lengths[] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1,
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+};
+
 // print machine code for buf[pc] (Useful for debugging)
-static int disassemble8080(unsigned char *buf, unsigned int pc)
+int disassemble8080(unsigned char *buf, unsigned int pc)
 {
     unsigned char *code = &buf[pc];
     int8_t length = 1;
@@ -349,148 +369,11 @@ static int disassemble8080(unsigned char *buf, unsigned int pc)
     return length;
 }
 
-// Returns 1 if the number bits set is even
-static int parity(uint8_t num)
-{
-    uint8_t tmp1, tmp2;
-    tmp1 = num ^ (num >> 1);
-    tmp2 = tmp1 ^ (tmp1 >> 2);
-    return ((tmp2 ^ (tmp2 >> 4)) & 1) ? 0 : 1;
-}
-
-static void setArithFlags(State *state, uint16_t result)
-{
-    state->codes->c = ((result & 0x100) == 0x100);
-    state->codes->z = ((result & 0xFF) == 0);
-    state->codes->s = ((result & 0x80) == 0x80);
-    state->codes->p = parity((uint8_t)(result & 0xFF));
-}
-
-static void setAllButCarry(State *state, uint16_t result)
-{
-    state->codes->z = ((result & 0xFF) == 0);
-    state->codes->s = ((result & 0x80) == 0x80);
-    state->codes->p = parity((uint8_t)(result & 0xFF));
-}
-
-static void setCarry(State *state, uint16_t result)
-{
-    state->codes->c = ((result & 0x100) == 0x100);
-}
-
-static void add(State *state, uint16_t num, bool carry)
-{
-    uint16_t tmp = (uint16_t)(state->a) + num;
-    if (carry) tmp++;
-
-    state->codes->ac = ((state->a) ^ tmp ^ num) & 0x10;
-    state->a = (uint8_t)tmp;
-
-    setArithFlags(state, tmp);
-}
-
-static void sub(State *state, uint16_t num, bool borrow)
-{
-    uint16_t tmp = (uint16_t)state->a - num;
-    if (borrow) tmp--;
-
-    state->codes->ac = ~((state->a) ^ tmp ^ num) & 0x10;
-
-    state->a = (uint8_t)tmp;
-
-    setArithFlags(state, tmp);
-}
-
-static void and(State *state, uint16_t num)
-{
-    uint16_t tmp = (uint16_t)state->a & num;
-    state->codes->ac = ((state->a | num) & 0x08) != 0;
-    state->a = (uint8_t)tmp;
-
-    setArithFlags(state, tmp);
-}
-
-static void or(State *state, uint16_t num)
-{
-    uint16_t tmp = (uint16_t)state->a | num;
-    state->a = (uint8_t)tmp;
-
-    setArithFlags(state, tmp);
-    state->codes->ac = 0;
-}
-
-static void xor(State *state, uint16_t num)
-{
-    uint16_t tmp = (uint16_t)state->a ^ num;
-    state->a = (uint8_t)tmp;
-
-    setArithFlags(state, tmp);
-    state->codes->ac = 0;
-}
-
-static void cmp(State *state, uint16_t num)
-{
-    uint16_t tmp = (uint16_t)state->a - num;
-
-    state->codes->ac = ~((state->a) ^ tmp ^ num) & 0x10;
-
-    setArithFlags(state, tmp);
-}
-
-static void inr(State *state, uint8_t *value)
-{
-    uint16_t tmp = 1 + (uint16_t)(*value);
-    *value = (uint8_t)tmp;
-    state->codes->ac = (*value & 0xF) == 0;
-    
-    setAllButCarry(state, tmp);
-}
-
-static void dcr(State *state, uint8_t *value)
-{
-    uint16_t tmp = (uint16_t)(*value) - 1;
-    *value = (uint8_t)tmp;
-    state->codes->ac = !((*value & 0xF) == 0xF);
-    
-    setAllButCarry(state, tmp);
-}
-
-static void mov(uint8_t *dest, uint8_t *src)
+static void mov(uint8_t *dest, const uint8_t *src)
 {
     *dest = *src;
 }
 
-// Increment register pair
-static void inx(uint8_t *hi, uint8_t *lo)
-{
-    uint16_t tmp = ((uint16_t)(*hi) << 8) | (uint16_t)(*lo);
-    tmp++;
-    *hi = (uint8_t)(tmp >> 8);
-    *lo = (uint8_t)(tmp & 0xFF);
-}
-
-// Decrement register pair
-static void dcx(uint8_t *hi, uint8_t *lo)
-{
-    uint16_t tmp = ((uint16_t)(*hi) << 8) | (uint16_t)(*lo);
-    tmp--;
-    *hi = (uint8_t)(tmp >> 8);
-    *lo = (uint8_t)(tmp & 0xFF);
-}
-
-// Add value to value stored in mem at HL
-static void dad(State* state, uint16_t value)
-{
-
-    uint16_t new = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-    uint32_t tmp = new + value;
-    new += value; 
-    state->h = (uint8_t)(new >> 8);
-    state->l = (uint8_t)(new & 0xFF);
-    if (tmp >> 16) // Set carry
-        state->codes->c = 0x1;
-}
-
 // Jump to new address if condition is true, otherwise continue execution
 static void jump(State* state, uint8_t cond, uint16_t addr)
 {
@@ -500,24 +383,6 @@ static void jump(State* state, uint8_t cond, uint16_t addr)
         state->pc += 2;
 }
 
-// Push value onto the stack
-static void push(State *state, uint8_t hi, uint8_t lo)
-{
-    state->sp--;
-    state->mem[state->sp] = hi;
-    state->sp--;
-    state->mem[state->sp] = lo;
-}
-
-// Pop from stack
-static void pop(State *state, uint8_t *hi, uint8_t *lo)
-{
-    *lo = state->mem[state->sp];
-    state->sp++;
-    *hi = state->mem[state->sp];
-    state->sp++;
-}
-
 // Push return and jump (returns true if branch is taken)
 static bool call(State *state, uint8_t cond, uint16_t addr)
 {
@@ -525,9 +390,7 @@ static bool call(State *state, uint8_t cond, uint16_t addr)
     state->pc += 2;
     if (cond)
     {
-        uint8_t hi = (state->pc >> 8) & 0xFF;
-        uint8_t lo = state->pc & 0xFF;
-        push(state, hi, lo);
+        push(state, state->pc);
         jump(state, cond, addr);
         return true;
     }   
@@ -535,24 +398,27 @@ static bool call(State *state, uint8_t cond, uint16_t addr)
     return false;
 }
 
-// Return to address on stack
-static void ret(State* state)
+// Push the address of the next instruction and jump to a restart vector
+static void rst(State *state, uint16_t addr)
 {
-    uint8_t hi, lo;
-    pop(state, &hi, &lo);
-    state->pc = (uint16_t)(hi << 8) | (uint16_t)lo;
+    push(state, state->pc);
+    state->pc = addr;
 }
 
-// Print the top of the stack (for debugging)
-static void stackPeek(State *state)
+// Return to address on stack
+static void ret(State* state)
 {
-    printf("\tAbove: %02x%02x\n", state->mem[state->sp + 3], state->mem[state->sp + 2]);
-    printf("\tTop of stack: %02x%02x\n", state->mem[state->sp + 1], state->mem[state->sp]);
-    printf("\tBelow: %02x%02x\n", state->mem[state->sp - 1], state->mem[state->sp - 1]);
+    state->pc = pop(state);
 }
 
 void GenerateInterrupt(State *state, int num)
 {
+    // The interrupt returns past the HLT
+    if (state->halted)
+    {
+        state->halted = false;
+        state->pc++;
+    }
     state->pc -= 2; // call function increments pc
     call(state, 0x1, num * 8);
     state->int_en = false;
@@ -561,19 +427,26 @@ void GenerateInterrupt(State *state, int num)
 // Update the current state based on the instruction read from the buffer
 int emulate8080(State *state)
 {
-    unsigned char *code = &(state->mem[state->pc]);
+    uint8_t straddle[3];
+    const uint8_t *code = memFetch(state->map, state->pc, straddle);
+    uint8_t opcode = code[0]; // the instruction may overwrite itself
     state->pc++;
     bool notTaken = false;
 
-    switch (code[0])
+    switch (opcode)
     {
         /* 1 byte codes */
 
         // NOP
         case 0x00: break;
 
-        // HLT
-        case 0x76: exit(EXIT_SUCCESS); break;
+        // HLT, executed over and over until an interrupt
+        case 0x76:
+        {
+            state->halted = true;
+            state->pc--;
+            break;
+        }
 
         // DI
         case 0xF3: state->int_en = false; break;
@@ -582,44 +455,30 @@ int emulate8080(State *state)
         case 0xFB: state->int_en = true; break;
 
         // SPHL
-        case 0xF9:
-        {
-            state->sp = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            break;
-        }
+        case 0xF9: state->sp = state->hl; break;
 
         // XTHL
         case 0xE3:
         {
-            uint8_t loStackVal = state->mem[state->sp];
-            uint8_t hiStackVal = state->mem[(state->sp)+1];
-            uint8_t lVal = state->l;
-            uint8_t hVal = state->h;
-
-            state->mem[state->sp] = lVal;
-            state->mem[(state->sp)+1] = hVal;
-            state->l = loStackVal;
-            state->h = hiStackVal;
+            uint16_t stackVal = pop(state);
+            push(state, state->hl);
+            state->hl = stackVal;
             break;
         }
 
         // PCHL
         // Set pc to HL
-        case 0xE9:
-        {
-            state->pc = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            break;
-        }
+        case 0xE9: state->pc = state->hl; break;
 
         // RST (push return onto stack and jump to 0b0000_0000_00xx_x000)
-        case 0xC7: call(state, 0x1, 0x0000); break;
-        case 0xCF: call(state, 0x1, 0x0008); break;
-        case 0xD7: call(state, 0x1, 0x0010); break;
-        case 0xDF: call(state, 0x1, 0x0018); break;
-        case 0xE7: call(state, 0x1, 0x0020); break;
-        case 0xEF: call(state, 0x1, 0x0028); break;
-        case 0xF7: call(state, 0x1, 0x0030); break;
-        case 0xFF: call(state, 0x1, 0x0038); break;
+        case 0xC7: rst(state, 0x0000); break;
+        case 0xCF: rst(state, 0x0008); break;
+        case 0xD7: rst(state, 0x0010); break;
+        case 0xDF: rst(state, 0x0018); break;
+        case 0xE7: rst(state, 0x0020); break;
+        case 0xEF: rst(state, 0x0028); break;
+        case 0xF7: rst(state, 0x0030); break;
+        case 0xFF: rst(state, 0x0038); break;
 
         // Rccc
         case 0xC0:
@@ -688,8 +547,9 @@ int emulate8080(State *state)
             break;
         }
 
-        // RET
-        case 0xC9: ret(state); break;
+        // RET (0xD9 is an undocumented copy)
+        case 0xC9:
+        case 0xD9: ret(state); break;
 
         // STC
         case 0x37: state->codes->c = 1; break;
@@ -701,135 +561,48 @@ int emulate8080(State *state)
         case 0x2F: state->a = ~(state->a); break;
 
         // RAR
-        case 0x1F:
-        {
-            uint8_t carry = state->codes->c;
-            uint8_t lo = state->a & 0x1;
-
-            state->a = (state->a >> 1) | (carry << 7);
-            state->codes->c = lo;
-            break;
-        }
+        case 0x1F: rar(state); break;
 
         // RAL
-        case 0x17:
-        {
-            uint8_t carry = state->codes->c;
-            uint8_t hi = (state->a) >> 7;
-            
-            state->a = ((state->a) << 1) | carry;
-            state->codes->c = hi;
-            break;
-        }
+        case 0x17: ral(state); break;
 
         // RRC
-        case 0x0F:
-        {
-            state->codes->c = state->a & 0x1;
-            state->a = (state->a >> 1) | (state->a << 7);
-            break;
-        }
+        case 0x0F: rrc(state); break;
 
         // RLC
-        case 0x07:
-        {
-            state->codes->c = (state->a) >> 7;
-            state->a = (state->a << 1) | ((state->a) >> 7);
-            break;
-        }
+        case 0x07: rlc(state); break;
 
         // DAA
-        case 0x27:
-        {
-            uint8_t tmpCarry = state->codes->c;
-            uint8_t lo = state->a & 0x0F;
-            uint8_t hi = state->a & 0xF0;
-            uint8_t toAdd = 0;
-            if ((lo > 0x9) || state->codes->ac)
-                toAdd += 0x6;
-            
-            if ((hi > 0x90) || state->codes->c || ((hi == 0x90) && (lo > 0x9))) {
-                toAdd += 0x60;
-                tmpCarry = 1;
-            }
-
-            add(state, toAdd, false);
-            state->codes->c = tmpCarry;
-            break;
-        }
+        case 0x27: daa(state); break;
 
         // XCHG
         case 0xEB:
         {
-            uint8_t hi = state->h;
-            uint8_t lo = state->l;
-            uint8_t d = state->d;
-            uint8_t e = state->e;
-            state->h = d;
-            state->l = e;
-            state->d = hi;
-            state->e = lo;
+            uint16_t de = state->de;
+            state->de = state->hl;
+            state->hl = de;
             break;
         }
 
         // LDAX
-        case 0x0A:
-        {
-            uint16_t addr = ((uint16_t)state->b << 8) | (uint16_t)state->c;
-            state->a = state->mem[addr];
-            break;
-        }
-        case 0x1A:
-        {
-            uint16_t addr = ((uint16_t)state->d << 8) | (uint16_t)state->e;
-            state->a = state->mem[addr];
-            break;
-        }
+        case 0x0A: state->a = memRead(state->map, state->bc); break;
+        case 0x1A: state->a = memRead(state->map, state->de); break;
 
         // STAX
-        case 0x02:
-        {
-            uint16_t addr = ((uint16_t)state->b << 8) | (uint16_t)state->c;
-            state->mem[addr] = state->a;
-            break;
-        }
-        case 0x12:
-        {
-            uint16_t addr = ((uint16_t)state->d << 8) | (uint16_t)state->e;
-            state->mem[addr] = state->a;
-            break;
-        }
+        case 0x02: memWrite(state->map, state->bc, state->a); break;
+        case 0x12: memWrite(state->map, state->de, state->a); break;
 
         // POP
-        case 0xC1: pop(state, &(state->b), &(state->c)); break;
-        case 0xD1: pop(state, &(state->d), &(state->e)); break;
-        case 0xE1: pop(state, &(state->h), &(state->l)); break;
-        case 0xF1:
-        {
-            uint8_t psw;
-            pop(state, &(state->a), &(psw));
-            
-            // restore condition codes
-            state->codes->c = (psw & 0x1);
-            state->codes->p = (psw >> 2) & 0x1;
-            state->codes->ac = (psw >> 4) & 0x1;
-            state->codes->z = (psw >> 6) & 0x1;
-            state->codes->s = (psw >> 7) & 0x1;
-            break;
-        }
+        case 0xC1: state->bc = pop(state); break;
+        case 0xD1: state->de = pop(state); break;
+        case 0xE1: state->hl = pop(state); break;
+        case 0xF1: popPsw(state); break;
 
         // PUSH
-        case 0xC5: push(state, state->b, state->c); break;
-        case 0xD5: push(state, state->d, state->e); break;
-        case 0xE5: push(state, state->h, state->l); break;
-        case 0xF5:
-        {
-            uint8_t ccs = (state->codes->c) | 0x2 | (state->codes->p << 2)
-                        | (state->codes->ac << 4) | (state->codes->z << 6)
-                        | (state->codes->s << 7);
-            push(state, state->a, ccs);
-            break;
-        }
+        case 0xC5: push(state, state->bc); break;
+        case 0xD5: push(state, state->de); break;
+        case 0xE5: push(state, state->hl); break;
+        case 0xF5: pushPsw(state); break;
 
         // MOV
         case 0x40: mov(&(state->b), &(state->b)); break;
@@ -838,12 +611,7 @@ int emulate8080(State *state)
 		case 0x43: mov(&(state->b), &(state->e)); break;
 		case 0x44: mov(&(state->b), &(state->h)); break;
 		case 0x45: mov(&(state->b), &(state->l)); break;
-		case 0x46: 
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->b), &(state->mem[addr]));
-            break;
-        }
+		case 0x46: state->b = memRead(state->map, state->hl); break;
 		case 0x47: mov(&(state->b), &(state->a)); break;
 		case 0x48: mov(&(state->c), &(state->b)); break;
 		case 0x49: mov(&(state->c), &(state->c)); break;
@@ -851,12 +619,7 @@ int emulate8080(State *state)
 		case 0x4b: mov(&(state->c), &(state->e)); break;
 		case 0x4c: mov(&(state->c), &(state->h)); break;
 		case 0x4d: mov(&(state->c), &(state->l)); break;
-		case 0x4e: 
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->c), &(state->mem[addr]));
-            break;
-        }
+		case 0x4e: state->c = memRead(state->map, state->hl); break;
 		case 0x4f: mov(&(state->c), &(state->a)); break;
 		case 0x50: mov(&(state->d), &(state->b)); break;
 		case 0x51: mov(&(state->d), &(state->c)); break;
@@ -864,12 +627,7 @@ int emulate8080(State *state)
 		case 0x53: mov(&(state->d), &(state->e)); break;
 		case 0x54: mov(&(state->d), &(state->h)); break;
 		case 0x55: mov(&(state->d), &(state->l)); break;
-		case 0x56:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->d), &(state->mem[addr]));
-            break;
-        }
+		case 0x56: state->d = memRead(state->map, state->hl); break;
 		case 0x57: mov(&(state->d), &(state->a)); break;
 		case 0x58: mov(&(state->e), &(state->b)); break;
 		case 0x59: mov(&(state->e), &(state->c)); break;
@@ -877,12 +635,7 @@ int emulate8080(State *state)
 		case 0x5b: mov(&(state->e), &(state->e)); break;
 		case 0x5c: mov(&(state->e), &(state->h)); break;
 		case 0x5d: mov(&(state->e), &(state->l)); break;
-		case 0x5e:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->e), &(state->mem[addr]));
-            break;
-        }
+		case 0x5e: state->e = memRead(state->map, state->hl); break;
 		case 0x5f: mov(&(state->e), &(state->a)); break;
 		case 0x60: mov(&(state->h), &(state->b)); break;
 		case 0x61: mov(&(state->h), &(state->c)); break;
@@ -890,12 +643,7 @@ int emulate8080(State *state)
 		case 0x63: mov(&(state->h), &(state->e)); break;
 		case 0x64: mov(&(state->h), &(state->h)); break;
 		case 0x65: mov(&(state->h), &(state->l)); break;
-		case 0x66:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->h), &(state->mem[addr]));
-            break;
-        }
+		case 0x66: state->h = memRead(state->map, state->hl); break;
 		case 0x67: mov(&(state->h), &(state->a)); break;
 		case 0x68: mov(&(state->l), &(state->b)); break;
 		case 0x69: mov(&(state->l), &(state->c)); break;
@@ -903,67 +651,22 @@ int emulate8080(State *state)
 		case 0x6b: mov(&(state->l), &(state->e)); break;
 		case 0x6c: mov(&(state->l), &(state->h)); break;
 		case 0x6d: mov(&(state->l), &(state->l)); break;
-		case 0x6e:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->l), &(state->mem[addr]));
-            break;
-        }
+		case 0x6e: state->l = memRead(state->map, state->hl); break;
 		case 0x6f: mov(&(state->l), &(state->a)); break;
-		case 0x70:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->b));
-            break;
-        }
-		case 0x71:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->c));
-            break;
-        }
-		case 0x72:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->d));
-            break;
-        }
-		case 0x73:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->e));
-            break;
-        }
-		case 0x74:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->h));
-            break;
-        }
-		case 0x75:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->l));
-            break;
-        }
-		case 0x77:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(state->a));
-            break;
-        }
+		case 0x70: memWrite(state->map, state->hl, state->b); break;
+		case 0x71: memWrite(state->map, state->hl, state->c); break;
+		case 0x72: memWrite(state->map, state->hl, state->d); break;
+		case 0x73: memWrite(state->map, state->hl, state->e); break;
+		case 0x74: memWrite(state->map, state->hl, state->h); break;
+		case 0x75: memWrite(state->map, state->hl, state->l); break;
+		case 0x77: memWrite(state->map, state->hl, state->a); break;
 		case 0x78: mov(&(state->a), &(state->b)); break;
 		case 0x79: mov(&(state->a), &(state->c)); break;
 		case 0x7a: mov(&(state->a), &(state->d)); break;
 		case 0x7b: mov(&(state->a), &(state->e)); break;
 		case 0x7c: mov(&(state->a), &(state->h)); break;
 		case 0x7d: mov(&(state->a), &(state->l)); break;
-		case 0x7e:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->a), &(state->mem[addr]));
-            break;
-        }
+		case 0x7e: state->a = memRead(state->map, state->hl); break;
 		case 0x7f: mov(&(state->a), &(state->a)); break;
 
         // ADD/ADC
@@ -973,26 +676,16 @@ int emulate8080(State *state)
 		case 0x83: add(state, (uint16_t)state->e, false); break;
 		case 0x84: add(state, (uint16_t)state->h, false); break;
 		case 0x85: add(state, (uint16_t)state->l, false); break;
-        case 0x86:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            add(state, (uint16_t)state->mem[addr], false);
-            break;
-        }
+        case 0x86: add(state, (uint16_t)memRead(state->map, state->hl), false); break;
 		case 0x87: add(state, (uint16_t)state->a, false); break;
-		case 0x88: add(state, (uint16_t)state->b, true); break;
-		case 0x89: add(state, (uint16_t)state->c, true); break;
-		case 0x8a: add(state, (uint16_t)state->d, true); break;
-		case 0x8b: add(state, (uint16_t)state->e, true); break;
-		case 0x8c: add(state, (uint16_t)state->h, true); break;
-		case 0x8d: add(state, (uint16_t)state->l, true); break;
-		case 0x8e:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            add(state, (uint16_t)state->mem[addr], true);
-            break;
-        }
-		case 0x8f: add(state, (uint16_t)state->a, true); break;
+		case 0x88: add(state, (uint16_t)state->b, state->codes->c); break;
+		case 0x89: add(state, (uint16_t)state->c, state->codes->c); break;
+		case 0x8a: add(state, (uint16_t)state->d, state->codes->c); break;
+		case 0x8b: add(state, (uint16_t)state->e, state->codes->c); break;
+		case 0x8c: add(state, (uint16_t)state->h, state->codes->c); break;
+		case 0x8d: add(state, (uint16_t)state->l, state->codes->c); break;
+		case 0x8e: add(state, (uint16_t)memRead(state->map, state->hl), state->codes->c); break;
+		case 0x8f: add(state, (uint16_t)state->a, state->codes->c); break;
 
         // SUB/SBB
         case 0x90: sub(state, (uint16_t)state->b, false); break;
@@ -1001,12 +694,7 @@ int emulate8080(State *state)
 		case 0x93: sub(state, (uint16_t)state->e, false); break;
 		case 0x94: sub(state, (uint16_t)state->h, false); break;
 		case 0x95: sub(state, (uint16_t)state->l, false); break;
-		case 0x96:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            sub(state, (uint16_t)state->mem[addr], false);
-            break;
-        }
+		case 0x96: sub(state, (uint16_t)memRead(state->map, state->hl), false); break;
 		case 0x97: sub(state, (uint16_t)state->a, false); break;
 		case 0x98: sub(state, (uint16_t)state->b, state->codes->c); break;
 		case 0x99: sub(state, (uint16_t)state->c, state->codes->c); break;
@@ -1014,12 +702,7 @@ int emulate8080(State *state)
 		case 0x9b: sub(state, (uint16_t)state->e, state->codes->c); break;
 		case 0x9c: sub(state, (uint16_t)state->h, state->codes->c); break;
 		case 0x9d: sub(state, (uint16_t)state->l, state->codes->c); break;
-		case 0x9e:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            sub(state, (uint16_t)state->mem[addr], state->codes->c);
-            break;
-        }
+		case 0x9e: sub(state, (uint16_t)memRead(state->map, state->hl), state->codes->c); break;
 		case 0x9f: sub(state, (uint16_t)state->a, state->codes->c); break;
 
         // ANA
@@ -1029,12 +712,7 @@ int emulate8080(State *state)
 		case 0xa3: and(state, (uint16_t)state->e); break;
 		case 0xa4: and(state, (uint16_t)state->h); break;
 		case 0xa5: and(state, (uint16_t)state->l); break;
-		case 0xa6:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            and(state, (uint16_t)state->mem[addr]);
-            break;
-        }
+		case 0xa6: and(state, (uint16_t)memRead(state->map, state->hl)); break;
 		case 0xa7: and(state, (uint16_t)state->a); break;
 		
         // XRA
@@ -1044,12 +722,7 @@ int emulate8080(State *state)
 		case 0xab: xor(state, (uint16_t)state->e); break;
 		case 0xac: xor(state, (uint16_t)state->h); break;
 		case 0xad: xor(state, (uint16_t)state->l); break;
-		case 0xae:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            xor(state, (uint16_t)state->mem[addr]);
-            break;
-        }
+		case 0xae: xor(state, (uint16_t)memRead(state->map, state->hl)); break;
 		case 0xaf: xor(state, (uint16_t)state->a); break;
 
         // ORA
@@ -1059,12 +732,7 @@ int emulate8080(State *state)
 		case 0xb3: or(state, (uint16_t)state->e); break;
 		case 0xb4: or(state, (uint16_t)state->h); break;
 		case 0xb5: or(state, (uint16_t)state->l); break;
-		case 0xb6:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            or(state, (uint16_t)state->mem[addr]);
-            break;
-        }
+		case 0xb6: or(state, (uint16_t)memRead(state->map, state->hl)); break;
 		case 0xb7: or(state, (uint16_t)state->a); break;
 		
         // CMP
@@ -1074,79 +742,64 @@ int emulate8080(State *state)
 		case 0xbb: cmp(state, (uint16_t)state->e); break;
 		case 0xbc: cmp(state, (uint16_t)state->h); break;
 		case 0xbd: cmp(state, (uint16_t)state->l); break;
-		case 0xbe:
-        {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            cmp(state, (uint16_t)state->mem[addr]);
-            break;
-        }
+		case 0xbe: cmp(state, (uint16_t)memRead(state->map, state->hl)); break;
 		case 0xbf: cmp(state, (uint16_t)state->a); break;
 
         // INX
-        case 0x03: inx(&(state->b), &(state->c)); break;
-        case 0x13: inx(&(state->d), &(state->e)); break;
-        case 0x23: inx(&(state->h), &(state->l)); break;
+        case 0x03: state->bc++; break;
+        case 0x13: state->de++; break;
+        case 0x23: state->hl++; break;
         case 0x33: state->sp++; break;
 
         // DCX
-        case 0x0B: dcx(&(state->b), &(state->c)); break;
-        case 0x1B: dcx(&(state->d), &(state->e)); break;
-        case 0x2B: dcx(&(state->h), &(state->l)); break;
+        case 0x0B: state->bc--; break;
+        case 0x1B: state->de--; break;
+        case 0x2B: state->hl--; break;
         case 0x3B: state->sp--; break;
 
         // DAD
-        case 0x09:
-        {
-            dad(state, (uint16_t)(state->b) << 8 | (uint16_t)(state->c));
-            break;
-        }
-        case 0x19:
-        {
-            dad(state, (uint16_t)(state->d) << 8 | (uint16_t)(state->e));
-            break;
-        }
-        case 0x29:
-        {
-            dad(state, (uint16_t)(state->h) << 8 | (uint16_t)(state->l));
-            break;
-        }
+        case 0x09: dad(state, state->bc); break;
+        case 0x19: dad(state, state->de); break;
+        case 0x29: dad(state, state->hl); break;
         case 0x39: dad(state, state->sp); break;
         
         // INR
-        case 0x04: inr(state, &(state->b)); break;
-        case 0x0C: inr(state, &(state->c)); break;
-        case 0x14: inr(state, &(state->d)); break;
-        case 0x1C: inr(state, &(state->e)); break;
-        case 0x24: inr(state, &(state->h)); break;
-        case 0x2C: inr(state, &(state->l)); break;
-        case 0x34:
+        case 0x04: state->b = inr(state, state->b); break;
+        case 0x0C: state->c = inr(state, state->c); break;
+        case 0x14: state->d = inr(state, state->d); break;
+        case 0x1C: state->e = inr(state, state->e); break;
+        case 0x24: state->h = inr(state, state->h); break;
+        case 0x2C: state->l = inr(state, state->l); break;
+        case 0x34: memWrite(state->map, state->hl, inr(state, memRead(state->map, state->hl))); break;
+        case 0x3C: state->a = inr(state, state->a); break;
+
+        // DCR
+        case 0x05: state->b = dcr(state, state->b); break;
+        case 0x0D: state->c = dcr(state, state->c); break;
+        case 0x15: state->d = dcr(state, state->d); break;
+        case 0x1D: state->e = dcr(state, state->e); break;
+        case 0x25: state->h = dcr(state, state->h); break;
+        case 0x2D: state->l = dcr(state, state->l); break;
+        case 0x35: memWrite(state->map, state->hl, dcr(state, memRead(state->map, state->hl))); break;
+        case 0x3D: state->a = dcr(state, state->a); break;
+
+        /* 2 byte codes */
+
+        // OUT
+        case 0xD3:
         {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            inr(state, &(state->mem[addr]));
+            state->pc++;
+            portWrite(state->io, code[1], state->a);
             break;
         }
-        case 0x3C: inr(state, &(state->a)); break;
 
-        // DCR
-        case 0x05: dcr(state, &(state->b)); break;
-        case 0x0D: dcr(state, &(state->c)); break;
-        case 0x15: dcr(state, &(state->d)); break;
-        case 0x1D: dcr(state, &(state->e)); break;
-        case 0x25: dcr(state, &(state->h)); break;
-        case 0x2D: dcr(state, &(state->l)); break;
-        case 0x35:
+        // IN
+        case 0xDB:
         {
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            dcr(state, &(state->mem[addr]));
+            state->pc++;
+            state->a = portRead(state->io, code[1]);
             break;
         }
-        case 0x3D: dcr(state, &(state->a)); break;
-
-        /* 2 byte codes */
-
-        // IN/OUT (Being handled outside the processor, will never hit here)
-        case 0xD3: state->pc++; break;
-        case 0xDB: state->pc++; break;
         
         // CPI
         case 0xFE:
@@ -1200,7 +853,7 @@ int emulate8080(State *state)
         case 0xCE:
         {
             state->pc++;
-            add(state, (uint16_t)code[1], true);
+            add(state, (uint16_t)code[1], state->codes->c);
             break;
         }
 
@@ -1252,8 +905,7 @@ int emulate8080(State *state)
         case 0x36:
         {
             state->pc++;
-            uint16_t addr = ((uint16_t)state->h << 8) | (uint16_t)state->l;
-            mov(&(state->mem[addr]), &(code[1]));
+            memWrite(state->map, state->hl, code[1]);
             break;
         }
         case 0x3E:
@@ -1269,7 +921,7 @@ int emulate8080(State *state)
         case 0x3A:
         {
             state->pc += 2;
-            state->a = state->mem[((uint16_t)(code[2]) << 8) | (uint16_t)code[1]];
+            state->a = memRead(state->map, ((uint16_t)(code[2]) << 8) | (uint16_t)code[1]);
             break;
         }
 
@@ -1277,7 +929,7 @@ int emulate8080(State *state)
         case 0x32:
         {
             state->pc += 2;
-            state->mem[((uint16_t)(code[2]) << 8) | (uint16_t)code[1]] = state->a;
+            memWrite(state->map, ((uint16_t)(code[2]) << 8) | (uint16_t)code[1], state->a);
             break;
         }
 
@@ -1286,8 +938,7 @@ int emulate8080(State *state)
         {
             state->pc += 2;
             uint16_t addr = ((uint16_t)(code[2]) << 8) | (uint16_t)code[1];
-            state->mem[addr] = state->l;
-            state->mem[addr + 1] = state->h;
+            memWrite16(state->map, addr, state->hl);
             break;
         }
 
@@ -1296,21 +947,24 @@ int emulate8080(State *state)
         {
             state->pc += 2;
             uint16_t addr = ((uint16_t)(code[2]) << 8) | (uint16_t)code[1];
-            state->l = state->mem[addr];
-            state->h = state->mem[addr + 1];
+            state->hl = memRead16(state->map, addr);
             break;
         }
 
-        // JMP
+        // JMP (0xCB is an undocumented copy)
         case 0xC3:
+        case 0xCB:
         {
             uint16_t addr = ((uint16_t)(code[2]) << 8) | (uint16_t)code[1];
             jump(state, 0x1, addr);
             break;
         }
 
-        // CALL
+        // CALL (0xDD, 0xED and 0xFD are undocumented copies)
         case 0xCD:
+        case 0xDD:
+        case 0xED:
+        case 0xFD:
         {
             uint16_t addr = ((uint16_t)(code[2]) << 8) | (uint16_t)code[1];
             call(state, 0x1, addr);
@@ -1321,22 +975,19 @@ int emulate8080(State *state)
         case 0x01:
         {
             state->pc += 2;
-            state->b = code[2];
-            state->c = code[1];
+            state->bc = ((uint16_t)code[2] << 8) | (uint16_t)code[1];
             break;
         }
         case 0x11:
         {
             state->pc += 2;
-            state->d = code[2];
-            state->e = code[1];
+            state->de = ((uint16_t)code[2] << 8) | (uint16_t)code[1];
             break;
         }
         case 0x21:
         {
             state->pc += 2;
-            state->h = code[2];
-            state->l = code[1];
+            state->hl = ((uint16_t)code[2] << 8) | (uint16_t)code[1];
             break;
         }
         case 0x31:
@@ -1457,25 +1108,52 @@ int emulate8080(State *state)
 
     if (notTaken)
     {
-        return notTakenCycles[code[0]];
+        return notTakenCycles[opcode];
     }
-    return cycles[code[0]];
+    return cycles[opcode];
+}
+
+// Base cycle count of an opcode (taken timing for conditional calls/returns)
+int cycles8080(uint8_t opcode)
+{
+    return cycles[opcode];
+}
+
+// Cycle count of a conditional call or return that isn't taken
+int notTakenCycles8080(uint8_t opcode)
+{
+    return notTakenCycles[opcode];
+}
+
+// Bytes taken by the instruction starting with opcode, 1 to 3
+int length8080(uint8_t opcode)
+{
+    return lengths[opcode];
+}
+
+// RESET line: only PC, the interrupt enable and HLT are affected
+void reset8080(State *state)
+{
+    state->pc = 0;
+    state->int_en = false;
+    state->halted = false;
 }
 
 State *init8080()
 {
     State *state = calloc(1, sizeof(State));
-    state->mem = malloc(0x10000); // 16kb
-    if (state->mem == NULL)
+    state->mem = calloc(1, MEM_SIZE); // 64kb
+    state->map = malloc(sizeof(Memory));
+    state->io = malloc(sizeof(Ports));
+    if (state->mem == NULL || state->map == NULL || state->io == NULL)
         exit(1);
+    memInit(state->map, state->mem);
+    portsInit(state->io, NULL);
     state->codes = malloc(sizeof(Codes));
-    state->a = 0;
-    state->b = 0;
-    state->c = 0;
-    state->d = 0;
-    state->e = 0;
-    state->h = 0;
-    state->l = 0;
+    state->psw = 0;
+    state->bc = 0;
+    state->de = 0;
+    state->hl = 0;
     state->pc = 0;
     state->sp = 0xf000;
     state->codes->ac = 0;
@@ -1,9 +1,14 @@
+#ifndef I8080_H
+#define I8080_H
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include "Memory.h"
+#include "Ports.h"
 
 typedef struct
 {
@@ -14,22 +19,38 @@ typedef struct
     uint8_t ac; // auxiliary carry
 } Codes;
 
+// Overlay a 16-bit register pair on its two 8-bit halves so pair operations
+// (INX, DAD, LHLD, HL addressing...) need no shift/or reconstruction.
+// The high register must sit at the higher address on little-endian hosts.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define REG_PAIR(pair, hi, lo) union { uint16_t pair; struct { uint8_t hi; uint8_t lo; }; }
+#else
+#define REG_PAIR(pair, hi, lo) union { uint16_t pair; struct { uint8_t lo; uint8_t hi; }; }
+#endif
+
 typedef struct
 {
     uint16_t pc;
     uint16_t sp;
-    uint8_t a;
-    uint8_t b;
-    uint8_t c;
-    uint8_t d;
-    uint8_t e;
-    uint8_t h;
-    uint8_t l;
+    REG_PAIR(psw, a, f); // f is only packed from codes on PUSH PSW
+    REG_PAIR(bc, b, c);
+    REG_PAIR(de, d, e);
+    REG_PAIR(hl, h, l);
     bool int_en; // interrupt enable
-    uint8_t *mem;
+    bool halted; // by HLT until the next interrupt, PC stays on the HLT
+    uint8_t *mem; // physical 64KiB image
+    Memory *map;  // address decoding, all CPU accesses go through it
+    Ports *io;    // IN/OUT handlers of the board
     Codes *codes;
 } State;
 
 void GenerateInterrupt(State *state, int num);
 int emulate8080(State *state);
-State *init8080();
\ No newline at end of file
+void reset8080(State *state);
+int cycles8080(uint8_t opcode);
+int notTakenCycles8080(uint8_t opcode);
+int length8080(uint8_t opcode);
+int disassemble8080(unsigned char *buf, unsigned int pc);
+State *init8080();
+
+#endif
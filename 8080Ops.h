@@ -0,0 +1,206 @@
+#ifndef I8080_OPS_H
+#define I8080_OPS_H
+
+#include "8080.h"
+
+// Flag and stack helpers of the instructions, shared by emulate8080() and
+// the C that romcfg -c translates a ROM into, so both compute the same
+// flags. Only for those two, the names are short.
+
+// Returns 1 if the number bits set is even
+static inline int parity(uint8_t num)
+{
+    uint8_t tmp1, tmp2;
+    tmp1 = num ^ (num >> 1);
+    tmp2 = tmp1 ^ (tmp1 >> 2);
+    return ((tmp2 ^ (tmp2 >> 4)) & 1) ? 0 : 1;
+}
+
+static inline void setArithFlags(State *state, uint16_t result)
+{
+    state->codes->c = ((result & 0x100) == 0x100);
+    state->codes->z = ((result & 0xFF) == 0);
+    state->codes->s = ((result & 0x80) == 0x80);
+    state->codes->p = parity((uint8_t)(result & 0xFF));
+}
+
+static inline void setAllButCarry(State *state, uint16_t result)
+{
+    state->codes->z = ((result & 0xFF) == 0);
+    state->codes->s = ((result & 0x80) == 0x80);
+    state->codes->p = parity((uint8_t)(result & 0xFF));
+}
+
+static inline void add(State *state, uint16_t num, bool carry)
+{
+    uint16_t tmp = (uint16_t)(state->a) + num;
+    if (carry) tmp++;
+
+    state->codes->ac = (((state->a) ^ tmp ^ num) & 0x10) != 0;
+    state->a = (uint8_t)tmp;
+
+    setArithFlags(state, tmp);
+}
+
+static inline void sub(State *state, uint16_t num, bool borrow)
+{
+    uint16_t tmp = (uint16_t)state->a - num;
+    if (borrow) tmp--;
+
+    state->codes->ac = (~((state->a) ^ tmp ^ num) & 0x10) != 0;
+
+    state->a = (uint8_t)tmp;
+
+    setArithFlags(state, tmp);
+}
+
+static inline void and(State *state, uint16_t num)
+{
+    uint16_t tmp = (uint16_t)state->a & num;
+    state->codes->ac = ((state->a | num) & 0x08) != 0;
+    state->a = (uint8_t)tmp;
+
+    setArithFlags(state, tmp);
+}
+
+static inline void or(State *state, uint16_t num)
+{
+    uint16_t tmp = (uint16_t)state->a | num;
+    state->a = (uint8_t)tmp;
+
+    setArithFlags(state, tmp);
+    state->codes->ac = 0;
+}
+
+static inline void xor(State *state, uint16_t num)
+{
+    uint16_t tmp = (uint16_t)state->a ^ num;
+    state->a = (uint8_t)tmp;
+
+    setArithFlags(state, tmp);
+    state->codes->ac = 0;
+}
+
+static inline void cmp(State *state, uint16_t num)
+{
+    uint16_t tmp = (uint16_t)state->a - num;
+
+    state->codes->ac = (~((state->a) ^ tmp ^ num) & 0x10) != 0;
+
+    setArithFlags(state, tmp);
+}
+
+static inline uint8_t inr(State *state, uint8_t value)
+{
+    uint16_t tmp = 1 + (uint16_t)value;
+    value = (uint8_t)tmp;
+    state->codes->ac = (value & 0xF) == 0;
+    
+    setAllButCarry(state, tmp);
+    return value;
+}
+
+static inline uint8_t dcr(State *state, uint8_t value)
+{
+    uint16_t tmp = (uint16_t)value - 1;
+    value = (uint8_t)tmp;
+    state->codes->ac = !((value & 0xF) == 0xF);
+    
+    setAllButCarry(state, tmp);
+    return value;
+}
+
+// Add register pair to HL
+static inline void dad(State* state, uint16_t value)
+{
+    uint32_t tmp = (uint32_t)state->hl + value;
+    state->hl = (uint16_t)tmp;
+    state->codes->c = (tmp >> 16) != 0;
+}
+
+// Push register pair onto the stack
+static inline void push(State *state, uint16_t value)
+{
+    state->sp -= 2;
+    memWrite16(state->map, state->sp, value);
+}
+
+// Pop register pair from stack
+static inline uint16_t pop(State *state)
+{
+    uint16_t value = memRead16(state->map, state->sp);
+    state->sp += 2;
+    return value;
+}
+
+// Rotates, through carry (RAL, RAR) or around (RLC, RRC)
+static inline void rlc(State *state)
+{
+    state->codes->c = (state->a) >> 7;
+    state->a = (state->a << 1) | ((state->a) >> 7);
+}
+
+static inline void rrc(State *state)
+{
+    state->codes->c = state->a & 0x1;
+    state->a = (state->a >> 1) | (state->a << 7);
+}
+
+static inline void ral(State *state)
+{
+    uint8_t carry = state->codes->c;
+    uint8_t hi = (state->a) >> 7;
+
+    state->a = ((state->a) << 1) | carry;
+    state->codes->c = hi;
+}
+
+static inline void rar(State *state)
+{
+    uint8_t carry = state->codes->c;
+    uint8_t lo = state->a & 0x1;
+
+    state->a = (state->a >> 1) | (carry << 7);
+    state->codes->c = lo;
+}
+
+static inline void daa(State *state)
+{
+    uint8_t tmpCarry = state->codes->c;
+    uint8_t lo = state->a & 0x0F;
+    uint8_t hi = state->a & 0xF0;
+    uint8_t toAdd = 0;
+    if ((lo > 0x9) || state->codes->ac)
+        toAdd += 0x6;
+
+    if ((hi > 0x90) || state->codes->c || ((hi == 0x90) && (lo > 0x9))) {
+        toAdd += 0x60;
+        tmpCarry = 1;
+    }
+
+    add(state, toAdd, false);
+    state->codes->c = tmpCarry;
+}
+
+// flags are only packed into F when PSW is pushed
+static inline void pushPsw(State *state)
+{
+    state->f = (state->codes->c) | 0x2 | (state->codes->p << 2)
+             | (state->codes->ac << 4) | (state->codes->z << 6)
+             | (state->codes->s << 7);
+    push(state, state->psw);
+}
+
+static inline void popPsw(State *state)
+{
+    state->psw = pop(state);
+
+    // restore condition codes
+    state->codes->c = (state->f & 0x1);
+    state->codes->p = (state->f >> 2) & 0x1;
+    state->codes->ac = (state->f >> 4) & 0x1;
+    state->codes->z = (state->f >> 6) & 0x1;
+    state->codes->s = (state->f >> 7) & 0x1;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#include <string.h>
+#include "Aot.h"
+#include "Rom.h"
+
+// make <target> AOT_ROM=file links the translation as aotRom
+#ifdef AOT
+extern const AotEngine aotRom;
+#endif
+
+const AotEngine *aotFind(const char *machine, const uint8_t *mem)
+{
+#ifdef AOT
+    if (strcmp(machine, aotRom.machine))
+        return NULL;
+    for (int i = 0; i < aotRom.spanCount; i++)
+        if (crc32(&(mem[aotRom.spans[i].addr]), aotRom.spans[i].size) != aotRom.spans[i].crc)
+            return NULL;
+    return &aotRom;
+#else
+    (void)machine;
+    (void)mem;
+    return NULL;
+#endif
+}
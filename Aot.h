@@ -0,0 +1,63 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "8080.h"
+
+// A ROM translated to C ahead of time by romcfg -c, one label per basic
+// block and goto between them (make <target> AOT_ROM=file links one in).
+// runFrame() runs translated blocks wherever PC is at a block start and the
+// whole block ends before the next interrupt is due. The interpreter takes
+// the instructions up to the interrupt, and any PC that has no block (RAM,
+// PCHL targets the analysis never saw), so interrupts land on the same
+// instruction as with the interpreter alone.
+typedef struct
+{
+    uint16_t addr;
+    uint32_t size;
+    uint32_t crc; // of the ROM bytes translated
+} AotSpan;
+
+typedef struct
+{
+    const char *machine;
+    const AotSpan *spans;
+    int spanCount;
+    int blocks;
+    const uint8_t *starts; // bit per address up to last, set at each block start
+    int last;
+
+
+    // Runs blocks from state->pc while each one ends before limit, returns
+    // the cycle count reached, with state->pc where it stopped
+    int (*run)(State *state, int cycles, int limit);
+} AotEngine;
+
+// The translation linked in if it was made from this machine's ROM as mem
+// holds it now, else NULL
+const AotEngine *aotFind(const char *machine, const uint8_t *mem);
+
+// Used by the translated code
+
+// Start of a block, leaves unless all of it runs before limit
+#define AOT_BLOCK(addr, most)                                                                                        \
+    do                                                                                                               \
+    {                                                                                                                \
+        if (cycles + (most) >= limit)                                                                                \
+        {                                                                                                            \
+            s->pc = (addr);                                                                                          \
+            return cycles;                                                                                           \
+        }                                                                                                            \
+    } while (0)
+
+// Hands addr over to the interpreter
+#define AOT_EXIT(addr)                                                                                               \
+    do                                                                                                               \
+    {                                                                                                                \
+        s->pc = (addr);                                                                                              \
+        return cycles;                                                                                               \
+    } while (0)
+
+#endif
@@ -0,0 +1,283 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+#include "Capture.h"
+#include "Bytes.h"
+
+static const char magic[8] = "8080VID";
+
+static size_t packedBytes(int width, int height)
+{
+    return (size_t)((width + 7) / 8) * height;
+}
+
+static size_t frameBytes(const Capture *c)
+{
+    if (c->format == CAPTURE_Y4M)
+        return (size_t)c->width * c->height * 4;
+    return packedBytes(c->width, c->height);
+}
+
+/* Delta stream */
+
+static size_t putVarint(uint8_t *dst, size_t out, size_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        dst[out++] = (uint8_t)(value | 0x80);
+    dst[out++] = (uint8_t)value;
+    return out;
+}
+
+static bool readVarint(FILE *f, size_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        int c = fgetc(f);
+        if (c == EOF)
+            return false;
+        *value |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static inline uint8_t before(const uint8_t *previous, size_t i)
+{
+    return previous != NULL ? previous[i] : 0;
+}
+
+// A single unchanged byte costs less as a literal than as a new pair, so
+// literals only stop at two
+size_t encodeDelta(const uint8_t *bits, const uint8_t *previous, size_t size, uint8_t *dst)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t start = i;
+        while (i < size && bits[i] == before(previous, i))
+            i++;
+        size_t same = i - start;
+
+        start = i;
+        while (i < size
+               && !(bits[i] == before(previous, i) && (i + 1 == size || bits[i + 1] == before(previous, i + 1))))
+            i++;
+
+        out = putVarint(dst, out, same);
+        out = putVarint(dst, out, i - start);
+        for (size_t k = start; k < i; k++)
+            dst[out++] = bits[k] ^ before(previous, k);
+    }
+    return out;
+}
+
+/* YUV4MPEG2 */
+
+// BT.601 studio range, exact for black and white
+static void encodeY4M(const uint8_t *rgba, int width, int height, uint8_t *dst)
+{
+    size_t pixels = (size_t)width * height;
+    uint8_t *y = dst;
+    uint8_t *u = dst + pixels;
+    uint8_t *v = dst + 2 * pixels;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        int r = rgba[4 * i];
+        int g = rgba[4 * i + 1];
+        int b = rgba[4 * i + 2];
+        y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+static void encodeFrame(Capture *c, const uint8_t *frame)
+{
+    if (c->format == CAPTURE_Y4M)
+    {
+        size_t size = (size_t)c->width * c->height * 3;
+        encodeY4M(frame, c->width, c->height, c->encoded);
+        fputs("FRAME\n", c->file);
+        fwrite(c->encoded, 1, size, c->file);
+        c->bytes += 6 + size;
+    }
+    else
+    {
+        size_t size = packedBytes(c->width, c->height);
+        size_t length = encodeDelta(frame, c->previous, size, c->encoded);
+        fwrite(c->encoded, 1, length, c->file);
+        c->bytes += length;
+        memcpy(c->previous, frame, size);
+    }
+    c->frames++;
+}
+
+static void *encoderThread(void *arg)
+{
+    Capture *c = arg;
+    const struct timespec nap = {0, 1000000}; // 1 ms, a frame is 16
+
+    for (;;)
+    {
+        unsigned tail = atomic_load_explicit(&(c->tail), memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&(c->head), memory_order_acquire);
+        if (tail == head)
+        {
+            if (!atomic_load(&(c->running)))
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        encodeFrame(c, &(c->queue[(tail & (CAPTURE_QUEUE - 1)) * frameBytes(c)]));
+        atomic_store_explicit(&(c->tail), tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+static bool endsWith(const char *s, const char *suffix)
+{
+    size_t n = strlen(s);
+    size_t k = strlen(suffix);
+    return n >= k && !strcmp(s + n - k, suffix);
+}
+
+Capture *initCapture(const char *path, int width, int height)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+
+    Capture *c = calloc(1, sizeof(Capture));
+    if (c == NULL)
+        exit(EXIT_FAILURE);
+
+    c->file = file;
+    c->format = endsWith(path, ".y4m") ? CAPTURE_Y4M : CAPTURE_DELTA;
+    c->width = width;
+    c->height = height;
+
+    size_t packed = packedBytes(width, height);
+    c->queue = malloc(CAPTURE_QUEUE * frameBytes(c));
+    c->previous = calloc(1, packed);
+    c->encoded = malloc(c->format == CAPTURE_Y4M ? (size_t)width * height * 3 : 2 * packed + 16);
+    if (c->queue == NULL || c->previous == NULL || c->encoded == NULL)
+    {
+        printf("Capture allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (c->format == CAPTURE_Y4M)
+        c->bytes = (uint64_t)fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, CAPTURE_FPS);
+    else
+    {
+        uint8_t header[14];
+        memcpy(header, magic, sizeof(magic));
+        put16(&(header[8]), (uint16_t)width);
+        put16(&(header[10]), (uint16_t)height);
+        put16(&(header[12]), CAPTURE_FPS);
+        fwrite(header, 1, sizeof(header), file);
+        c->bytes = sizeof(header);
+    }
+
+    atomic_store(&(c->running), true);
+    if (pthread_create(&(c->thread), NULL, encoderThread, c) != 0)
+    {
+        printf("Capture encoder thread could not be started\n");
+        exit(EXIT_FAILURE);
+    }
+    return c;
+}
+
+void freeCapture(Capture *c)
+{
+    atomic_store(&(c->running), false);
+    pthread_join(c->thread, NULL);
+    fclose(c->file);
+    free(c->queue);
+    free(c->previous);
+    free(c->encoded);
+    free(c);
+}
+
+uint8_t *captureSlot(Capture *c)
+{
+    const struct timespec nap = {0, 100000};
+    unsigned head = atomic_load_explicit(&(c->head), memory_order_relaxed);
+    while (head - atomic_load_explicit(&(c->tail), memory_order_acquire) >= CAPTURE_QUEUE)
+        nanosleep(&nap, NULL);
+
+    return &(c->queue[(head & (CAPTURE_QUEUE - 1)) * frameBytes(c)]);
+}
+
+void captureFrame(Capture *c)
+{
+    unsigned head = atomic_load_explicit(&(c->head), memory_order_relaxed);
+    atomic_store_explicit(&(c->head), head + 1, memory_order_release);
+}
+
+/* Reading */
+
+CaptureReader *openCapture(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    uint8_t header[14];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, magic, sizeof(magic)))
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    CaptureReader *r = calloc(1, sizeof(CaptureReader));
+    if (r == NULL)
+        exit(EXIT_FAILURE);
+
+    r->file = file;
+    r->width = get16(&(header[8]));
+    r->height = get16(&(header[10]));
+    r->fps = get16(&(header[12]));
+    r->stride = (r->width + 7) / 8;
+    r->bits = calloc(1, packedBytes(r->width, r->height));
+    if (r->bits == NULL)
+    {
+        printf("Capture allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    return r;
+}
+
+void closeCapture(CaptureReader *r)
+{
+    fclose(r->file);
+    free(r->bits);
+    free(r);
+}
+
+bool captureNext(CaptureReader *r)
+{
+    size_t size = packedBytes(r->width, r->height);
+    size_t at = 0;
+    while (at < size)
+    {
+        size_t same;
+        size_t literals;
+        if (!readVarint(r->file, &same) || !readVarint(r->file, &literals) || same + literals > size - at)
+            return false;
+
+        at += same;
+        for (size_t end = at + literals; at < end; at++)
+        {
+            int c = fgetc(r->file);
+            if (c == EOF)
+                return false;
+            r->bits[at] ^= (uint8_t)c;
+        }
+    }
+    return true;
+}
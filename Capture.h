@@ -0,0 +1,86 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Video capture of the emulated frames, encoded by a background thread.
+// Two formats, picked by the file name:
+//   .y4m  YUV4MPEG2, 4:4:4, readable by ffmpeg and most players
+//   else  1bpp delta stream:
+//           "8080VID" '\0', u16 width, u16 height, u16 frames per second
+//           per frame, the rows packed MSB first, XORed with the frame
+//           before (zeros for the first), as pairs of LEB128 counts
+//           (unchanged bytes, literal bytes) followed by the literals,
+//           until the frame is covered
+// The lit pixels come from the board's VRAM, so a -background picture
+// doesn't show in the delta stream. Everything is little endian.
+#define CAPTURE_QUEUE 8 // frames between emulation and encoder, power of 2
+#define CAPTURE_FPS 60
+
+typedef enum
+{
+    CAPTURE_DELTA,
+    CAPTURE_Y4M,
+} CaptureFormat;
+
+typedef struct
+{
+    FILE *file;
+    CaptureFormat format;
+    int width;
+    int height;
+    uint64_t frames;
+
+    // Emulation writes into slot head of the queue, the encoder drains from
+    // tail
+    uint8_t *queue; // CAPTURE_QUEUE frames, RGBA for .y4m else packed
+    atomic_uint head;
+    atomic_uint tail;
+
+    // Encoder thread
+    uint8_t *previous; // packed frame before the one encoded
+    uint8_t *encoded;
+    uint64_t bytes; // written to the file
+    pthread_t thread;
+    atomic_bool running;
+} Capture;
+
+// Returns NULL if path can't be created
+Capture *initCapture(const char *path, int width, int height);
+// Encodes what is queued and closes the file
+void freeCapture(Capture *c);
+
+// Where to write the next frame: width x height RGBA for .y4m, else the
+// rows packed as in the delta stream. Only waits when the encoder is
+// CAPTURE_QUEUE frames behind.
+uint8_t *captureSlot(Capture *c);
+// Queues the frame written to the slot
+void captureFrame(Capture *c);
+
+// size bytes as unchanged runs and literals XORed with previous (zeros if
+// NULL), the frame format above and Stream's payload. dst needs room for
+// 2 * size + 16 bytes, returns the bytes written.
+size_t encodeDelta(const uint8_t *bits, const uint8_t *previous, size_t size, uint8_t *dst);
+
+typedef struct
+{
+    FILE *file;
+    int width;
+    int height;
+    int fps;
+    int stride; // bytes per packed row
+    uint8_t *bits;
+} CaptureReader;
+
+// Returns NULL if path isn't a delta stream
+CaptureReader *openCapture(const char *path);
+void closeCapture(CaptureReader *r);
+// Decodes the next frame into r->bits, false at the end of the stream
+bool captureNext(CaptureReader *r);
+
+#endif
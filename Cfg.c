@@ -0,0 +1,317 @@
+#include <string.h>
+#include "Cfg.h"
+
+#define NOT_A_BRANCH -1
+
+// BlockKind of an instruction that ends a block, NOT_A_BRANCH otherwise
+static int blockKind(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0xC3: case 0xCB: return BLOCK_JUMP;
+        case 0xCD: case 0xDD: case 0xED: case 0xFD: return BLOCK_CALL;
+        case 0xC9: case 0xD9: return BLOCK_RETURN;
+        case 0xE9: return BLOCK_INDIRECT;
+        case 0x76: return BLOCK_HALT;
+    }
+    switch (opcode & 0xC7)
+    {
+        case 0xC2: return BLOCK_BRANCH;
+        case 0xC4: case 0xC7: return BLOCK_CALL;
+        case 0xC0: return BLOCK_RETURN_IF;
+    }
+    return NOT_A_BRANCH;
+}
+
+// Target of a jump, call or RST at pc
+static uint16_t branchTarget(const uint8_t *mem, uint16_t pc)
+{
+    uint8_t opcode = mem[pc];
+    if ((opcode & 0xC7) == 0xC7)
+        return opcode & 0x38;
+    return (uint16_t)(mem[(uint16_t)(pc + 1)] | (mem[(uint16_t)(pc + 2)] << 8));
+}
+
+static bool inRom(const Cfg *cfg, uint32_t addr)
+{
+    return addr < MEM_SIZE && (cfg->flags[addr] & CFG_ROM);
+}
+
+typedef struct
+{
+    uint16_t *items;
+    int count;
+} WorkList;
+
+// Makes addr a block leader, queued to be decoded the first time
+static void addLeader(Cfg *cfg, WorkList *work, uint32_t addr, uint8_t flags)
+{
+    if (!inRom(cfg, addr))
+    {
+        cfg->exits++;
+        return;
+    }
+    cfg->flags[addr] |= flags;
+    if (cfg->flags[addr] & CFG_LEADER)
+        return;
+    cfg->flags[addr] |= CFG_LEADER;
+    work->items[work->count++] = (uint16_t)addr;
+}
+
+// Marks the instructions from addr up to the first that leaves the block
+static void decodeFrom(Cfg *cfg, WorkList *work, uint16_t addr)
+{
+    const uint8_t *mem = cfg->mem;
+    uint32_t pc = addr;
+    while (inRom(cfg, pc) && !(cfg->flags[pc] & CFG_CODE))
+    {
+        uint8_t opcode = mem[pc];
+        int length = length8080(opcode);
+        if (cfg->flags[pc] & CFG_OPERAND)
+            cfg->flags[pc] |= CFG_CONFLICT;
+        cfg->flags[pc] |= CFG_CODE;
+        cfg->instructions++;
+        for (int i = 1; i < length; i++)
+        {
+            uint16_t operand = (uint16_t)(pc + i);
+            if (cfg->flags[operand] & CFG_CODE)
+                cfg->flags[operand] |= CFG_CONFLICT;
+            cfg->flags[operand] |= CFG_OPERAND;
+        }
+
+        uint32_t next = pc + (uint32_t)length;
+        switch (blockKind(opcode))
+        {
+            case BLOCK_JUMP:
+                addLeader(cfg, work, branchTarget(mem, (uint16_t)pc), 0);
+                return;
+            case BLOCK_BRANCH:
+                addLeader(cfg, work, branchTarget(mem, (uint16_t)pc), 0);
+                addLeader(cfg, work, next, 0);
+                return;
+            case BLOCK_CALL:
+                addLeader(cfg, work, branchTarget(mem, (uint16_t)pc), CFG_FUNCTION);
+                addLeader(cfg, work, next, 0);
+                return;
+            case BLOCK_RETURN_IF:
+            case BLOCK_HALT:
+                addLeader(cfg, work, next, 0);
+                return;
+            case BLOCK_RETURN:
+                return;
+            case BLOCK_INDIRECT:
+                cfg->indirect++;
+                return;
+        }
+
+        // Absolute addresses of data (LXI loads constants as well)
+        if (opcode == 0x3A || opcode == 0x32 || opcode == 0x2A || opcode == 0x22 || opcode == 0x01
+            || opcode == 0x11 || opcode == 0x21)
+        {
+            uint16_t target = branchTarget(mem, (uint16_t)pc);
+            if (inRom(cfg, target))
+                cfg->flags[target] |= CFG_DATA;
+        }
+        pc = next;
+    }
+
+    // Ran into code decoded before, which now starts a block too
+    if (pc != addr && inRom(cfg, pc))
+        cfg->flags[pc] |= CFG_LEADER;
+}
+
+static void buildBlock(Cfg *cfg, CfgBlock *b, uint16_t start)
+{
+    const uint8_t *mem = cfg->mem;
+    *b = (CfgBlock){.start = start, .function = -1};
+    uint32_t pc = start;
+    for (;;)
+    {
+        uint8_t opcode = mem[pc];
+        uint32_t next = pc + (uint32_t)length8080(opcode);
+        b->count++;
+        b->cycles += (uint32_t)cycles8080(opcode);
+        b->last = (uint16_t)pc;
+        b->end = next;
+
+        int kind = blockKind(opcode);
+        if (kind != NOT_A_BRANCH)
+        {
+            b->kind = (uint8_t)kind;
+            b->hasTarget = kind == BLOCK_JUMP || kind == BLOCK_BRANCH || kind == BLOCK_CALL;
+            b->hasNext = kind != BLOCK_JUMP && kind != BLOCK_RETURN && kind != BLOCK_INDIRECT;
+            if (b->hasTarget)
+                b->target = branchTarget(mem, (uint16_t)pc);
+            return;
+        }
+        if (!inRom(cfg, next) || !(cfg->flags[next] & CFG_CODE))
+        {
+            b->kind = BLOCK_OUTSIDE;
+            return;
+        }
+        if (cfg->flags[next] & CFG_LEADER)
+        {
+            b->kind = BLOCK_FALLS;
+            b->hasNext = true;
+            return;
+        }
+        pc = next;
+    }
+}
+
+static int compareAddr(const void *a, const void *b)
+{
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+static void addFunction(Cfg *cfg, uint16_t entry, bool vector, bool given)
+{
+    if (!(cfg->flags[entry] & CFG_CODE) || cfgFunctionAt(cfg, entry) >= 0)
+        return;
+    cfg->functions[cfg->functionCount++] = (CfgFunction){.entry = entry, .vector = vector, .given = given};
+}
+
+// Gives the blocks a function reaches without calling to it, unless an
+// earlier one already has them
+static void claimBlocks(Cfg *cfg, int function, int *stack)
+{
+    CfgFunction *f = &(cfg->functions[function]);
+    int count = 0;
+    const CfgBlock *first = cfgBlockAt(cfg, f->entry);
+    if (first != NULL && first->start == f->entry)
+        stack[count++] = (int)(first - cfg->blocks);
+
+    while (count > 0)
+    {
+        CfgBlock *b = &(cfg->blocks[stack[--count]]);
+        if (b->function >= 0)
+            continue;
+        b->function = function;
+        f->blocks++;
+        f->instructions += b->count;
+
+        const CfgBlock *successors[2] = {NULL, NULL};
+        if (b->hasTarget && b->kind != BLOCK_CALL)
+            successors[0] = cfgBlockAt(cfg, b->target);
+        if (b->hasNext && b->end < MEM_SIZE)
+            successors[1] = cfgBlockAt(cfg, (uint16_t)b->end);
+        for (int i = 0; i < 2; i++)
+            if (successors[i] != NULL && successors[i]->function < 0)
+                stack[count++] = (int)(successors[i] - cfg->blocks);
+    }
+}
+
+Cfg *analyseROM(const MachineDesc *desc, const RomImage *rom, const uint16_t *entries, int entryCount)
+{
+    Cfg *cfg = calloc(1, sizeof(Cfg));
+    WorkList work = {.items = malloc(MEM_SIZE * sizeof(uint16_t))};
+    if (cfg == NULL || work.items == NULL || (cfg->flags = calloc(1, MEM_SIZE)) == NULL)
+        exit(EXIT_FAILURE);
+    cfg->mem = rom->data;
+    for (int i = 0; i < rom->spanCount; i++)
+    {
+        memset(&(cfg->flags[rom->spans[i].addr]), CFG_ROM, rom->spans[i].size);
+        cfg->romBytes += rom->spans[i].size;
+    }
+
+    // Recursive descent, with the work list standing in for the recursion
+    uint16_t vectors[3] = {0, (uint16_t)(desc->interrupts[0] * 8), (uint16_t)(desc->interrupts[1] * 8)};
+    for (int i = 0; i < 3; i++)
+        addLeader(cfg, &work, vectors[i], CFG_FUNCTION);
+    for (int i = 0; i < entryCount; i++)
+        addLeader(cfg, &work, entries[i], 0);
+    while (work.count > 0)
+        decodeFrom(cfg, &work, work.items[--work.count]);
+
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+    {
+        if ((cfg->flags[addr] & (CFG_LEADER | CFG_CODE)) == (CFG_LEADER | CFG_CODE))
+            cfg->blockCount++;
+        if (cfg->flags[addr] & CFG_CONFLICT)
+            cfg->conflicts++;
+    }
+    cfg->blocks = calloc((size_t)cfg->blockCount + 1, sizeof(CfgBlock));
+    if (cfg->blocks == NULL)
+        exit(EXIT_FAILURE);
+    int index = 0;
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+        if ((cfg->flags[addr] & (CFG_LEADER | CFG_CODE)) == (CFG_LEADER | CFG_CODE))
+            buildBlock(cfg, &(cfg->blocks[index++]), (uint16_t)addr);
+
+    // Functions: vectors, what the ROM calls, then the given entries
+    int entryFunctions = entryCount;
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+        if (cfg->flags[addr] & CFG_FUNCTION)
+            entryFunctions++;
+    cfg->functions = calloc((size_t)entryFunctions + 1, sizeof(CfgFunction));
+    uint16_t *given = malloc(((size_t)entryCount + 1) * sizeof(uint16_t));
+    if (cfg->functions == NULL || given == NULL)
+        exit(EXIT_FAILURE);
+    for (int i = 0; i < 3; i++)
+        addFunction(cfg, vectors[i], true, false);
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+        if (cfg->flags[addr] & CFG_FUNCTION)
+            addFunction(cfg, (uint16_t)addr, false, false);
+    if (entryCount > 0)
+    {
+        memcpy(given, entries, (size_t)entryCount * sizeof(uint16_t));
+        qsort(given, (size_t)entryCount, sizeof(uint16_t), compareAddr);
+    }
+    for (int i = 0; i < entryCount; i++)
+        addFunction(cfg, given[i], false, true);
+    free(given);
+
+    for (int i = 0; i < cfg->blockCount; i++)
+    {
+        int callee = cfg->blocks[i].kind == BLOCK_CALL ? cfgFunctionAt(cfg, cfg->blocks[i].target) : -1;
+        if (callee >= 0)
+            cfg->functions[callee].callers++;
+    }
+
+    int *stack = malloc(((size_t)cfg->blockCount + 1) * 2 * sizeof(int));
+    if (stack == NULL)
+        exit(EXIT_FAILURE);
+    for (int i = 0; i < cfg->functionCount; i++)
+        claimBlocks(cfg, i, stack);
+    free(stack);
+    free(work.items);
+    return cfg;
+}
+
+void freeCfg(Cfg *cfg)
+{
+    free(cfg->flags);
+    free(cfg->blocks);
+    free(cfg->functions);
+    free(cfg);
+}
+
+const CfgBlock *cfgBlockAt(const Cfg *cfg, uint16_t pc)
+{
+    // Last block starting at or before pc
+    int low = 0;
+    int high = cfg->blockCount - 1;
+    int found = -1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (cfg->blocks[mid].start <= pc)
+        {
+            found = mid;
+            low = mid + 1;
+        }
+        else
+            high = mid - 1;
+    }
+    if (found < 0 || pc >= cfg->blocks[found].end)
+        return NULL;
+    return &(cfg->blocks[found]);
+}
+
+int cfgFunctionAt(const Cfg *cfg, uint16_t pc)
+{
+    for (int i = 0; i < cfg->functionCount; i++)
+        if (cfg->functions[i].entry == pc)
+            return i;
+    return -1;
+}
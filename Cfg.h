@@ -0,0 +1,89 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Rom.h"
+
+// Control flow graph of a ROM, found by recursive descent from the reset
+// vector, the board's interrupt vectors and any extra entries: every jump,
+// branch, call and RST target is followed, inside the ROM only. What is
+// never reached is data as far as the analysis can tell. PCHL targets can't
+// be followed statically, they are listed so a trace can supply them.
+// Calls are assumed to return to the instruction after them.
+
+// Per byte of the address space
+#define CFG_CODE     0x01 // first byte of a reached instruction
+#define CFG_OPERAND  0x02 // operand byte of a reached instruction
+#define CFG_LEADER   0x04 // a basic block starts here
+#define CFG_FUNCTION 0x08 // entered by a vector, CALL or RST
+#define CFG_DATA     0x10 // address loaded by LDA, LHLD, STA, SHLD or LXI
+#define CFG_CONFLICT 0x20 // both an instruction start and inside another one
+#define CFG_ROM      0x40 // loaded from the ROM
+
+typedef enum
+{
+    BLOCK_FALLS,     // runs into the next block, which is also a target
+    BLOCK_JUMP,      // JMP
+    BLOCK_BRANCH,    // conditional jump, target or next
+    BLOCK_CALL,      // CALL, conditional call or RST, next once it returns
+    BLOCK_RETURN,    // RET
+    BLOCK_RETURN_IF, // conditional return, or next
+    BLOCK_INDIRECT,  // PCHL
+    BLOCK_HALT,      // HLT, next after an interrupt
+    BLOCK_OUTSIDE,   // runs off the end of the ROM
+} BlockKind;
+
+typedef struct
+{
+    uint16_t start;
+    uint16_t last;     // address of the last instruction
+    uint32_t end;      // address after the last instruction
+    uint16_t target;   // of a jump, branch or call, if hasTarget
+    uint16_t count;    // instructions
+    uint32_t cycles;   // with conditional calls and returns taken
+    int function;      // index into Cfg.functions of the first to reach it
+    uint8_t kind;      // BlockKind
+    bool hasTarget;
+    bool hasNext;      // control can go on at end
+} CfgBlock;
+
+typedef struct
+{
+    uint16_t entry;
+    bool vector; // reset or interrupt, not called by the ROM
+    bool given;  // one of the extra entries (a PCHL target...)
+    int blocks;
+    int instructions;
+    int callers; // call sites, over all functions
+} CfgFunction;
+
+typedef struct
+{
+    uint8_t *flags; // MEM_SIZE, CFG_ bits
+    const uint8_t *mem; // the ROM image analysed
+    uint32_t romBytes;
+
+    CfgBlock *blocks; // sorted by start
+    int blockCount;
+    CfgFunction *functions; // vectors, then called, then given, by entry
+    int functionCount;
+
+    int instructions;
+    int conflicts;
+    int indirect; // PCHL sites
+    int exits;    // targets outside the ROM
+} Cfg;
+
+// Entries come on top of reset and the desc's interrupt vectors
+Cfg *analyseROM(const MachineDesc *desc, const RomImage *rom, const uint16_t *entries, int entryCount);
+void freeCfg(Cfg *cfg);
+
+// Block starting at pc, else the last one starting before it if it holds
+// pc, else NULL
+const CfgBlock *cfgBlockAt(const Cfg *cfg, uint16_t pc);
+// Index of the function entered at pc, -1 if pc isn't an entry
+int cfgFunctionAt(const Cfg *cfg, uint16_t pc);
+
+#endif
@@ -0,0 +1,599 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "Debugger.h"
+
+// Z80 register numbering, the 8080 has the first six
+#define REG_PC 5
+#define REG_COUNT 13
+
+typedef enum
+{
+    SERVE_REPLY,  // send d->reply and wait for the next packet
+    SERVE_RESUME, // continue or step, the reply is the next stop
+    SERVE_DETACH,
+} ServeResult;
+
+static void rearm(Debugger *d)
+{
+    d->armed = d->client >= 0 && (d->breakCount > 0 || d->watchCount > 0 || d->stepping || d->interrupted);
+}
+
+// Condition field of Jcc/Ccc/Rcc: NZ Z NC C PO PE P M
+static bool condition(const State *s, uint8_t op)
+{
+    bool flag;
+    switch ((op >> 4) & 3)
+    {
+        case 0: flag = s->codes->z; break;
+        case 1: flag = s->codes->c; break;
+        case 2: flag = s->codes->p; break;
+        default: flag = s->codes->s; break;
+    }
+    return (op & 0x08) ? flag : !flag;
+}
+
+static DataAccess dataAccess(uint16_t addr, uint16_t len, bool read, bool write)
+{
+    return (DataAccess){.addr = addr, .len = len, .read = read, .write = write};
+}
+
+// Decode the memory the instruction at PC is going to touch, len 0 if none.
+// Every 8080 instruction has at most one data access.
+static DataAccess nextAccess(const State *s)
+{
+    uint8_t buf[3];
+    const uint8_t *code = memFetch(s->map, s->pc, buf);
+    uint8_t op = code[0];
+    uint16_t imm = (uint16_t)(code[1] | (code[2] << 8));
+    uint16_t push = (uint16_t)(s->sp - 2);
+
+    // MOV r,M and the ALU on M read (HL), MOV M,r writes it
+    if (op >= 0x40 && op < 0xC0 && op != 0x76)
+    {
+        bool read = (op & 0x07) == 6;
+        bool write = op < 0x80 && (op & 0x38) == 0x30;
+        return dataAccess(s->hl, (read || write) ? 1 : 0, read, write);
+    }
+
+    switch (op)
+    {
+        case 0x02: return dataAccess(s->bc, 1, false, true);   // STAX B
+        case 0x12: return dataAccess(s->de, 1, false, true);   // STAX D
+        case 0x0A: return dataAccess(s->bc, 1, true, false);   // LDAX B
+        case 0x1A: return dataAccess(s->de, 1, true, false);   // LDAX D
+        case 0x22: return dataAccess(imm, 2, false, true);     // SHLD
+        case 0x2A: return dataAccess(imm, 2, true, false);     // LHLD
+        case 0x32: return dataAccess(imm, 1, false, true);     // STA
+        case 0x3A: return dataAccess(imm, 1, true, false);     // LDA
+        case 0x34:                                             // INR M
+        case 0x35: return dataAccess(s->hl, 1, true, true);    // DCR M
+        case 0x36: return dataAccess(s->hl, 1, false, true);   // MVI M
+        case 0xE3: return dataAccess(s->sp, 2, true, true);    // XTHL
+        case 0xC9:
+        case 0xD9: return dataAccess(s->sp, 2, true, false);   // RET
+        case 0xCD:
+        case 0xDD:
+        case 0xED:
+        case 0xFD: return dataAccess(push, 2, false, true);    // CALL
+    }
+
+    if ((op & 0xCF) == 0xC5)
+        return dataAccess(push, 2, false, true); // PUSH
+    if ((op & 0xCF) == 0xC1)
+        return dataAccess(s->sp, 2, true, false); // POP
+    if ((op & 0xC7) == 0xC7)
+        return dataAccess(push, 2, false, true); // RST
+    if ((op & 0xC7) == 0xC0 && condition(s, op))
+        return dataAccess(s->sp, 2, true, false); // Rcc taken
+    if ((op & 0xC7) == 0xC4 && condition(s, op))
+        return dataAccess(push, 2, false, true); // Ccc taken
+    return dataAccess(0, 0, false, false);
+}
+
+/* Packets */
+
+static int hexDigit(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Two hex digits, -1 if they aren't
+static int hexByte(const char *s)
+{
+    int hi = hexDigit(s[0]);
+    int lo = hi < 0 ? -1 : hexDigit(s[1]);
+    return lo < 0 ? -1 : (hi << 4) | lo;
+}
+
+// Blocks, -1 when GDB hung up
+static int readByte(Debugger *d)
+{
+    if (d->inputNext == d->inputLength)
+    {
+        ssize_t n = recv(d->client, d->input, DEBUG_INPUT, 0);
+        if (n <= 0)
+            return -1;
+        d->inputLength = (int)n;
+        d->inputNext = 0;
+    }
+    return d->input[d->inputNext++];
+}
+
+// Next well formed packet into d->packet, false when GDB hung up. Acks and
+// stray ^C before it are skipped.
+static bool receivePacket(Debugger *d)
+{
+    for (;;)
+    {
+        int c;
+        while ((c = readByte(d)) != '$')
+        {
+            if (c < 0)
+                return false;
+        }
+
+        int length = 0;
+        uint8_t sum = 0;
+        while ((c = readByte(d)) != '#')
+        {
+            if (c < 0)
+                return false;
+            if (length < DEBUG_PACKET - 1)
+                d->packet[length++] = (char)c;
+            sum = (uint8_t)(sum + c);
+        }
+        d->packet[length] = '\0';
+
+        char check[3] = {0};
+        for (int i = 0; i < 2; i++)
+        {
+            if ((c = readByte(d)) < 0)
+                return false;
+            check[i] = (char)c;
+        }
+
+        char ack = hexByte(check) == sum ? '+' : '-';
+        send(d->client, &ack, 1, MSG_NOSIGNAL);
+        if (ack == '+')
+            return true;
+    }
+}
+
+static void sendPacket(Debugger *d, const char *data)
+{
+    char frame[DEBUG_PACKET + 4];
+    uint8_t sum = 0;
+    size_t length = strlen(data);
+    for (size_t i = 0; i < length; i++)
+        sum = (uint8_t)(sum + data[i]);
+
+    int n = snprintf(frame, sizeof(frame), "$%s#%02x", data, sum);
+    send(d->client, frame, (size_t)n, MSG_NOSIGNAL);
+}
+
+/* Registers and memory */
+
+static uint16_t getRegister(const State *s, int n)
+{
+    const Codes *c = s->codes;
+    switch (n)
+    {
+        case 0: return (uint16_t)((s->a << 8) | c->c | 0x02 | (c->p << 2) | (c->ac << 4) | (c->z << 6) | (c->s << 7));
+        case 1: return s->bc;
+        case 2: return s->de;
+        case 3: return s->hl;
+        case 4: return s->sp;
+        case REG_PC: return s->pc;
+    }
+    return 0; // IX, IY, the shadow set and IR
+}
+
+static void setRegister(State *s, int n, uint16_t value)
+{
+    switch (n)
+    {
+        case 0:
+        {
+            s->a = (uint8_t)(value >> 8);
+            s->f = (uint8_t)value;
+            s->codes->c = value & 0x01;
+            s->codes->p = (value >> 2) & 1;
+            s->codes->ac = (value >> 4) & 1;
+            s->codes->z = (value >> 6) & 1;
+            s->codes->s = (value >> 7) & 1;
+            break;
+        }
+        case 1: s->bc = value; break;
+        case 2: s->de = value; break;
+        case 3: s->hl = value; break;
+        case 4: s->sp = value; break;
+        case REG_PC: s->pc = value; s->halted = false; break;
+    }
+}
+
+// Registers go over the wire little endian
+static char *putRegister(char *out, uint16_t value)
+{
+    sprintf(out, "%02x%02x", value & 0xFF, value >> 8);
+    return out + 4;
+}
+
+static bool parseRegister(const char *in, uint16_t *value)
+{
+    int lo = hexByte(in);
+    int hi = lo < 0 ? -1 : hexByte(in + 2);
+    *value = (uint16_t)((hi << 8) | lo);
+    return hi >= 0;
+}
+
+// GDB may patch ROM too, so writes go straight to the backing page
+static void pokeMemory(Memory *map, uint16_t addr, uint8_t value)
+{
+    int page = addr >> MEM_PAGE_SHIFT;
+    if (map->type[page] != PAGE_UNMAPPED)
+        map->target[page][addr & MEM_PAGE_MASK] = value;
+}
+
+// "addr,len" in hex, end points past it
+static bool parseRange(const char *in, uint16_t *addr, uint16_t *len, char **end)
+{
+    unsigned long a = strtoul(in, end, 16);
+    if (**end != ',')
+        return false;
+    unsigned long n = strtoul(*end + 1, end, 16);
+    *addr = (uint16_t)a;
+    *len = (uint16_t)(n > MEM_SIZE ? MEM_SIZE : n);
+    return a < MEM_SIZE;
+}
+
+/* Breakpoints and watchpoints */
+
+static bool isBreakpoint(const Debugger *d, uint16_t addr)
+{
+    return d->breaks[addr >> 3] & (1 << (addr & 7));
+}
+
+static void setBreakpoint(Debugger *d, uint16_t addr, bool set)
+{
+    if (isBreakpoint(d, addr) == set)
+        return;
+
+    int delta = set ? 1 : -1;
+    d->breaks[addr >> 3] ^= (uint8_t)(1 << (addr & 7));
+    d->pageBreaks[addr >> MEM_PAGE_SHIFT] = (uint16_t)(d->pageBreaks[addr >> MEM_PAGE_SHIFT] + delta);
+    d->breakCount += delta;
+}
+
+static bool setWatchpoint(Debugger *d, WatchType type, uint16_t addr, uint16_t len, bool set)
+{
+    for (int i = 0; i < d->watchCount; i++)
+    {
+        Watchpoint *w = &(d->watches[i]);
+        if (w->type == type && w->addr == addr && w->len == len)
+        {
+            if (!set)
+                *w = d->watches[--d->watchCount];
+            return true;
+        }
+    }
+
+    if (!set || d->watchCount == DEBUG_WATCHPOINTS || len == 0)
+        return !set;
+    d->watches[d->watchCount++] = (Watchpoint){.addr = addr, .len = len, .type = type};
+    return true;
+}
+
+// Z/z type,addr,kind
+static const char *breakpointPacket(Debugger *d)
+{
+    bool set = d->packet[0] == 'Z';
+    int type = d->packet[1] - '0';
+    uint16_t addr;
+    uint16_t len;
+    char *end;
+    if (d->packet[2] != ',' || !parseRange(d->packet + 3, &addr, &len, &end))
+        return "E01";
+
+    switch (type)
+    {
+        case 0: // software and hardware breakpoints are the same thing here
+        case 1: setBreakpoint(d, addr, set); return "OK";
+        case WATCH_WRITE:
+        case WATCH_READ:
+        case WATCH_ACCESS: return setWatchpoint(d, (WatchType)type, addr, len, set) ? "OK" : "E02";
+    }
+    return "";
+}
+
+static void detach(Debugger *d)
+{
+    close(d->client);
+    d->client = -1;
+    d->inputLength = d->inputNext = 0;
+    memset(d->breaks, 0, sizeof(d->breaks));
+    memset(d->pageBreaks, 0, sizeof(d->pageBreaks));
+    d->breakCount = 0;
+    d->watchCount = 0;
+    d->stepping = false;
+    d->interrupted = false;
+    rearm(d);
+}
+
+/* Protocol */
+
+static ServeResult handlePacket(Debugger *d)
+{
+    State *cpu = d->cpu;
+    const char *p = d->packet;
+    char *end;
+    uint16_t addr;
+    uint16_t len;
+    const char *reply = "";
+
+    switch (p[0])
+    {
+        case '?': reply = "S05"; break;
+
+        case 'g':
+        {
+            char *out = d->reply;
+            for (int i = 0; i < REG_COUNT; i++)
+                out = putRegister(out, getRegister(cpu, i));
+            return SERVE_REPLY;
+        }
+
+        case 'G':
+        {
+            for (int i = 0; i < REG_COUNT && p[1 + 4 * i] != '\0'; i++)
+            {
+                uint16_t value;
+                if (!parseRegister(p + 1 + 4 * i, &value))
+                    break;
+                setRegister(cpu, i, value);
+            }
+            reply = "OK";
+            break;
+        }
+
+        case 'p':
+        {
+            putRegister(d->reply, getRegister(cpu, (int)strtol(p + 1, NULL, 16)));
+            return SERVE_REPLY;
+        }
+
+        case 'P':
+        {
+            long n = strtol(p + 1, &end, 16);
+            uint16_t value;
+            reply = (*end == '=' && parseRegister(end + 1, &value)) ? "OK" : "E01";
+            if (reply[0] == 'O')
+                setRegister(cpu, (int)n, value);
+            break;
+        }
+
+        case 'm':
+        {
+            if (!parseRange(p + 1, &addr, &len, &end))
+            {
+                reply = "E01";
+                break;
+            }
+            len = len > (DEBUG_PACKET - 1) / 2 ? (DEBUG_PACKET - 1) / 2 : len;
+            for (int i = 0; i < len; i++)
+                sprintf(&(d->reply[2 * i]), "%02x", memRead(cpu->map, (uint16_t)(addr + i)));
+            d->reply[2 * len] = '\0';
+            return SERVE_REPLY;
+        }
+
+        case 'M':
+        {
+            reply = "OK";
+            if (!parseRange(p + 1, &addr, &len, &end) || *end != ':' || strlen(end + 1) < 2u * len)
+            {
+                reply = "E01";
+                break;
+            }
+            for (int i = 0; i < len; i++)
+            {
+                int value = hexByte(end + 1 + 2 * i);
+                if (value < 0)
+                {
+                    reply = "E01";
+                    break;
+                }
+                pokeMemory(cpu->map, (uint16_t)(addr + i), (uint8_t)value);
+            }
+            break;
+        }
+
+        // c [addr], s [addr]
+        case 'c':
+        case 's':
+        {
+            if (p[1] != '\0')
+                setRegister(cpu, REG_PC, (uint16_t)strtoul(p + 1, NULL, 16));
+            d->stepping = p[0] == 's';
+            return SERVE_RESUME;
+        }
+
+        case 'Z':
+        case 'z': reply = breakpointPacket(d); break;
+
+        case 'H': reply = "OK"; break; // one thread
+        case 'D': sendPacket(d, "OK"); return SERVE_DETACH;
+        case 'k': return SERVE_DETACH; // the emulator goes on without GDB
+
+        case 'q':
+        {
+            if (!strncmp(p, "qSupported", 10))
+            {
+                snprintf(d->reply, sizeof(d->reply), "PacketSize=%x", DEBUG_PACKET - 1);
+                return SERVE_REPLY;
+            }
+            if (!strcmp(p, "qAttached"))
+                reply = "1";
+            break;
+        }
+    }
+
+    snprintf(d->reply, sizeof(d->reply), "%s", reply);
+    return SERVE_REPLY;
+}
+
+// Answer GDB until it resumes execution or goes away
+static void serve(Debugger *d)
+{
+    for (;;)
+    {
+        if (!receivePacket(d))
+        {
+            detach(d);
+            return;
+        }
+
+        switch (handlePacket(d))
+        {
+            case SERVE_REPLY: sendPacket(d, d->reply); break;
+            case SERVE_RESUME: rearm(d); return;
+            case SERVE_DETACH: detach(d); return;
+        }
+    }
+}
+
+static void stop(Debugger *d, const char *reason)
+{
+    d->stepping = false;
+    d->interrupted = false;
+    sendPacket(d, reason);
+    serve(d);
+}
+
+static void attach(Debugger *d, int client)
+{
+    int one = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+    d->client = client;
+    d->inputLength = d->inputNext = 0;
+    printf("GDB attached at PC %04x\n", d->cpu->pc);
+    fflush(stdout);
+
+    // GDB asks why we're stopped itself
+    serve(d);
+}
+
+Debugger *initDebugger(State *cpu, int port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port = htons((uint16_t)port);
+
+    int one = 1;
+    if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || bind(sock, (struct sockaddr *)&local, sizeof(local)) != 0 || listen(sock, 1) != 0
+        || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        if (sock >= 0)
+            close(sock);
+        return NULL;
+    }
+
+    Debugger *d = calloc(1, sizeof(Debugger));
+    if (d == NULL)
+        exit(EXIT_FAILURE);
+
+    d->cpu = cpu;
+    d->listener = sock;
+    d->client = -1;
+    printf("Waiting for GDB on port %d\n", port);
+    fflush(stdout);
+
+    // Nothing runs before the first client has had its say
+    struct pollfd pfd = {.fd = sock, .events = POLLIN};
+    int client = -1;
+    while (client < 0)
+    {
+        poll(&pfd, 1, -1);
+        client = accept(sock, NULL, NULL);
+    }
+    attach(d, client);
+    return d;
+}
+
+void freeDebugger(Debugger *d)
+{
+    if (d->client >= 0)
+    {
+        sendPacket(d, "W00");
+        close(d->client);
+    }
+    close(d->listener);
+    free(d);
+}
+
+void debuggerBefore(Debugger *d)
+{
+    uint16_t pc = d->cpu->pc;
+    bool hit = d->pageBreaks[pc >> MEM_PAGE_SHIFT] != 0 && isBreakpoint(d, pc);
+    if (hit || d->interrupted)
+        stop(d, hit ? "S05" : "S02");
+
+    d->pending = d->watchCount > 0 ? nextAccess(d->cpu) : dataAccess(0, 0, false, false);
+}
+
+void debuggerAfter(Debugger *d)
+{
+    DataAccess a = d->pending;
+    for (int i = 0; i < d->watchCount && a.len > 0; i++)
+    {
+        const Watchpoint *w = &(d->watches[i]);
+        bool inside = (uint16_t)(a.addr - w->addr) < w->len;
+        bool overlaps = inside || (uint16_t)(w->addr - a.addr) < a.len;
+        bool matches = w->type == WATCH_ACCESS || (w->type == WATCH_WRITE ? a.write : a.read);
+        if (overlaps && matches)
+        {
+            const char *kind = w->type == WATCH_WRITE ? "watch" : (w->type == WATCH_READ ? "rwatch" : "awatch");
+            snprintf(d->reply, sizeof(d->reply), "T05%s:%04x;", kind, inside ? a.addr : w->addr);
+            stop(d, d->reply);
+            return;
+        }
+    }
+
+    if (d->stepping)
+        stop(d, "S05");
+}
+
+void debuggerPoll(Debugger *d)
+{
+    if (d->client < 0)
+    {
+        int client = accept(d->listener, NULL, NULL);
+        if (client >= 0)
+            attach(d, client);
+        return;
+    }
+
+    // All-stop mode: GDB sends nothing but ^C while the program runs
+    ssize_t n = recv(d->client, d->input, DEBUG_INPUT, MSG_DONTWAIT);
+    d->inputLength = d->inputNext = 0;
+    if (n == 0)
+        detach(d);
+    else if (n > 0 && memchr(d->input, 0x03, (size_t)n) != NULL)
+    {
+        d->interrupted = true;
+        rearm(d);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "8080.h"
+
+// GDB remote serial protocol stub. GDB has no 8080 target, the Z80 one
+// reads the registers (af bc de hl sp pc, the Z80 only ones are 0):
+//   gdb-multiarch -ex "set architecture z80" -ex "target remote :1234"
+#define DEBUG_PACKET 4096
+#define DEBUG_WATCHPOINTS 16
+#define DEBUG_INPUT 512
+
+// Same numbering as the Z packets
+typedef enum
+{
+    WATCH_WRITE = 2,
+    WATCH_READ = 3,
+    WATCH_ACCESS = 4,
+} WatchType;
+
+typedef struct
+{
+    uint16_t addr;
+    uint16_t len;
+    WatchType type;
+} Watchpoint;
+
+// Memory an instruction is about to read or write, len 0 for none
+typedef struct
+{
+    uint16_t addr;
+    uint16_t len;
+    bool read;
+    bool write;
+} DataAccess;
+
+typedef struct
+{
+    State *cpu;
+    int listener;
+    int client; // -1 while no GDB is attached
+
+    // Set when anything below needs a look around each instruction, the
+    // only thing checked on the hot path
+    bool armed;
+    bool stepping;
+    bool interrupted; // ^C from GDB, stop before the next instruction
+
+    int breakCount;
+    uint16_t pageBreaks[MEM_PAGES]; // breakpoints in each page
+    uint8_t breaks[MEM_SIZE / 8];
+
+    Watchpoint watches[DEBUG_WATCHPOINTS];
+    int watchCount;
+    DataAccess pending; // of the instruction being executed
+
+    uint8_t input[DEBUG_INPUT];
+    int inputLength;
+    int inputNext;
+    char packet[DEBUG_PACKET];
+    char reply[DEBUG_PACKET];
+} Debugger;
+
+// Listens on 127.0.0.1:port and waits for GDB to attach, then serves it
+// until it continues. NULL if the port can't be bound.
+Debugger *initDebugger(State *cpu, int port);
+// Tells GDB the program exited
+void freeDebugger(Debugger *d);
+
+// Around every instruction while d->armed: stop at breakpoints, single
+// steps and watchpoints and serve GDB until it resumes
+void debuggerBefore(Debugger *d);
+void debuggerAfter(Debugger *d);
+
+// Now and then (every frame) while running: picks up ^C and new clients
+void debuggerPoll(Debugger *d);
+
+#endif
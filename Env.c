@@ -0,0 +1,159 @@
+#include <string.h>
+#include "Env.h"
+#include "GameState.h"
+#include "Rom.h"
+
+static uint32_t readScore(const Machine *m)
+{
+    GameState gs;
+    readGameState(m, &gs);
+    return gs.score[0];
+}
+
+// Downsample straight from VRAM (same rotation as updateVideo()), only the
+// lit pixels cost anything
+static void writeObservation(const Env *env, const Machine *m, uint8_t *obs)
+{
+    const uint8_t *vram = &(m->state8080->mem[m->desc->vramAddr]);
+    int height = m->desc->screenHeight;
+    int columnBytes = height / 8;
+
+    memset(obs, 0, env->obsSize);
+    for (int x = 0; x < env->obsWidth * env->scale; x++)
+    {
+        int ox = x / env->scale;
+        for (int k = 0; k < columnBytes; k++)
+        {
+            uint8_t byte = vram[x * columnBytes + k];
+            for (int bit = 0; byte != 0; bit++, byte >>= 1)
+            {
+                int oy = (height - 1 - (k * 8 + bit)) / env->scale;
+                if (!(byte & 1) || oy >= env->obsHeight)
+                    continue;
+
+                if (env->format == OBS_GRAY)
+                    obs[oy * env->obsPitch + ox]++;
+                else
+                    obs[oy * env->obsPitch + ox / 8] |= 0x80 >> (ox & 7);
+            }
+        }
+    }
+
+    // Pixel counts to intensities
+    if (env->format == OBS_GRAY && env->scale > 1)
+    {
+        int area = env->scale * env->scale;
+        for (size_t i = 0; i < env->obsSize; i++)
+            obs[i] = (uint8_t)(obs[i] * 255 / area);
+    }
+    else if (env->format == OBS_GRAY)
+    {
+        for (size_t i = 0; i < env->obsSize; i++)
+            obs[i] = obs[i] ? 255 : 0;
+    }
+}
+
+// Returns NULL if the ROM can't be read or the settings make no sense (the
+// grayscale counts have to fit a byte, so scale is at most 15)
+Env *initEnv(const char *romPath, int instances, int frameSkip, ObsFormat format, int scale)
+{
+    if (instances <= 0 || frameSkip <= 0 || scale <= 0 || scale > 15)
+        return NULL;
+
+    Env *env = calloc(1, sizeof(Env));
+    if (env == NULL)
+        exit(EXIT_FAILURE);
+
+    const MachineDesc *desc = findMachine("invaders");
+    env->instances = instances;
+    env->frameSkip = frameSkip;
+    env->format = format;
+    env->scale = scale;
+    env->obsWidth = desc->screenWidth / scale;
+    env->obsHeight = desc->screenHeight / scale;
+    env->obsPitch = (format == OBS_GRAY) ? (size_t)env->obsWidth : (size_t)(env->obsWidth + 7) / 8;
+    env->obsSize = env->obsPitch * env->obsHeight;
+
+    size_t obsTotal = env->obsSize * instances;
+    env->rewardOffset = (obsTotal + sizeof(int32_t) - 1) / sizeof(int32_t) * sizeof(int32_t);
+
+    env->machines = malloc(sizeof(Machine *) * instances);
+    env->score = calloc(instances, sizeof(uint32_t));
+    if (env->machines == NULL || env->score == NULL)
+        exit(EXIT_FAILURE);
+
+    // The ROM is read and checked once for the whole pool
+    RomImage *rom = openROM(desc, romPath);
+    if (rom == NULL)
+    {
+        env->instances = 0;
+        freeEnv(env);
+        return NULL;
+    }
+    for (int i = 0; i < instances; i++)
+    {
+        env->machines[i] = initMachine(desc);
+        applyROM(env->machines[i], rom);
+    }
+    freeROM(rom);
+
+    // Lockstep only pays off once there is a vector's worth of lanes
+    env->lockstep = (instances >= LOCKSTEP_CHUNK) ? initLockstep(env->machines, instances) : NULL;
+    return env;
+}
+
+void freeEnv(Env *env)
+{
+    if (env->lockstep != NULL)
+        freeLockstep(env->lockstep);
+    for (int i = 0; i < env->instances; i++)
+        freeMachine(env->machines[i]);
+    free(env->machines);
+    free(env->score);
+    free(env);
+}
+
+size_t envBufferSize(const Env *env)
+{
+    return env->rewardOffset + sizeof(int32_t) * env->instances;
+}
+
+void envReset(Env *env, uint8_t *buffer)
+{
+    int32_t *reward = (int32_t *)(buffer + env->rewardOffset);
+    for (int i = 0; i < env->instances; i++)
+    {
+        machineReset(env->machines[i]);
+        env->score[i] = readScore(env->machines[i]);
+        writeObservation(env, env->machines[i], buffer + env->obsSize * i);
+        reward[i] = 0;
+    }
+}
+
+void envStep(Env *env, const uint8_t *actions, uint8_t *buffer)
+{
+    for (int i = 0; i < env->instances; i++)
+        machineSetAction(env->machines[i], 0, actions[i]);
+
+    for (int frame = 0; frame < env->frameSkip; frame++)
+    {
+        if (env->lockstep != NULL)
+            lockstepRunFrame(env->lockstep);
+        else
+        {
+            for (int i = 0; i < env->instances; i++)
+                runFrame(env->machines[i]);
+        }
+    }
+
+    int32_t *reward = (int32_t *)(buffer + env->rewardOffset);
+    for (int i = 0; i < env->instances; i++)
+    {
+        // The score only drops when a new game starts
+        uint32_t score = readScore(env->machines[i]);
+        reward[i] = (score >= env->score[i]) ? (int32_t)(score - env->score[i]) : 0;
+        env->score[i] = score;
+
+        writeObservation(env, env->machines[i], buffer + env->obsSize * i);
+    }
+}
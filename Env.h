@@ -0,0 +1,49 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Machine.h"
+#include "Lockstep.h"
+
+/* Space Invaders as a batched reinforcement learning environment */
+
+typedef enum
+{
+    OBS_1BPP, // rows of packed pixels, MSB first, set if any source pixel is
+    OBS_GRAY, // one byte per pixel, the lit fraction of the source block
+} ObsFormat;
+
+// Everything a step produces goes into one caller-owned buffer of
+// envBufferSize() bytes:
+//   uint8_t obs[instances][obsSize]   at offset 0
+//   int32_t reward[instances]         at rewardOffset, score delta of the step
+typedef struct
+{
+    int instances;
+    int frameSkip; // runFrame() calls per step
+    ObsFormat format;
+    int scale;     // downsampling factor of the observation
+
+    int obsWidth;
+    int obsHeight;
+    size_t obsPitch; // bytes per observation row
+    size_t obsSize;
+    size_t rewardOffset;
+
+    Machine **machines;
+    Lockstep *lockstep; // NULL when the pool is too small to gain from it
+    uint32_t *score;    // score at the end of the last step
+} Env;
+
+Env *initEnv(const char *romPath, int instances, int frameSkip, ObsFormat format, int scale);
+void freeEnv(Env *env);
+size_t envBufferSize(const Env *env);
+
+// Power cycle every instance and write the first observations
+void envReset(Env *env, uint8_t *buffer);
+
+// actions holds one byte of ACTION_ bits (Machine.h) per instance
+void envStep(Env *env, const uint8_t *actions, uint8_t *buffer);
+
+#endif
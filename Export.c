@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Export.h"
+
+static void objectName(char *out, size_t size, const char *name)
+{
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static ExportSlot *slotAt(const ExportHeader *h, uint64_t frame)
+{
+    return (ExportSlot *)((uint8_t *)h + h->headerSize + (size_t)(frame % h->slotCount) * h->slotSize);
+}
+
+static uint32_t alignUp(size_t size)
+{
+    return (uint32_t)((size + EXPORT_ALIGN - 1) / EXPORT_ALIGN * EXPORT_ALIGN);
+}
+
+Export *initExport(const char *name, const Machine *m)
+{
+    const MachineDesc *desc = m->desc;
+    size_t ramSize = 0;
+    size_t vramOffset = 0;
+    for (int i = 0; i < desc->regionCount; i++)
+    {
+        const MemRegion *r = &(desc->regions[i]);
+        if (r->type != PAGE_RAM)
+            continue;
+        if (desc->vramAddr >= r->start && desc->vramAddr <= r->end)
+            vramOffset = ramSize + (desc->vramAddr - r->start);
+        ramSize += (size_t)(r->end - r->start) + 1;
+    }
+
+    Export *e = calloc(1, sizeof(Export));
+    if (e == NULL)
+    {
+        printf("Export allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    objectName(e->name, sizeof(e->name), name);
+
+    uint32_t headerSize = alignUp(sizeof(ExportHeader));
+    uint32_t slotSize = alignUp(sizeof(ExportSlot) + ramSize);
+    e->size = headerSize + (size_t)EXPORT_SLOTS * slotSize;
+
+    // A segment left behind by a crashed run is simply replaced
+    int fd = shm_open(e->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        free(e);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)e->size) != 0)
+    {
+        close(fd);
+        shm_unlink(e->name);
+        free(e);
+        return NULL;
+    }
+    e->header = mmap(NULL, e->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (e->header == MAP_FAILED)
+    {
+        shm_unlink(e->name);
+        free(e);
+        return NULL;
+    }
+
+    // The segment starts zeroed, so every slot is at sequence 0
+    ExportHeader *h = e->header;
+    h->version = EXPORT_VERSION;
+    h->headerSize = headerSize;
+    h->slotCount = EXPORT_SLOTS;
+    h->slotSize = slotSize;
+    h->ramSize = (uint32_t)ramSize;
+    h->vramOffset = (uint32_t)vramOffset;
+    h->vramSize = (uint32_t)desc->screenWidth * desc->screenHeight / 8;
+    h->screenWidth = (uint16_t)desc->screenWidth;
+    h->screenHeight = (uint16_t)desc->screenHeight;
+    snprintf(h->machine, sizeof(h->machine), "%s", desc->name);
+    atomic_store_explicit(&(h->published), 0, memory_order_relaxed);
+
+    // Readers check the magic last
+    atomic_thread_fence(memory_order_release);
+    memcpy(h->magic, EXPORT_MAGIC, sizeof(h->magic));
+    return e;
+}
+
+// Readers that already mapped the segment keep it until they unmap it
+void freeExport(Export *e)
+{
+    munmap(e->header, e->size);
+    shm_unlink(e->name);
+    free(e);
+}
+
+void exportFrame(Export *e, const Machine *m)
+{
+    ExportHeader *h = e->header;
+    ExportSlot *slot = slotAt(h, e->frame);
+    uint32_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_relaxed);
+
+    // Odd sequence first, so a reader mid copy sees the slot change
+    atomic_store_explicit(&(slot->sequence), sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    const State *state = m->state8080;
+    const Codes *codes = state->codes;
+    uint8_t f = (uint8_t)(codes->c | 0x02 | (codes->p << 2) | (codes->ac << 4) | (codes->z << 6) | (codes->s << 7));
+    slot->frame = e->frame;
+    slot->regs = (ExportRegisters){
+        .pc = state->pc,
+        .sp = state->sp,
+        .psw = (uint16_t)((state->a << 8) | f),
+        .bc = state->bc,
+        .de = state->de,
+        .hl = state->hl,
+        .intEnable = state->int_en,
+        .halted = state->halted,
+    };
+
+    uint8_t *ram = slot->ram;
+    for (int i = 0; i < m->desc->regionCount; i++)
+    {
+        const MemRegion *r = &(m->desc->regions[i]);
+        if (r->type != PAGE_RAM)
+            continue;
+
+        size_t size = (size_t)(r->end - r->start) + 1;
+        memcpy(ram, &(state->mem[r->start]), size);
+        ram += size;
+    }
+
+    atomic_store_explicit(&(slot->sequence), sequence + 2, memory_order_release);
+    atomic_store_explicit(&(h->published), ++(e->frame), memory_order_release);
+}
+
+ExportReader *openExport(const char *name)
+{
+    char path[256];
+    objectName(path, sizeof(path), name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    ExportHeader *h = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ExportHeader))
+        h = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED)
+        return NULL;
+
+    atomic_thread_fence(memory_order_acquire);
+    size_t size = (size_t)st.st_size;
+    if (memcmp(h->magic, EXPORT_MAGIC, sizeof(h->magic)) || h->version != EXPORT_VERSION || h->slotCount == 0
+        || h->slotSize < sizeof(ExportSlot) + h->ramSize || h->headerSize + (size_t)h->slotCount * h->slotSize > size)
+    {
+        munmap(h, size);
+        return NULL;
+    }
+
+    ExportReader *r = calloc(1, sizeof(ExportReader));
+    if (r == NULL || (r->slot = malloc(sizeof(ExportSlot) + h->ramSize)) == NULL)
+    {
+        printf("Export reader allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    r->header = h;
+    r->size = size;
+    return r;
+}
+
+void closeExport(ExportReader *r)
+{
+    munmap((void *)r->header, r->size);
+    free(r->slot);
+    free(r);
+}
+
+uint64_t exportPublished(const ExportReader *r)
+{
+    return atomic_load_explicit(&(((ExportHeader *)r->header)->published), memory_order_acquire);
+}
+
+bool exportRead(ExportReader *r, uint64_t frame)
+{
+    const ExportHeader *h = r->header;
+    ExportSlot *slot = slotAt(h, frame);
+    size_t size = sizeof(ExportSlot) + h->ramSize;
+
+    for (;;)
+    {
+        uint64_t published = exportPublished(r);
+        if (frame >= published || published - frame > h->slotCount)
+            return false;
+
+        uint32_t before = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+        if (before & 1)
+        {
+            r->retries++;
+            continue;
+        }
+        memcpy((uint8_t *)r->slot + sizeof(slot->sequence), (uint8_t *)slot + sizeof(slot->sequence),
+               size - sizeof(slot->sequence));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t after = atomic_load_explicit(&(slot->sequence), memory_order_relaxed);
+
+        // Rewritten meanwhile, maybe by a later frame
+        if (before == after && r->slot->frame == frame)
+            return true;
+        r->retries++;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "Machine.h"
+
+// Every finished frame published into POSIX shared memory for other
+// processes on the host (monitoring, trainers...). The segment is a ring of
+// slots, each behind a seqlock: the emulator never waits for readers, and a
+// reader retries or skips ahead when the slot it was copying got rewritten.
+#define EXPORT_MAGIC "8080SHM"
+#define EXPORT_VERSION 1
+#define EXPORT_SLOTS 8
+#define EXPORT_ALIGN 64 // slots start on their own cache lines
+
+typedef struct
+{
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t psw; // flags packed like PUSH PSW
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint8_t intEnable;
+    uint8_t halted;
+} ExportRegisters;
+
+typedef struct
+{
+    _Atomic uint32_t sequence; // odd while the slot is being written
+    uint32_t reserved;
+    uint64_t frame;
+    ExportRegisters regs;
+    uint8_t ram[]; // the desc's PAGE_RAM regions back to back, VRAM included
+} ExportSlot;
+
+// Start of the segment, slots follow at headerSize
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t slotCount;
+    uint32_t slotSize;   // stride between slots
+    uint32_t ramSize;
+    uint32_t vramOffset; // 1bpp VRAM within ram, vramSize bytes
+    uint32_t vramSize;
+    uint16_t screenWidth; // VRAM is stored rotated, screenHeight bits a column
+    uint16_t screenHeight;
+    char machine[16];
+    _Atomic uint64_t published; // frames so far, the newest is published - 1
+} ExportHeader;
+
+typedef struct
+{
+    char name[256];
+    ExportHeader *header;
+    size_t size;
+    uint64_t frame;
+} Export;
+
+// name is a shared memory object name ("/invaders", the slash is added if
+// missing). Returns NULL if it can't be created.
+Export *initExport(const char *name, const Machine *m);
+void freeExport(Export *e);
+
+// Publish m's registers and RAM as the next frame
+void exportFrame(Export *e, const Machine *m);
+
+typedef struct
+{
+    const ExportHeader *header;
+    size_t size;
+    ExportSlot *slot; // private copy of the last frame read
+    uint64_t retries; // torn copies thrown away
+} ExportReader;
+
+// NULL if name doesn't exist or isn't an export segment
+ExportReader *openExport(const char *name);
+void closeExport(ExportReader *r);
+
+// Frames published so far
+uint64_t exportPublished(const ExportReader *r);
+
+// Copy frame into r->slot, false once it has left the ring
+bool exportRead(ExportReader *r, uint64_t frame);
+
+#endif
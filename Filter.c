@@ -0,0 +1,437 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Filter.h"
+
+// Eight pixels. Every operator on it is a single AVX2 instruction when
+// built with -mavx2, the compiler splits it into SSE2 halves otherwise.
+#define LANES 8
+typedef uint32_t pixels __attribute__((vector_size(LANES * sizeof(uint32_t))));
+typedef int32_t mask __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+// Unaligned, and allowed to alias the uint32_t rows
+typedef uint32_t unaligned __attribute__((vector_size(LANES * sizeof(uint32_t)), aligned(4), may_alias));
+
+// Macros, as GCC notes its ABI change on any function passing a 32-byte
+// vector when built without -mavx2
+#define load(p) ((pixels)(*(const unaligned *)(p)))
+#define store(p, v) (*(unaligned *)(p) = (unaligned)(v))
+#define choose(m, a, b) (((pixels)(m) & (a)) | (~(pixels)(m) & (b)))
+
+// Copy the edge pixels of the width x height image inside into its border
+static void padBorder(uint32_t *padded, int stride, int width, int height)
+{
+    for (int y = 1; y <= height; y++)
+    {
+        padded[y * stride] = padded[y * stride + 1];
+        padded[y * stride + width + 1] = padded[y * stride + width];
+    }
+    memcpy(padded, &(padded[stride]), (size_t)(width + 2) * sizeof(uint32_t));
+    memcpy(&(padded[(height + 1) * stride]), &(padded[height * stride]), (size_t)(width + 2) * sizeof(uint32_t));
+}
+
+/* Scale2x: E becomes E0 E1 / E2 E3 from its neighbours
+ *   A B C
+ *   D E F
+ *   G H I
+ * src points at pixel (0, 0) inside a padded buffer. */
+
+static void scale2xRows(const uint32_t *src, int srcStride, uint32_t *dst, int dstStride, int width, int first,
+                        int last)
+{
+    for (int y = first; y < last; y++)
+    {
+        const uint32_t *b = &(src[(y - 1) * srcStride]);
+        const uint32_t *e = &(src[y * srcStride]);
+        const uint32_t *h = &(src[(y + 1) * srcStride]);
+        uint32_t *out0 = &(dst[2 * y * dstStride]);
+        uint32_t *out1 = &(out0[dstStride]);
+
+        int x = 0;
+        for (; x + LANES <= width; x += LANES)
+        {
+            pixels B = load(&(b[x]));
+            pixels D = load(&(e[x - 1]));
+            pixels E = load(&(e[x]));
+            pixels F = load(&(e[x + 1]));
+            pixels H = load(&(h[x]));
+
+            mask edge = (B != H) & (D != F);
+            pixels e0 = choose(edge & (D == B), D, E);
+            pixels e1 = choose(edge & (B == F), F, E);
+            pixels e2 = choose(edge & (D == H), D, E);
+            pixels e3 = choose(edge & (H == F), F, E);
+            for (int k = 0; k < LANES; k++)
+            {
+                out0[2 * (x + k)] = e0[k];
+                out0[2 * (x + k) + 1] = e1[k];
+                out1[2 * (x + k)] = e2[k];
+                out1[2 * (x + k) + 1] = e3[k];
+            }
+        }
+
+        for (; x < width; x++)
+        {
+            uint32_t B = b[x], D = e[x - 1], E = e[x], F = e[x + 1], H = h[x];
+            bool edge = B != H && D != F;
+            out0[2 * x] = edge && D == B ? D : E;
+            out0[2 * x + 1] = edge && B == F ? F : E;
+            out1[2 * x] = edge && D == H ? D : E;
+            out1[2 * x + 1] = edge && H == F ? F : E;
+        }
+    }
+}
+
+static void scale3xRows(const uint32_t *src, int srcStride, uint32_t *dst, int dstStride, int width, int first,
+                        int last)
+{
+    for (int y = first; y < last; y++)
+    {
+        const uint32_t *b = &(src[(y - 1) * srcStride]);
+        const uint32_t *e = &(src[y * srcStride]);
+        const uint32_t *h = &(src[(y + 1) * srcStride]);
+        uint32_t *out0 = &(dst[3 * y * dstStride]);
+        uint32_t *out1 = &(out0[dstStride]);
+        uint32_t *out2 = &(out1[dstStride]);
+
+        int x = 0;
+        for (; x + LANES <= width; x += LANES)
+        {
+            pixels A = load(&(b[x - 1]));
+            pixels B = load(&(b[x]));
+            pixels C = load(&(b[x + 1]));
+            pixels D = load(&(e[x - 1]));
+            pixels E = load(&(e[x]));
+            pixels F = load(&(e[x + 1]));
+            pixels G = load(&(h[x - 1]));
+            pixels H = load(&(h[x]));
+            pixels I = load(&(h[x + 1]));
+
+            mask edge = (B != H) & (D != F);
+            mask db = edge & (D == B);
+            mask bf = edge & (B == F);
+            mask dh = edge & (D == H);
+            mask hf = edge & (H == F);
+            pixels e0 = choose(db, D, E);
+            pixels e1 = choose((db & (E != C)) | (bf & (E != A)), B, E);
+            pixels e2 = choose(bf, F, E);
+            pixels e3 = choose((db & (E != G)) | (dh & (E != A)), D, E);
+            pixels e5 = choose((bf & (E != I)) | (hf & (E != C)), F, E);
+            pixels e6 = choose(dh, D, E);
+            pixels e7 = choose((dh & (E != I)) | (hf & (E != G)), H, E);
+            pixels e8 = choose(hf, F, E);
+            for (int k = 0; k < LANES; k++)
+            {
+                int o = 3 * (x + k);
+                out0[o] = e0[k];
+                out0[o + 1] = e1[k];
+                out0[o + 2] = e2[k];
+                out1[o] = e3[k];
+                out1[o + 1] = E[k];
+                out1[o + 2] = e5[k];
+                out2[o] = e6[k];
+                out2[o + 1] = e7[k];
+                out2[o + 2] = e8[k];
+            }
+        }
+
+        for (; x < width; x++)
+        {
+            uint32_t A = b[x - 1], B = b[x], C = b[x + 1];
+            uint32_t D = e[x - 1], E = e[x], F = e[x + 1];
+            uint32_t G = h[x - 1], H = h[x], I = h[x + 1];
+            bool edge = B != H && D != F;
+            bool db = edge && D == B;
+            bool bf = edge && B == F;
+            bool dh = edge && D == H;
+            bool hf = edge && H == F;
+            int o = 3 * x;
+            out0[o] = db ? D : E;
+            out0[o + 1] = (db && E != C) || (bf && E != A) ? B : E;
+            out0[o + 2] = bf ? F : E;
+            out1[o] = (db && E != G) || (dh && E != A) ? D : E;
+            out1[o + 1] = E;
+            out1[o + 2] = (bf && E != I) || (hf && E != C) ? F : E;
+            out2[o] = dh ? D : E;
+            out2[o + 1] = (dh && E != I) || (hf && E != G) ? H : E;
+            out2[o + 2] = hf ? F : E;
+        }
+    }
+}
+
+/* Passes over a band of rows */
+
+static const uint32_t *source(const Filter *f)
+{
+    return &(f->padded[f->paddedStride + 1]);
+}
+
+static void passScale2x(Filter *f, int first, int last)
+{
+    scale2xRows(source(f), f->paddedStride, f->out, f->outWidth, f->width, first, last);
+}
+
+static void passScale3x(Filter *f, int first, int last)
+{
+    scale3xRows(source(f), f->paddedStride, f->out, f->outWidth, f->width, first, last);
+}
+
+// Scale4x is Scale2x into the padded middle buffer, then again from there
+static void passScale4xFirst(Filter *f, int first, int last)
+{
+    scale2xRows(source(f), f->paddedStride, &(f->middle[f->middleStride + 1]), f->middleStride, f->width, first,
+                last);
+}
+
+static void passScale4xSecond(Filter *f, int first, int last)
+{
+    scale2xRows(&(f->middle[f->middleStride + 1]), f->middleStride, f->out, f->outWidth, 2 * f->width, first,
+                last);
+}
+
+// Each source row stretched once into the first row of its block, the
+// other rows are copies
+static void passNearest(Filter *f, int first, int last)
+{
+    const uint32_t *src = source(f);
+    for (int y = first; y < last; y++)
+    {
+        const uint32_t *in = &(src[y * f->paddedStride]);
+        uint32_t *out = &(f->out[y * f->scale * f->outWidth]);
+        for (int x = 0; x < f->width; x++)
+        {
+            for (int k = 0; k < f->scale; k++)
+                out[x * f->scale + k] = in[x];
+        }
+        for (int k = 1; k < f->scale; k++)
+            memcpy(&(out[k * f->outWidth]), out, (size_t)f->outWidth * sizeof(uint32_t));
+    }
+}
+
+// The stretched row goes into the last row of the block, then every row
+// of the block (the last one in place) is that row times its weights
+static void passCrt(Filter *f, int first, int last)
+{
+    const uint32_t *src = source(f);
+    int w = f->outWidth;
+    for (int y = first; y < last; y++)
+    {
+        const uint32_t *in = &(src[y * f->paddedStride]);
+        uint32_t *block = &(f->out[y * f->scale * w]);
+        uint32_t *row = &(block[(f->scale - 1) * w]);
+        for (int x = 0; x < f->width; x++)
+        {
+            for (int k = 0; k < f->scale; k++)
+                row[x * f->scale + k] = in[x];
+        }
+
+        for (int r = 0; r < f->scale; r++)
+        {
+            const uint32_t *wr = &(f->weights[(3 * r) * w]);
+            const uint32_t *wg = &(wr[w]);
+            const uint32_t *wb = &(wg[w]);
+            uint32_t *out = &(block[r * w]);
+
+            int x = 0;
+            for (; x + LANES <= w; x += LANES)
+            {
+                pixels p = load(&(row[x]));
+                pixels red = ((p & 0xFF) * load(&(wr[x]))) >> 8;
+                pixels green = (((p >> 8) & 0xFF) * load(&(wg[x]))) >> 8;
+                pixels blue = (((p >> 16) & 0xFF) * load(&(wb[x]))) >> 8;
+                store(&(out[x]), red | (green << 8) | (blue << 16) | (p & 0xFF000000));
+            }
+            for (; x < w; x++)
+            {
+                uint32_t p = row[x];
+                uint32_t red = ((p & 0xFF) * wr[x]) >> 8;
+                uint32_t green = (((p >> 8) & 0xFF) * wg[x]) >> 8;
+                uint32_t blue = (((p >> 16) & 0xFF) * wb[x]) >> 8;
+                out[x] = red | (green << 8) | (blue << 16) | (p & 0xFF000000);
+            }
+        }
+    }
+}
+
+// The last row of every scanline is dimmed, and each output column lets
+// its own channel through fully and the other two at 3/4. Channels are in
+// RGBA byte order.
+static void initCrtWeights(Filter *f)
+{
+    for (int r = 0; r < f->scale; r++)
+    {
+        int scan = r == f->scale - 1 ? 128 : 256;
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t *row = &(f->weights[(3 * r + c) * f->outWidth]);
+            for (int x = 0; x < f->outWidth; x++)
+                row[x] = (uint32_t)(x % 3 == c ? scan : scan * 3 / 4);
+        }
+    }
+}
+
+/* Thread pool */
+
+static void runBands(Filter *f)
+{
+    int band;
+    while ((band = atomic_fetch_add(&(f->next), 1)) < f->bands)
+    {
+        int first = band * FILTER_BAND_ROWS;
+        int last = first + FILTER_BAND_ROWS < f->passHeight ? first + FILTER_BAND_ROWS : f->passHeight;
+        f->pass(f, first, last);
+    }
+}
+
+static void *worker(void *arg)
+{
+    Filter *f = arg;
+    const struct timespec nap = {0, 100000}; // 0.1 ms
+    unsigned seen = 0;
+
+    for (;;)
+    {
+        unsigned generation = atomic_load_explicit(&(f->generation), memory_order_acquire);
+        if (generation == seen)
+        {
+            if (!atomic_load(&(f->running)))
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        seen = generation;
+        runBands(f);
+        atomic_fetch_add_explicit(&(f->finished), 1, memory_order_release);
+    }
+    return NULL;
+}
+
+// Returns when every band is done and every worker has let go of the pass
+static void runPass(Filter *f, FilterPass pass, int height)
+{
+    const struct timespec nap = {0, 20000};
+    f->pass = pass;
+    f->passHeight = height;
+    f->bands = (height + FILTER_BAND_ROWS - 1) / FILTER_BAND_ROWS;
+    atomic_store(&(f->next), 0);
+    atomic_store(&(f->finished), 0);
+    atomic_fetch_add_explicit(&(f->generation), 1, memory_order_release);
+
+    runBands(f);
+    while (atomic_load_explicit(&(f->finished), memory_order_acquire) < f->threads)
+        nanosleep(&nap, NULL);
+}
+
+bool findFilter(const char *name, FilterType *type)
+{
+    static const char *names[] = {"nearest", "scale2x", "scale3x", "scale4x", "crt"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (!strcmp(names[i], name))
+        {
+            *type = (FilterType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+Filter *initFilter(FilterType type, int scale, int width, int height, int threads)
+{
+    Filter *f = calloc(1, sizeof(Filter));
+    if (f == NULL)
+        exit(EXIT_FAILURE);
+
+    switch (type)
+    {
+        case FILTER_SCALE2X: scale = 2; break;
+        case FILTER_SCALE3X: scale = 3; break;
+        case FILTER_SCALE4X: scale = 4; break;
+        case FILTER_CRT: scale = scale < 2 ? 2 : scale; break;
+        default: scale = scale < 1 ? 1 : scale; break;
+    }
+    scale = scale > FILTER_MAX_SCALE ? FILTER_MAX_SCALE : scale;
+
+    if (threads < 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    threads = threads < 0 ? 0 : (threads > FILTER_MAX_THREADS ? FILTER_MAX_THREADS : threads);
+
+    f->type = type;
+    f->scale = scale;
+    f->width = width;
+    f->height = height;
+    f->outWidth = width * scale;
+    f->outHeight = height * scale;
+    f->paddedStride = width + 2;
+    f->out = calloc((size_t)f->outWidth * f->outHeight, sizeof(uint32_t));
+    f->padded = calloc((size_t)f->paddedStride * (height + 2), sizeof(uint32_t));
+    if (f->out == NULL || f->padded == NULL)
+    {
+        printf("Filter allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (type == FILTER_SCALE4X)
+    {
+        f->middleStride = 2 * width + 2;
+        f->middle = calloc((size_t)f->middleStride * (2 * height + 2), sizeof(uint32_t));
+        if (f->middle == NULL)
+            exit(EXIT_FAILURE);
+    }
+    if (type == FILTER_CRT)
+    {
+        f->weights = malloc((size_t)3 * scale * f->outWidth * sizeof(uint32_t));
+        if (f->weights == NULL)
+            exit(EXIT_FAILURE);
+        initCrtWeights(f);
+    }
+
+    atomic_init(&(f->next), 0);
+    atomic_init(&(f->finished), 0);
+    atomic_init(&(f->generation), 0);
+    atomic_init(&(f->running), true);
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&(f->workers[i]), NULL, worker, f) != 0)
+            break;
+        f->threads++;
+    }
+    return f;
+}
+
+void freeFilter(Filter *f)
+{
+    atomic_store(&(f->running), false);
+    for (int i = 0; i < f->threads; i++)
+        pthread_join(f->workers[i], NULL);
+    free(f->out);
+    free(f->padded);
+    free(f->middle);
+    free(f->weights);
+    free(f);
+}
+
+void filterFrame(Filter *f, const uint32_t *src)
+{
+    for (int y = 0; y < f->height; y++)
+        memcpy(&(f->padded[(y + 1) * f->paddedStride + 1]), &(src[y * f->width]), (size_t)f->width * sizeof(uint32_t));
+    padBorder(f->padded, f->paddedStride, f->width, f->height);
+
+    switch (f->type)
+    {
+        case FILTER_NEAREST: runPass(f, passNearest, f->height); break;
+        case FILTER_SCALE2X: runPass(f, passScale2x, f->height); break;
+        case FILTER_SCALE3X: runPass(f, passScale3x, f->height); break;
+        case FILTER_CRT: runPass(f, passCrt, f->height); break;
+        case FILTER_SCALE4X:
+        {
+            runPass(f, passScale4xFirst, f->height);
+            padBorder(f->middle, f->middleStride, 2 * f->width, 2 * f->height);
+            runPass(f, passScale4xSecond, 2 * f->height);
+            break;
+        }
+    }
+}
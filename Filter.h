@@ -0,0 +1,76 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// CPU upscaling of the RGBA screen buffer for the front end, split into
+// bands of rows across a pool of threads. The caller's thread works on
+// bands too, filterFrame() returns when the frame is done.
+#define FILTER_MAX_SCALE 8
+#define FILTER_MAX_THREADS 16
+#define FILTER_BAND_ROWS 8 // source rows per job
+
+typedef enum
+{
+    FILTER_NEAREST, // integer scale
+    FILTER_SCALE2X, // AdvMAME2x/3x edge rules, 4x is 2x twice
+    FILTER_SCALE3X,
+    FILTER_SCALE4X,
+    FILTER_CRT, // scanlines and an aperture grille phosphor mask
+} FilterType;
+
+typedef struct Filter Filter;
+
+// One pass over rows [first, last) of its source
+typedef void (*FilterPass)(Filter *f, int first, int last);
+
+struct Filter
+{
+    FilterType type;
+    int scale;
+    int width; // source
+    int height;
+    int outWidth;
+    int outHeight;
+    uint32_t *out; // outWidth x outHeight, same pixel format as the source
+
+    // The source and the Scale4x middle pass with a replicated one pixel
+    // border, so the kernels never test for edges
+    uint32_t *padded;
+    int paddedStride;
+    uint32_t *middle;
+    int middleStride;
+
+    uint32_t *weights; // CRT: per sub-row, channel and output column, 256 = 1
+
+    // Current pass, published by generation. Bands are claimed from next,
+    // every worker counts itself in finished when no band is left.
+    FilterPass pass;
+    int bands;
+    int passHeight;
+    atomic_int next;
+    atomic_int finished;
+    atomic_uint generation;
+
+    int threads; // workers besides the caller
+    pthread_t workers[FILTER_MAX_THREADS];
+    atomic_bool running;
+};
+
+// Name as given on the command line (nearest, scale2x, scale3x, scale4x,
+// crt), false if unknown
+bool findFilter(const char *name, FilterType *type);
+
+// scale only matters for nearest (1-8) and crt (2-8). threads < 0 picks
+// one per online CPU.
+Filter *initFilter(FilterType type, int scale, int width, int height, int threads);
+void freeFilter(Filter *f);
+
+// Scale a width x height RGBA frame into f->out
+void filterFrame(Filter *f, const uint32_t *src);
+
+#endif
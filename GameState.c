@@ -0,0 +1,76 @@
+#include "GameState.h"
+
+// Work RAM variables of the invaders program
+#define PLAYER_ALIVE_ADDR 0x2015 // 0xFF while alive
+#define PLAYER_X_ADDR 0x201B
+#define SHOT_STATUS_ADDR 0x2025
+#define SHOT_POS_ADDR 0x2029     // Y then X, like the alien shots below
+#define ROLLING_POS_ADDR 0x203D
+#define PLUNGER_POS_ADDR 0x204D
+#define SQUIGGLY_POS_ADDR 0x205D
+#define PLAYER_PAGE_ADDR 0x2067  // high byte of the current player's data
+#define CREDITS_ADDR 0x20EB      // BCD
+#define GAME_MODE_ADDR 0x20EF
+#define HIGH_SCORE_ADDR 0x20F4   // BCD, low byte first
+#define P1_SCORE_ADDR 0x20F8
+#define P2_SCORE_ADDR 0x20FC
+
+// Offsets into a player's data page (0x2100 or 0x2200)
+#define PLAYER_ALIENS 0x00 // one byte per alien, 1 = alive
+#define PLAYER_SHIPS 0xFF
+
+static uint8_t fromBCD(uint8_t value)
+{
+    return (value >> 4) * 10 + (value & 0xF);
+}
+
+static uint16_t readScore(const uint8_t *mem, uint16_t addr)
+{
+    return fromBCD(mem[addr + 1]) * 100 + fromBCD(mem[addr]);
+}
+
+static ObjPos readPos(const uint8_t *mem, uint16_t addr)
+{
+    ObjPos pos = {mem[addr + 1], mem[addr]};
+    return pos;
+}
+
+void readGameState(const Machine *m, GameState *gs)
+{
+    const uint8_t *mem = m->state8080->mem;
+
+    gs->score[0] = readScore(mem, P1_SCORE_ADDR);
+    gs->score[1] = readScore(mem, P2_SCORE_ADDR);
+    gs->highScore = readScore(mem, HIGH_SCORE_ADDR);
+    gs->credits = fromBCD(mem[CREDITS_ADDR]);
+    gs->playing = mem[GAME_MODE_ADDR] != 0;
+
+    // Only pages 0x21 and 0x22 are valid, anything else is boot garbage
+    uint8_t page = mem[PLAYER_PAGE_ADDR];
+    gs->player = (page == 0x22) ? 1 : 0;
+    uint16_t data = (uint16_t)(0x21 + gs->player) << 8;
+
+    gs->ships = mem[data + PLAYER_SHIPS];
+    gs->alive = mem[PLAYER_ALIVE_ADDR] == 0xFF;
+    gs->playerX = mem[PLAYER_X_ADDR];
+
+    gs->alienCount = 0;
+    for (int row = 0; row < ALIEN_ROWS; row++)
+    {
+        gs->aliens[row] = 0;
+        for (int col = 0; col < ALIEN_COLUMNS; col++)
+        {
+            if (mem[data + PLAYER_ALIENS + row * ALIEN_COLUMNS + col])
+            {
+                gs->aliens[row] |= 1 << col;
+                gs->alienCount++;
+            }
+        }
+    }
+
+    gs->shotStatus = mem[SHOT_STATUS_ADDR];
+    gs->shot = readPos(mem, SHOT_POS_ADDR);
+    gs->rolling = readPos(mem, ROLLING_POS_ADDR);
+    gs->plunger = readPos(mem, PLUNGER_POS_ADDR);
+    gs->squiggly = readPos(mem, SQUIGGLY_POS_ADDR);
+}
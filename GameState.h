@@ -0,0 +1,44 @@
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "Machine.h"
+
+/* Space Invaders game variables, decoded from work RAM */
+
+#define ALIEN_ROWS 5
+#define ALIEN_COLUMNS 11
+
+typedef struct
+{
+    uint8_t x;
+    uint8_t y;
+} ObjPos;
+
+typedef struct
+{
+    uint16_t score[2];  // player 1 and 2, in points
+    uint16_t highScore;
+    uint8_t credits;
+    bool playing;       // a game is running (not attract mode)
+    int player;         // 0 or 1, whose turn it is
+
+    // The rest belongs to the current player
+    uint8_t ships;      // reserve ships
+    bool alive;         // false while the ship is blowing up
+    uint8_t playerX;
+    uint16_t aliens[ALIEN_ROWS]; // bit c set = column c alive, row 0 at the bottom
+    int alienCount;
+
+    uint8_t shotStatus; // 0 ready, 1 fired, 2 moving, 3 blew up, 4/5 hit an alien
+    ObjPos shot;        // player shot
+    ObjPos rolling;     // alien shots
+    ObjPos plunger;
+    ObjPos squiggly;
+} GameState;
+
+// Only reads RAM, so it works without ever calling updateBuffer()
+void readGameState(const Machine *m, GameState *gs);
+
+#endif
@@ -0,0 +1,520 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "Lockstep.h"
+
+// One vector of lanes. Every operator on it is a single AVX2 instruction when
+// built with -mavx2, the compiler splits it into SSE2 halves otherwise.
+typedef uint16_t lane16 __attribute__((vector_size(LOCKSTEP_CHUNK * sizeof(uint16_t))));
+
+// Vectors are only passed between static functions of this file, so the
+// calling convention GCC warns about never crosses a library boundary
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// Register file row and bit position of B, C, D, E, H, L, (M), A
+static const uint8_t regRow[8] = {LANE_BC, LANE_BC, LANE_DE, LANE_DE, LANE_HL, LANE_HL, 0, LANE_PSW};
+static const uint8_t regShift[8] = {8, 0, 8, 0, 8, 0, 0, 8};
+
+// Register pairs as encoded in bits 4-5 of LXI/INX/DCX/DAD
+static const uint8_t pairRow[4] = {LANE_BC, LANE_DE, LANE_HL, LANE_SP};
+
+// Flag bit tested by the Jccc conditions NZ, Z, NC, C, PO, PE, P, M
+static const uint8_t condBit[8] = {6, 6, 0, 0, 2, 2, 7, 7};
+
+static inline lane16 load(const uint16_t *p)
+{
+    lane16 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store(uint16_t *p, lane16 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+// Write v to the lanes in m, leaving the others alone
+static inline void commit(uint16_t *p, lane16 v, lane16 m)
+{
+    store(p, (v & m) | (load(p) & ~m));
+}
+
+static inline lane16 broadcast(uint16_t value)
+{
+    lane16 v = {0};
+    return v + value;
+}
+
+static inline bool anyLane(lane16 m)
+{
+    uint64_t parts[sizeof(lane16) / sizeof(uint64_t)];
+    memcpy(parts, &m, sizeof(parts));
+
+    uint64_t any = 0;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+        any |= parts[i];
+    return any != 0;
+}
+
+// S, Z and P of an 8-bit result, in their PSW positions
+static inline lane16 szpFlags(lane16 result)
+{
+    lane16 r = result & 0xFF;
+    lane16 x = r ^ (r >> 4);
+    x ^= x >> 2;
+    x ^= x >> 1;
+
+    return (r & 0x80) | ((lane16)(r == 0) & 0x40) | ((~x & 1) << 2);
+}
+
+static inline lane16 get8(Lockstep *ls, int r, int i)
+{
+    return (load(&(ls->reg[regRow[r]][i])) >> regShift[r]) & 0xFF;
+}
+
+static inline void put8(Lockstep *ls, int r, int i, lane16 value, lane16 m)
+{
+    uint16_t *p = &(ls->reg[regRow[r]][i]);
+    uint16_t keep = regShift[r] ? 0x00FF : 0xFF00;
+    commit(p, (load(p) & keep) | ((value & 0xFF) << regShift[r]), m);
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP, with the same flag results as 8080.c
+static void aluLanes(Lockstep *ls, int i, lane16 m, int kind, lane16 num)
+{
+    uint16_t *p = &(ls->reg[LANE_PSW][i]);
+    lane16 psw = load(p);
+    lane16 a = psw >> 8;
+    lane16 res;
+    lane16 ac;
+
+    switch (kind)
+    {
+        case 0: res = a + num; ac = (a ^ res ^ num) & 0x10; break;
+        case 1: res = a + num + (psw & 1); ac = (a ^ res ^ num) & 0x10; break;
+        case 2: res = a - num; ac = ~(a ^ res ^ num) & 0x10; break;
+        case 3: res = a - num - (psw & 1); ac = ~(a ^ res ^ num) & 0x10; break;
+        case 4: res = a & num; ac = ((a | num) & 0x08) << 1; break;
+        case 5: res = a ^ num; ac = broadcast(0); break;
+        case 6: res = a | num; ac = broadcast(0); break;
+        default: res = a - num; ac = ~(a ^ res ^ num) & 0x10; break;
+    }
+
+    lane16 flags = szpFlags(res) | ac | 0x02 | ((res >> 8) & 1);
+    lane16 newA = (kind == 7) ? a : (res & 0xFF);
+    commit(p, (newA << 8) | flags, m);
+}
+
+// INR/DCR r, carry is left alone
+static void incLanes(Lockstep *ls, int i, lane16 m, int r, bool dec)
+{
+    lane16 value = get8(ls, r, i);
+    lane16 res = dec ? value - 1 : value + 1;
+    lane16 ac = dec ? ((lane16)((res & 0xF) != 0xF) & 0x10) : ((lane16)((res & 0xF) == 0) & 0x10);
+    put8(ls, r, i, res, m);
+
+    uint16_t *p = &(ls->reg[LANE_PSW][i]);
+    commit(p, (load(p) & 0xFF01) | szpFlags(res) | ac | 0x02, m);
+}
+
+// RLC RRC RAL RAR CMA STC CMC, the opcodes from 0x07 to 0x3F that only
+// touch A and the carry
+static void accLanes(Lockstep *ls, int i, lane16 m, uint8_t op)
+{
+    uint16_t *p = &(ls->reg[LANE_PSW][i]);
+    lane16 psw = load(p);
+    lane16 a = psw >> 8;
+    lane16 carry = psw & 1;
+
+    switch (op)
+    {
+        case 0x07: carry = a >> 7; a = (a << 1) | carry; break;
+        case 0x0F: carry = a & 1; a = (a >> 1) | (carry << 7); break;
+        case 0x17:
+        {
+            lane16 hi = a >> 7;
+            a = (a << 1) | carry;
+            carry = hi;
+            break;
+        }
+        case 0x1F:
+        {
+            lane16 lo = a & 1;
+            a = (a >> 1) | (carry << 7);
+            carry = lo;
+            break;
+        }
+        case 0x2F: a = ~a; break;
+        case 0x37: carry = broadcast(1); break;
+        default: carry ^= 1; break;
+    }
+
+    commit(p, ((a & 0xFF) << 8) | (psw & 0xFE) | carry, m);
+}
+
+// Execute code[0] for the lanes of one chunk. The opcode has passed
+// vectorOp(), so it never touches memory or ports.
+static void vectorChunk(Lockstep *ls, int i, lane16 m, const uint8_t *code)
+{
+    uint8_t op = code[0];
+    uint16_t imm16 = (uint16_t)code[1] | ((uint16_t)code[2] << 8);
+    uint16_t *pc = &(ls->reg[LANE_PC][i]);
+    int length = 1;
+
+    if (op >= 0x40 && op < 0x80)
+    {
+        // MOV r, r
+        put8(ls, (op >> 3) & 7, i, get8(ls, op & 7, i), m);
+    }
+    else if (op >= 0x80 && op < 0xC0)
+    {
+        // ALU r
+        aluLanes(ls, i, m, (op >> 3) & 7, get8(ls, op & 7, i));
+    }
+    else if ((op & 0xC7) == 0xC6)
+    {
+        // ALU immediate
+        aluLanes(ls, i, m, (op >> 3) & 7, broadcast(code[1]));
+        length = 2;
+    }
+    else if (op < 0x40 && (op & 0x07) == 0x04)
+        incLanes(ls, i, m, (op >> 3) & 7, false);
+    else if (op < 0x40 && (op & 0x07) == 0x05)
+        incLanes(ls, i, m, (op >> 3) & 7, true);
+    else if (op < 0x40 && (op & 0x07) == 0x06)
+    {
+        // MVI
+        put8(ls, (op >> 3) & 7, i, broadcast(code[1]), m);
+        length = 2;
+    }
+    else if (op < 0x40 && (op & 0x07) == 0x07)
+        accLanes(ls, i, m, op);
+    else if (op < 0x40 && (op & 0x0F) == 0x01)
+    {
+        // LXI
+        commit(&(ls->reg[pairRow[op >> 4]][i]), broadcast(imm16), m);
+        length = 3;
+    }
+    else if (op < 0x40 && (op & 0x0F) == 0x03)
+    {
+        // INX
+        uint16_t *p = &(ls->reg[pairRow[op >> 4]][i]);
+        commit(p, load(p) + 1, m);
+    }
+    else if (op < 0x40 && (op & 0x0F) == 0x0B)
+    {
+        // DCX
+        uint16_t *p = &(ls->reg[pairRow[op >> 4]][i]);
+        commit(p, load(p) - 1, m);
+    }
+    else if (op < 0x40 && (op & 0x0F) == 0x09)
+    {
+        // DAD
+        uint16_t *hl = &(ls->reg[LANE_HL][i]);
+        uint16_t *psw = &(ls->reg[LANE_PSW][i]);
+        lane16 before = load(hl);
+        lane16 sum = before + load(&(ls->reg[pairRow[op >> 4]][i]));
+        commit(hl, sum, m);
+        commit(psw, (load(psw) & 0xFFFE) | ((lane16)(sum < before) & 1), m);
+    }
+    else if (op == 0xEB)
+    {
+        // XCHG
+        uint16_t *de = &(ls->reg[LANE_DE][i]);
+        uint16_t *hl = &(ls->reg[LANE_HL][i]);
+        lane16 tmp = load(de);
+        commit(de, load(hl), m);
+        commit(hl, tmp, m);
+    }
+    else if (op == 0xF3 || op == 0xFB)
+    {
+        // DI, EI
+        commit(&(ls->inte[i]), broadcast(op == 0xFB ? 0xFFFF : 0), m);
+    }
+    else if (op == 0xC3)
+    {
+        // JMP
+        commit(pc, broadcast(imm16), m);
+        return;
+    }
+    else if ((op & 0xC7) == 0xC2)
+    {
+        // Jccc, a per-lane select between the target and the next opcode
+        int cond = (op >> 3) & 7;
+        lane16 flag = (load(&(ls->reg[LANE_PSW][i])) >> condBit[cond]) & 1;
+        lane16 taken = (lane16)(flag == (uint16_t)(cond & 1));
+        commit(pc, (broadcast(imm16) & taken) | ((load(pc) + 3) & ~taken), m);
+        return;
+    }
+
+    commit(pc, load(pc) + (uint16_t)length, m);
+}
+
+// Opcodes the vector path handles: everything that only reads and writes
+// registers. DAA and the undocumented opcodes are left to the scalar core.
+static bool vectorOp(uint8_t op)
+{
+    if (op >= 0x40 && op < 0xC0)
+        return (op & 0x07) != 6 && (op < 0x70 || op >= 0x78);
+
+    if (op < 0x40)
+    {
+        switch (op & 0x0F)
+        {
+            case 0x01: case 0x03: case 0x09: case 0x0B: return true;
+            case 0x07: case 0x0F: return op != 0x27;
+            case 0x04: case 0x05: case 0x06:
+            case 0x0C: case 0x0D: case 0x0E: return ((op >> 3) & 7) != 6;
+            case 0x00: return op == 0x00;
+            default: return false;
+        }
+    }
+
+    if ((op & 0xC7) == 0xC6 || (op & 0xC7) == 0xC2)
+        return true;
+    return op == 0xC3 || op == 0xEB || op == 0xF3 || op == 0xFB;
+}
+
+// Copy a lane between its State (codes unpacked) and the register file
+static void loadLane(Lockstep *ls, int i)
+{
+    const State *state = ls->machines[i]->state8080;
+    const Codes *codes = state->codes;
+    uint8_t f = (codes->c) | 0x2 | (codes->p << 2) | (codes->ac << 4)
+              | (codes->z << 6) | (codes->s << 7);
+
+    ls->reg[LANE_PC][i] = state->pc;
+    ls->reg[LANE_SP][i] = state->sp;
+    ls->reg[LANE_BC][i] = state->bc;
+    ls->reg[LANE_DE][i] = state->de;
+    ls->reg[LANE_HL][i] = state->hl;
+    ls->reg[LANE_PSW][i] = (uint16_t)((state->a << 8) | f);
+    ls->inte[i] = state->int_en ? 0xFFFF : 0;
+}
+
+static void storeLane(Lockstep *ls, int i)
+{
+    State *state = ls->machines[i]->state8080;
+    Codes *codes = state->codes;
+
+    state->pc = ls->reg[LANE_PC][i];
+    state->sp = ls->reg[LANE_SP][i];
+    state->bc = ls->reg[LANE_BC][i];
+    state->de = ls->reg[LANE_DE][i];
+    state->hl = ls->reg[LANE_HL][i];
+    state->psw = ls->reg[LANE_PSW][i];
+    state->int_en = ls->inte[i] != 0;
+
+    codes->c = (state->f & 0x1);
+    codes->p = (state->f >> 2) & 0x1;
+    codes->ac = (state->f >> 4) & 0x1;
+    codes->z = (state->f >> 6) & 0x1;
+    codes->s = (state->f >> 7) & 0x1;
+}
+
+// Interrupt and end of frame bookkeeping of runFrame(), for one lane whose
+// State is current
+static void laneTimers(Lockstep *ls, int i)
+{
+    Machine *m = ls->machines[i];
+    if (ls->cycles[i] >= ls->interruptCycles[i])
+    {
+        ls->interruptCycles[i] *= 2;
+        GenerateInterrupt(m->state8080, m->desc->interrupts[m->interruptNum]);
+        m->interruptNum ^= 1;
+    }
+    if (ls->cycles[i] >= ls->cyclesPerFrame)
+        ls->active[i] = 0;
+}
+
+// Run up to steps instructions of an active lane on the scalar core
+static void scalarRun(Lockstep *ls, int i, int steps)
+{
+    State *state = ls->machines[i]->state8080;
+    storeLane(ls, i);
+    for (int n = 0; n < steps && ls->active[i]; n++)
+    {
+        ls->cycles[i] += emulate8080(state);
+        laneTimers(ls, i);
+        ls->scalarLanes++;
+    }
+    loadLane(ls, i);
+}
+
+static void vectorStep(Lockstep *ls, const uint8_t *code)
+{
+    int32_t cycles = cycles8080(code[0]);
+    bool timers = false;
+
+    for (int i = 0; i < ls->padded; i += LOCKSTEP_CHUNK)
+    {
+        lane16 m = load(&(ls->mask[i]));
+        if (!anyLane(m))
+            continue;
+
+        vectorChunk(ls, i, m, code);
+        for (int j = i; j < i + LOCKSTEP_CHUNK; j++)
+        {
+            ls->cycles[j] += ls->mask[j] ? cycles : 0;
+            timers |= ls->cycles[j] >= ls->interruptCycles[j] || ls->cycles[j] >= ls->cyclesPerFrame;
+        }
+    }
+
+    // Interrupts and frame ends are rare enough to take on the scalar side
+    if (timers)
+    {
+        for (int i = 0; i < ls->lanes; i++)
+        {
+            if (!ls->mask[i] || (ls->cycles[i] < ls->interruptCycles[i] && ls->cycles[i] < ls->cyclesPerFrame))
+                continue;
+
+            storeLane(ls, i);
+            laneTimers(ls, i);
+            loadLane(ls, i);
+        }
+    }
+    ls->vectorSteps++;
+}
+
+// The next step runs the lanes at the lowest PC. Branches that split the
+// lanes mostly jump forward, so the ones left behind catch up and merge
+// again with the others at the join.
+static int buildMask(Lockstep *ls, int *leader)
+{
+    lane16 lowest = broadcast(0xFFFF);
+    lane16 live = broadcast(0);
+    for (int i = 0; i < ls->padded; i += LOCKSTEP_CHUNK)
+    {
+        lane16 active = load(&(ls->active[i]));
+        lane16 pc = load(&(ls->reg[LANE_PC][i])) | ~active;
+        lowest = ((lane16)(pc < lowest) & pc) | ((lane16)(pc >= lowest) & lowest);
+        live |= active;
+    }
+    if (!anyLane(live))
+        return 0;
+
+    uint16_t pc = 0xFFFF;
+    for (int k = 0; k < LOCKSTEP_CHUNK; k++)
+        pc = lowest[k] < pc ? lowest[k] : pc;
+
+    lane16 want = broadcast(pc);
+    lane16 count = broadcast(0);
+    *leader = -1;
+    for (int i = 0; i < ls->padded; i += LOCKSTEP_CHUNK)
+    {
+        lane16 m = (lane16)(load(&(ls->reg[LANE_PC][i])) == want) & load(&(ls->active[i]));
+        store(&(ls->mask[i]), m);
+        count += m & 1;
+        if (*leader < 0 && anyLane(m))
+        {
+            for (int j = i; *leader < 0; j++)
+                *leader = ls->mask[j] ? j : -1;
+        }
+    }
+
+    int group = 0;
+    for (int k = 0; k < LOCKSTEP_CHUNK; k++)
+        group += count[k];
+    return group;
+}
+
+static void *laneAlloc(int padded, size_t size)
+{
+    void *p = aligned_alloc(sizeof(lane16), (size_t)padded * size);
+    if (p == NULL)
+    {
+        printf("Lockstep allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(p, 0, (size_t)padded * size);
+    return p;
+}
+
+Lockstep *initLockstep(Machine **machines, int lanes)
+{
+    Lockstep *ls = calloc(1, sizeof(Lockstep));
+    if (ls == NULL)
+        exit(EXIT_FAILURE);
+
+    ls->lanes = lanes;
+    ls->padded = (lanes + LOCKSTEP_CHUNK - 1) / LOCKSTEP_CHUNK * LOCKSTEP_CHUNK;
+    ls->machines = machines;
+    ls->cyclesPerFrame = machines[0]->desc->cyclesPerFrame;
+
+    for (int r = 0; r < LANE_REGS; r++)
+        ls->reg[r] = laneAlloc(ls->padded, sizeof(uint16_t));
+    ls->inte = laneAlloc(ls->padded, sizeof(uint16_t));
+    ls->active = laneAlloc(ls->padded, sizeof(uint16_t));
+    ls->mask = laneAlloc(ls->padded, sizeof(uint16_t));
+    ls->cycles = laneAlloc(ls->padded, sizeof(int32_t));
+    ls->interruptCycles = laneAlloc(ls->padded, sizeof(int32_t));
+    return ls;
+}
+
+void freeLockstep(Lockstep *ls)
+{
+    for (int r = 0; r < LANE_REGS; r++)
+        free(ls->reg[r]);
+    free(ls->inte);
+    free(ls->active);
+    free(ls->mask);
+    free(ls->cycles);
+    free(ls->interruptCycles);
+    free(ls);
+}
+
+void lockstepRunFrame(Lockstep *ls)
+{
+    // Padding lanes stay inactive with their timers out of reach
+    for (int i = 0; i < ls->padded; i++)
+    {
+        ls->cycles[i] = 0;
+        ls->interruptCycles[i] = ls->cyclesPerFrame / 2;
+        ls->active[i] = (i < ls->lanes) ? 0xFFFF : 0;
+        if (i < ls->lanes)
+            loadLane(ls, i);
+    }
+
+    int leader;
+    int group;
+    while ((group = buildMask(ls, &leader)) > 0)
+    {
+        if (group == 1)
+        {
+            scalarRun(ls, leader, LOCKSTEP_BURST);
+            continue;
+        }
+
+        // The opcode is shared only when it comes from ROM, every lane
+        // runs the same image
+        const Memory *map = ls->machines[leader]->state8080->map;
+        uint16_t pc = ls->reg[LANE_PC][leader];
+        uint8_t straddle[3];
+        const uint8_t *code = memFetch(map, pc, straddle);
+        bool shared = map->type[pc >> MEM_PAGE_SHIFT] == PAGE_ROM
+                   && map->type[(uint16_t)(pc + 2) >> MEM_PAGE_SHIFT] == PAGE_ROM;
+
+        if (shared && group >= LOCKSTEP_MIN_GROUP && vectorOp(code[0]))
+        {
+            vectorStep(ls, code);
+            ls->vectorLanes += group;
+            continue;
+        }
+
+        for (int i = leader; i < ls->lanes; i++)
+        {
+            if (ls->mask[i])
+                scalarRun(ls, i, 1);
+        }
+    }
+
+    for (int i = 0; i < ls->lanes; i++)
+    {
+        storeLane(ls, i);
+        machineEndFrame(ls->machines[i]);
+    }
+}
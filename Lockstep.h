@@ -0,0 +1,63 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "Machine.h"
+
+// Lanes handled per vector, 16-bit registers in a 256-bit AVX2 register
+#define LOCKSTEP_CHUNK 16
+
+// Smallest group of matching lanes worth a vector step, smaller groups (and
+// lanes that diverged on their own) run on the scalar core
+#define LOCKSTEP_MIN_GROUP 4
+
+// Scalar instructions run in a row by a lane that has no company
+#define LOCKSTEP_BURST 32
+
+// Register file rows, each an array of one uint16_t per lane
+typedef enum
+{
+    LANE_PC,
+    LANE_SP,
+    LANE_BC,
+    LANE_DE,
+    LANE_HL,
+    LANE_PSW, // A in the high byte, flags packed as in PUSH PSW
+    LANE_REGS
+} LaneReg;
+
+// Runs N machines of the same board and ROM together. The register files
+// live here in structure-of-arrays form while a frame runs, one opcode is
+// fetched for every lane sharing the PC of the leading lane and executed for
+// all of them at once when it only touches registers. Anything touching
+// memory or ports, and lanes that went their own way, go through
+// emulate8080() on the lane's own Machine.
+typedef struct
+{
+    int lanes;
+    int padded; // lanes rounded up to LOCKSTEP_CHUNK, padding is never active
+    Machine **machines;
+    int cyclesPerFrame;
+
+    uint16_t *reg[LANE_REGS];
+    uint16_t *inte;   // interrupt enable, 0 or 0xFFFF
+    uint16_t *active; // 0xFFFF while the lane is still inside the frame
+    uint16_t *mask;   // lanes taking part in the current step
+    int32_t *cycles;
+    int32_t *interruptCycles;
+
+    // Statistics since initLockstep()
+    uint64_t vectorSteps;
+    uint64_t vectorLanes; // lane-instructions retired by vector steps
+    uint64_t scalarLanes; // lane-instructions retired by the scalar core
+} Lockstep;
+
+// The machines stay owned by the caller and must all share one MachineDesc
+Lockstep *initLockstep(Machine **machines, int lanes);
+void freeLockstep(Lockstep *ls);
+
+// Same as calling runFrame() on every machine
+void lockstepRunFrame(Lockstep *ls);
+
+#endif
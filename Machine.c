@@ -0,0 +1,374 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include "Machine.h"
+#include "SpaceInvaders.h"
+#include "Rom.h"
+
+// Boards this runtime knows about, the first one is the default
+static const MachineDesc *machines[] = {
+    &spaceInvadersDesc,
+    &lunarRescueDesc,
+};
+
+const MachineDesc *findMachine(const char *name)
+{
+    if (name == NULL)
+        return machines[0];
+
+    for (size_t i = 0; i < sizeof(machines) / sizeof(machines[0]); i++)
+    {
+        if (!strcmp(machines[i]->name, name))
+            return machines[i];
+    }
+    return NULL;
+}
+
+uint8_t machineReadInputs(void *ctx, uint8_t port)
+{
+    return ((Machine *)ctx)->inputs[port % MACHINE_INPUT_PORTS];
+}
+
+Machine *initMachine(const MachineDesc *desc)
+{
+    Machine *new = calloc(1, sizeof(Machine));
+    if (new == NULL)
+        exit(EXIT_FAILURE);
+
+    new->desc = desc;
+    new->state8080 = init8080();
+    new->screenBuffer = calloc((size_t)desc->screenWidth * desc->screenHeight, 4);
+    new->overlay = malloc((size_t)desc->screenHeight * sizeof(*(new->overlay)));
+    if (new->screenBuffer == NULL || new->overlay == NULL)
+        exit(EXIT_FAILURE);
+    machineSetOverlay(new, true);
+
+    // Memory map, everything not listed is open bus
+    Memory *map = new->state8080->map;
+    memMap(map, 0x0000, 0xFFFF, PAGE_UNMAPPED);
+    for (int i = 0; i < desc->regionCount; i++)
+        memMap(map, desc->regions[i].start, desc->regions[i].end, desc->regions[i].type);
+    for (int i = 0; i < desc->aliasCount; i++)
+        memMirror(map, desc->aliases[i].start, desc->aliases[i].end, desc->aliases[i].target);
+
+    Ports *io = new->state8080->io;
+    portsInit(io, new);
+    for (int i = 0; i < desc->portCount; i++)
+    {
+        if (desc->ports[i].read != NULL)
+            portsMapRead(io, desc->ports[i].port, desc->ports[i].read);
+        if (desc->ports[i].write != NULL)
+            portsMapWrite(io, desc->ports[i].port, desc->ports[i].write);
+    }
+
+    memcpy(new->inputs, desc->inputDefaults, sizeof(new->inputs));
+    watchdogInit(&(new->watchdog), desc->watchdogFrames);
+    new->interruptNum = 0;
+    new->sound = NULL;
+    return new;
+}
+
+void freeMachine(Machine *m)
+{
+    if (m->sound != NULL)
+        freeSound(m->sound);
+    if (m->trace != NULL)
+        freeTrace(m->trace);
+    if (m->debugger != NULL)
+        freeDebugger(m->debugger);
+    if (m->capture != NULL)
+        freeCapture(m->capture);
+    free(m->state8080->codes);
+    free(m->state8080->mem);
+    free(m->state8080->map);
+    free(m->state8080->io);
+    free(m->state8080);
+    free(m->screenBuffer);
+    free(m->overlay);
+    free(m->background);
+    free(m->backgroundLit);
+    free(m);
+}
+
+// Read, check and load the board's ROM, see Rom.h for what path can be
+// (returns false if it can't be used)
+bool loadROM(Machine *m, const char *path)
+{
+    RomImage *rom = openROM(m->desc, path);
+    if (rom == NULL)
+        return false;
+
+    applyROM(m, rom);
+    freeROM(rom);
+    return true;
+}
+
+// Power-on state: cleared RAM and board latches, CPU at the reset vector
+void machineReset(Machine *m)
+{
+    for (int i = 0; i < m->desc->regionCount; i++)
+    {
+        const MemRegion *r = &(m->desc->regions[i]);
+        if (r->type == PAGE_RAM)
+            memset(&(m->state8080->mem[r->start]), 0, (size_t)(r->end - r->start) + 1);
+    }
+
+    reset8080(m->state8080);
+    memset(&(m->shifter), 0, sizeof(m->shifter));
+    memcpy(m->inputs, m->desc->inputDefaults, sizeof(m->inputs));
+    watchdogInit(&(m->watchdog), m->desc->watchdogFrames);
+    m->interruptNum = 0;
+}
+
+void machineSetInput(Machine *m, Input input, bool pressed)
+{
+    InputBit bit = m->desc->inputMap[input];
+    if (bit.mask == 0)
+        return;
+
+    if (pressed)
+        m->inputs[bit.port] |= bit.mask;
+    else
+        m->inputs[bit.port] &= ~(bit.mask);
+}
+
+// Player 0 uses the 1 player start button and port 1 controls, player 1
+// the 2 player start and the cocktail controls
+void machineSetAction(Machine *m, int player, uint8_t action)
+{
+    machineSetInput(m, INPUT_COIN, action & ACTION_COIN);
+    machineSetInput(m, player ? INPUT_START2 : INPUT_START1, action & ACTION_START);
+    machineSetInput(m, player ? INPUT_P2_FIRE : INPUT_FIRE, action & ACTION_FIRE);
+    machineSetInput(m, player ? INPUT_P2_LEFT : INPUT_LEFT, action & ACTION_LEFT);
+    machineSetInput(m, player ? INPUT_P2_RIGHT : INPUT_RIGHT, action & ACTION_RIGHT);
+}
+
+void runFrame(Machine *m)
+{
+    int cycles = 0;
+    int cyclesPerFrame = m->desc->cyclesPerFrame;
+    int interruptCycles = cyclesPerFrame / 2;
+    Debugger *dbg = m->debugger;
+    const AotEngine *aot = (m->trace == NULL && dbg == NULL) ? m->aot : NULL;
+
+    while (cycles < cyclesPerFrame)
+    {
+        // Translated blocks, if PC is at one, up to the next interrupt, then one
+        // instruction of the interpreter from wherever they stopped
+        uint16_t pc = m->state8080->pc;
+        if (aot != NULL && pc <= aot->last && (aot->starts[pc >> 3] & (1 << (pc & 7))))
+            cycles = aot->run(m->state8080, cycles, interruptCycles < cyclesPerFrame ? interruptCycles : cyclesPerFrame);
+
+        // Breakpoints cost nothing until GDB sets one
+        if (dbg != NULL && dbg->armed)
+            debuggerBefore(dbg);
+        cycles += (m->trace != NULL) ? traceStep(m->trace, m->state8080) : emulate8080(m->state8080);
+        if (dbg != NULL && dbg->armed)
+            debuggerAfter(dbg);
+
+        // Check if time for an interrupt
+        if (cycles >= interruptCycles)
+        {
+            interruptCycles *= 2;
+            GenerateInterrupt(m->state8080, m->desc->interrupts[m->interruptNum]);
+            m->interruptNum ^= 1;
+        }
+    }
+
+    if (dbg != NULL)
+        debuggerPoll(dbg);
+    machineEndFrame(m);
+}
+
+// Every frame emulated is captured, whether it gets shown or not. A hung
+// program stops kicking the watchdog and the board resets.
+void machineEndFrame(Machine *m)
+{
+    if (m->capture != NULL)
+    {
+        uint8_t *frame = captureSlot(m->capture);
+        if (m->capture->format == CAPTURE_Y4M)
+        {
+            m->desc->video(m);
+            memcpy(frame, m->screenBuffer, (size_t)m->desc->screenWidth * m->desc->screenHeight * 4);
+        }
+        else
+            m->desc->packVideo(m, frame);
+        captureFrame(m->capture);
+    }
+    if (watchdogTick(&(m->watchdog)))
+    {
+        reset8080(m->state8080);
+        m->interruptNum = 0;
+    }
+}
+
+void updateBuffer(Machine *m)
+{
+    m->desc->video(m);
+}
+
+static uint32_t packColour(uint8_t r, uint8_t g, uint8_t b)
+{
+    uint8_t rgba[4] = {r, g, b, 0};
+    uint32_t colour;
+    memcpy(&colour, rgba, sizeof(colour));
+    return colour;
+}
+
+// Light from the screen adds to the picture behind the glass
+static uint32_t addColour(uint32_t a, uint32_t b)
+{
+    uint8_t x[4];
+    uint8_t y[4];
+    memcpy(x, &a, sizeof(x));
+    memcpy(y, &b, sizeof(y));
+    for (int i = 0; i < 3; i++)
+        x[i] = (uint8_t)(x[i] + y[i] > 255 ? 255 : x[i] + y[i]);
+    memcpy(&a, x, sizeof(a));
+    return a;
+}
+
+static void updateBackgroundLit(Machine *m)
+{
+    int width = m->desc->screenWidth;
+    for (int y = 0; y < m->desc->screenHeight; y++)
+    {
+        const OverlaySpan *span = m->overlay[y];
+        for (int x = 0; x < width; x++)
+        {
+            while (x >= span->end)
+                span++;
+            m->backgroundLit[y * width + x] = addColour(m->background[y * width + x], span->colour);
+        }
+    }
+}
+
+// Rebuild the per-row palette, from the board's overlay or all white
+void machineSetOverlay(Machine *m, bool enabled)
+{
+    const MachineDesc *desc = m->desc;
+    uint32_t *row = malloc((size_t)desc->screenWidth * sizeof(uint32_t));
+    if (row == NULL)
+        exit(EXIT_FAILURE);
+
+    // Rows under the same bands share spans, so only build one per change
+    uint32_t bands = 0;
+    for (int y = 0; y < desc->screenHeight; y++)
+    {
+        uint32_t rowBands = 0;
+        for (int i = 0; enabled && i < desc->overlayCount && i < 32; i++)
+            if (y >= desc->overlay[i].top && y <= desc->overlay[i].bottom)
+                rowBands |= 1u << i;
+        if (y > 0 && rowBands == bands && desc->overlayCount <= 32)
+        {
+            memcpy(m->overlay[y], m->overlay[y - 1], sizeof(m->overlay[y]));
+            continue;
+        }
+        bands = rowBands;
+
+        for (int x = 0; x < desc->screenWidth; x++)
+            row[x] = packColour(255, 255, 255);
+
+        for (int i = 0; enabled && i < desc->overlayCount; i++)
+        {
+            const OverlayBand *band = &(desc->overlay[i]);
+            if (y < band->top || y > band->bottom)
+                continue;
+            for (int x = band->left; x <= band->right && x < desc->screenWidth; x++)
+                row[x] = packColour(band->r, band->g, band->b);
+        }
+
+        // Runs of one colour become the spans of the row
+        int spans = 0;
+        for (int x = 0; x < desc->screenWidth; x++)
+        {
+            if (x + 1 < desc->screenWidth && row[x + 1] == row[x])
+                continue;
+            if (spans == OVERLAY_SPANS)
+            {
+                printf("Overlay of %s has too many colours in row %d\n", desc->name, y);
+                exit(EXIT_FAILURE);
+            }
+            m->overlay[y][spans++] = (OverlaySpan){.end = (uint16_t)(x + 1), .colour = row[x]};
+        }
+    }
+    free(row);
+
+    if (m->background != NULL)
+        updateBackgroundLit(m);
+}
+
+// Next number of a PPM header, skipping whitespace and comments
+static int ppmNumber(FILE *f)
+{
+    int c = fgetc(f);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+                c = fgetc(f);
+        }
+        c = fgetc(f);
+    }
+
+    int value = 0;
+    for (; c >= '0' && c <= '9' && value < 100000; c = fgetc(f))
+        value = value * 10 + (c - '0');
+    return c == EOF ? -1 : value; // the single whitespace after it is gone too
+}
+
+// Picture behind the screen from a binary PPM (P6), scaled to the screen
+// size (returns false if it can't be read)
+bool loadBackground(Machine *m, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+
+    int width = -1;
+    int height = -1;
+    int maxValue = -1;
+    if (fgetc(f) == 'P' && fgetc(f) == '6')
+    {
+        width = ppmNumber(f);
+        height = ppmNumber(f);
+        maxValue = ppmNumber(f);
+    }
+
+    uint8_t *pixels = NULL;
+    if (width > 0 && height > 0 && maxValue > 0 && maxValue < 256)
+        pixels = malloc((size_t)width * height * 3);
+    bool ok = pixels != NULL && fread(pixels, (size_t)width * height * 3, 1, f) == 1;
+    fclose(f);
+    if (!ok)
+    {
+        free(pixels);
+        return false;
+    }
+
+    int screenWidth = m->desc->screenWidth;
+    int screenHeight = m->desc->screenHeight;
+    if (m->background == NULL)
+    {
+        m->background = malloc((size_t)screenWidth * screenHeight * sizeof(uint32_t));
+        m->backgroundLit = malloc((size_t)screenWidth * screenHeight * sizeof(uint32_t));
+        if (m->background == NULL || m->backgroundLit == NULL)
+            exit(EXIT_FAILURE);
+    }
+
+    for (int y = 0; y < screenHeight; y++)
+    {
+        for (int x = 0; x < screenWidth; x++)
+        {
+            const uint8_t *p = &(pixels[3 * ((y * height / screenHeight) * width + x * width / screenWidth)]);
+            m->background[y * screenWidth + x] = packColour((uint8_t)(p[0] * 255 / maxValue),
+                                                            (uint8_t)(p[1] * 255 / maxValue),
+                                                            (uint8_t)(p[2] * 255 / maxValue));
+        }
+    }
+    free(pixels);
+
+    updateBackgroundLit(m);
+    return true;
+}
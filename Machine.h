@@ -0,0 +1,189 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "8080.h"
+#include "Sound.h"
+#include "Trace.h"
+#include "Debugger.h"
+#include "Capture.h"
+#include "Aot.h"
+
+#define MACHINE_INPUT_PORTS 4
+
+typedef struct Machine Machine;
+
+typedef struct
+{
+    uint16_t start;
+    uint16_t end;
+    PageType type;
+} MemRegion;
+
+// [start, end] aliases the already mapped pages at target
+typedef struct
+{
+    uint16_t start;
+    uint16_t end;
+    uint16_t target;
+} MemAlias;
+
+// A NULL handler leaves that direction unmapped
+typedef struct
+{
+    uint8_t port;
+    PortRead read;
+    PortWrite write;
+} PortHandler;
+
+// Logical cabinet controls, mapped to port bits by each board
+typedef enum
+{
+    INPUT_COIN,
+    INPUT_START1,
+    INPUT_START2,
+    INPUT_FIRE,
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_P2_FIRE,
+    INPUT_P2_LEFT,
+    INPUT_P2_RIGHT,
+    INPUT_TILT,
+    INPUT_COUNT
+} Input;
+
+// One player's controls packed in a byte, as fed by the RL environment and
+// netplay
+#define ACTION_COIN 0x01
+#define ACTION_START 0x02
+#define ACTION_FIRE 0x04
+#define ACTION_LEFT 0x08
+#define ACTION_RIGHT 0x10
+
+typedef struct
+{
+    uint8_t port; // index into Machine.inputs, mask 0 = not wired
+    uint8_t mask;
+} InputBit;
+
+// Coloured cellophane on the glass: lit pixels in rows [top, bottom] and
+// columns [left, right] of the displayed picture take this colour
+typedef struct
+{
+    int top;
+    int bottom;
+    int left;
+    int right;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} OverlayBand;
+
+// One chip of a board's ROM set, as dumps are usually named
+typedef struct
+{
+    const char *name;
+    uint16_t addr;
+    uint16_t size;
+    uint32_t crc; // CRC-32 of a good dump, 0 if not checked
+} RomFile;
+
+#define OVERLAY_SPANS 4 // colours across one row
+
+// Lit pixels of a displayed row are colour up to column end
+typedef struct
+{
+    uint16_t end;
+    uint32_t colour; // RGBA byte order, like screenBuffer
+} OverlaySpan;
+
+// Everything board specific, resolved into the CPU's memory and port tables
+// once by initMachine()
+typedef struct
+{
+    const char *name;
+
+    int screenWidth;     // displayed (rotated) size
+    int screenHeight;
+    uint16_t vramAddr;
+    int cyclesPerFrame;
+    uint8_t interrupts[2]; // RST at mid screen and at vblank
+    int watchdogFrames;    // 0 when there is no watchdog
+
+    const MemRegion *regions;
+    int regionCount;
+    const MemAlias *aliases;
+    int aliasCount;
+
+    const PortHandler *ports;
+    int portCount;
+
+    InputBit inputMap[INPUT_COUNT];
+    uint8_t inputDefaults[MACHINE_INPUT_PORTS]; // idle port values (DIP switches...)
+
+    const RomFile *romFiles; // the chips in address order
+    int romCount;
+
+    const OverlayBand *overlay; // NULL for a plain white picture
+    int overlayCount;
+
+    void (*video)(Machine *m); // decode VRAM into screenBuffer
+    // Lit pixels of VRAM, the screen rows packed MSB first
+    void (*packVideo)(const Machine *m, uint8_t *bits);
+} MachineDesc;
+
+// MB14241 barrel shifter found on the Midway/Taito 8080 boards
+typedef struct
+{
+    uint8_t lsb;
+    uint8_t msb;
+    uint8_t offset;
+} Shifter;
+
+struct Machine
+{
+    const MachineDesc *desc;
+    State *state8080;
+
+    Shifter shifter;
+    uint8_t inputs[MACHINE_INPUT_PORTS];
+
+    int interruptNum; // index into desc->interrupts of the next interrupt
+    Watchdog watchdog;
+
+    Sound *sound; // NULL when sound is not emulated
+    Trace *trace; // NULL unless recording an execution trace
+    Debugger *debugger; // NULL unless GDB can attach
+    Capture *capture;   // NULL unless recording every frame emulated
+    const AotEngine *aot; // NULL unless a translation of the ROM is linked in
+
+    uint8_t *screenBuffer; // screenHeight x screenWidth, RGBA format
+
+    // Colour of the lit pixels of each displayed row, built once from
+    // desc->overlay. With a background picture, unlit pixels show it and
+    // lit ones show it plus their colour, both precomputed per pixel.
+    OverlaySpan (*overlay)[OVERLAY_SPANS];
+    uint32_t *background; // NULL for black
+    uint32_t *backgroundLit;
+};
+
+// Port handler returning inputs[port], for boards to put in their tables
+uint8_t machineReadInputs(void *ctx, uint8_t port);
+
+const MachineDesc *findMachine(const char *name);
+Machine *initMachine(const MachineDesc *desc);
+void freeMachine(Machine *m);
+bool loadROM(Machine *m, const char *path);
+void machineReset(Machine *m);
+void machineSetInput(Machine *m, Input input, bool pressed);
+void machineSetAction(Machine *m, int player, uint8_t action);
+void runFrame(Machine *m);
+void machineEndFrame(Machine *m);
+void updateBuffer(Machine *m);
+void machineSetOverlay(Machine *m, bool enabled);
+bool loadBackground(Machine *m, const char *path);
+
+#endif
@@ -0,0 +1,104 @@
+#include <string.h>
+#include "Memory.h"
+
+// Recompute the hot path pointers of a page from its type and hook
+static void updatePage(Memory *m, int page)
+{
+    switch (m->type[page])
+    {
+        case PAGE_ROM:
+        {
+            m->read[page] = m->target[page];
+            m->write[page] = NULL;
+            break;
+        }
+
+        case PAGE_RAM:
+        {
+            m->read[page] = m->target[page];
+            m->write[page] = m->hooked[page] ? NULL : m->target[page];
+            break;
+        }
+
+        default:
+        {
+            m->read[page] = m->openBus;
+            m->write[page] = NULL;
+            break;
+        }
+    }
+}
+
+// Whole address space is RAM, the plain 8080 setup
+void memInit(Memory *m, uint8_t *backing)
+{
+    memset(m->openBus, 0xFF, sizeof(m->openBus));
+    m->backing = backing;
+    m->hook = NULL;
+    m->hookCtx = NULL;
+
+    for (int page = 0; page < MEM_PAGES; page++)
+        m->hooked[page] = false;
+
+    memMap(m, 0x0000, 0xFFFF, PAGE_RAM);
+}
+
+// Map [start, end] onto the backing image at the same address
+void memMap(Memory *m, uint16_t start, uint16_t end, PageType type)
+{
+    for (int page = start >> MEM_PAGE_SHIFT; page <= end >> MEM_PAGE_SHIFT; page++)
+    {
+        m->target[page] = &(m->backing[page << MEM_PAGE_SHIFT]);
+        m->type[page] = type;
+        updatePage(m, page);
+    }
+}
+
+// Make [start, end] an alias of the pages starting at target (which must
+// already be mapped)
+void memMirror(Memory *m, uint16_t start, uint16_t end, uint16_t target)
+{
+    int src = target >> MEM_PAGE_SHIFT;
+    for (int page = start >> MEM_PAGE_SHIFT; page <= end >> MEM_PAGE_SHIFT; page++, src++)
+    {
+        m->target[page] = m->target[src];
+        m->type[page] = m->type[src];
+        m->hooked[page] = m->hooked[src];
+        updatePage(m, page);
+    }
+}
+
+// Route writes to [start, end] (and every mirror of it) through hook. Only
+// hooked pages leave the fast path.
+void memSetWriteHook(Memory *m, uint16_t start, uint16_t end, MemWriteHook hook, void *ctx)
+{
+    m->hook = hook;
+    m->hookCtx = ctx;
+
+    uint8_t *first = &(m->backing[start & ~MEM_PAGE_MASK]);
+    uint8_t *last = &(m->backing[end & ~MEM_PAGE_MASK]);
+    for (int page = 0; page < MEM_PAGES; page++)
+    {
+        if (m->target[page] >= first && m->target[page] <= last)
+        {
+            m->hooked[page] = (hook != NULL);
+            updatePage(m, page);
+        }
+    }
+}
+
+void memWriteSlow(Memory *m, uint16_t addr, uint8_t value)
+{
+    int page = addr >> MEM_PAGE_SHIFT;
+
+    // writes to ROM and unmapped space are dropped
+    if (m->type[page] != PAGE_RAM)
+        return;
+
+    m->target[page][addr & MEM_PAGE_MASK] = value;
+    if (m->hooked[page] && m->hook != NULL)
+    {
+        uint16_t phys = (uint16_t)(m->target[page] - m->backing) | (addr & MEM_PAGE_MASK);
+        m->hook(m->hookCtx, phys, value);
+    }
+}
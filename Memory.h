@@ -0,0 +1,88 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MEM_SIZE 0x10000
+#define MEM_PAGE_SHIFT 8
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK (MEM_PAGE_SIZE - 1)
+#define MEM_PAGES (MEM_SIZE >> MEM_PAGE_SHIFT)
+
+typedef enum
+{
+    PAGE_UNMAPPED,
+    PAGE_ROM,
+    PAGE_RAM,
+} PageType;
+
+// Called after a write lands in a hooked page, addr is the physical
+// (mirror resolved) address
+typedef void (*MemWriteHook)(void *ctx, uint16_t addr, uint8_t value);
+
+typedef struct
+{
+    // Hot path tables, indexed by page. Reads always have a page to read
+    // from (unmapped pages read open bus). A NULL write page sends the write
+    // down memWriteSlow() (ROM, unmapped and hooked pages).
+    uint8_t *read[MEM_PAGES];
+    uint8_t *write[MEM_PAGES];
+
+    uint8_t *target[MEM_PAGES]; // backing storage of the page, mirrors resolved
+    uint8_t type[MEM_PAGES];
+    bool hooked[MEM_PAGES];
+
+    MemWriteHook hook;
+    void *hookCtx;
+
+    uint8_t *backing; // 64KiB physical image
+    uint8_t openBus[MEM_PAGE_SIZE];
+} Memory;
+
+void memInit(Memory *m, uint8_t *backing);
+void memMap(Memory *m, uint16_t start, uint16_t end, PageType type);
+void memMirror(Memory *m, uint16_t start, uint16_t end, uint16_t target);
+void memSetWriteHook(Memory *m, uint16_t start, uint16_t end, MemWriteHook hook, void *ctx);
+void memWriteSlow(Memory *m, uint16_t addr, uint8_t value);
+
+static inline uint8_t memRead(const Memory *m, uint16_t addr)
+{
+    return m->read[addr >> MEM_PAGE_SHIFT][addr & MEM_PAGE_MASK];
+}
+
+static inline void memWrite(Memory *m, uint16_t addr, uint8_t value)
+{
+    uint8_t *page = m->write[addr >> MEM_PAGE_SHIFT];
+    if (page != NULL)
+        page[addr & MEM_PAGE_MASK] = value;
+    else
+        memWriteSlow(m, addr, value);
+}
+
+// 16-bit accesses are little endian and wrap around at 0xFFFF
+static inline uint16_t memRead16(const Memory *m, uint16_t addr)
+{
+    return (uint16_t)memRead(m, addr) | ((uint16_t)memRead(m, (uint16_t)(addr + 1)) << 8);
+}
+
+static inline void memWrite16(Memory *m, uint16_t addr, uint16_t value)
+{
+    memWrite(m, addr, (uint8_t)(value & 0xFF));
+    memWrite(m, (uint16_t)(addr + 1), (uint8_t)(value >> 8));
+}
+
+// Returns the (up to) 3 instruction bytes at addr. Points straight into the
+// page unless the instruction straddles a page boundary, then buf is filled.
+static inline const uint8_t *memFetch(const Memory *m, uint16_t addr, uint8_t *buf)
+{
+    if ((addr & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 3)
+        return &(m->read[addr >> MEM_PAGE_SHIFT][addr & MEM_PAGE_MASK]);
+
+    buf[0] = memRead(m, addr);
+    buf[1] = memRead(m, (uint16_t)(addr + 1));
+    buf[2] = memRead(m, (uint16_t)(addr + 2));
+    return buf;
+}
+
+#endif
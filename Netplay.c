@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include "Netplay.h"
+#include "Bytes.h"
+
+// Packet: 'S' 'I', ack (u32), first frame (u32), count (u8), count inputs.
+// ack tells the peer which of its inputs arrived. Inputs are resent until
+// acked, so a lost packet costs nothing but a little more rollback.
+#define NET_HEADER 11
+
+// The peer can be missing at most this many of our inputs (both sides
+// stall NET_MAX_ROLLBACK frames ahead and add their delay), one packet has
+// to be able to carry all of them
+_Static_assert(2 * (NET_MAX_ROLLBACK + NET_MAX_DELAY) <= NET_PACKET_INPUTS, "packet too small");
+_Static_assert(NET_PACKET_INPUTS + NET_MAX_ROLLBACK < NET_RING, "ring too small");
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Netplay *initNetplay(Machine *m, int player, int delay, int localPort, const char *host, int port)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo *peer;
+    if (getaddrinfo(host, service, &hints, &peer) != 0)
+        return NULL;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((uint16_t)localPort);
+
+    if (sock < 0 || bind(sock, (struct sockaddr *)&local, sizeof(local)) != 0
+        || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        if (sock >= 0)
+            close(sock);
+        freeaddrinfo(peer);
+        return NULL;
+    }
+
+    Netplay *n = calloc(1, sizeof(Netplay));
+    if (n == NULL)
+        exit(EXIT_FAILURE);
+
+    n->m = m;
+    n->player = player ? 1 : 0;
+    n->delay = delay < 0 ? 0 : (delay > NET_MAX_DELAY ? NET_MAX_DELAY : delay);
+    n->sock = sock;
+    memcpy(&(n->peer), peer->ai_addr, peer->ai_addrlen);
+    n->peerLen = peer->ai_addrlen;
+    freeaddrinfo(peer);
+
+    n->rollbackFrom = UINT32_MAX;
+    for (int i = 0; i < NET_RING; i++)
+        n->ring[i].snapshot = initSnapshot(m);
+    return n;
+}
+
+void freeNetplay(Netplay *n)
+{
+    for (int i = 0; i < NET_RING; i++)
+        freeSnapshot(n->ring[i].snapshot);
+    close(n->sock);
+    free(n);
+}
+
+// Everything the peer may still be missing, newest NET_PACKET_INPUTS at most
+static void netSend(Netplay *n)
+{
+    uint8_t packet[NET_HEADER + NET_PACKET_INPUTS];
+    uint32_t known = n->frame + (uint32_t)n->delay;
+    uint32_t first = n->remoteAck;
+    if (known - first > NET_PACKET_INPUTS)
+        first = known - NET_PACKET_INPUTS;
+
+    packet[0] = 'S';
+    packet[1] = 'I';
+    put32(&(packet[2]), n->remoteFrames);
+    put32(&(packet[6]), first);
+    packet[10] = (uint8_t)(known - first);
+    for (uint32_t f = first; f < known; f++)
+        packet[NET_HEADER + (f - first)] = n->ring[f % NET_RING].local;
+
+    // Best effort, a dropped packet is covered by the next one
+    sendto(n->sock, packet, NET_HEADER + (known - first), 0, (struct sockaddr *)&(n->peer), n->peerLen);
+}
+
+static void netReceive(Netplay *n)
+{
+    uint8_t packet[NET_HEADER + 255];
+    ssize_t len;
+    while ((len = recvfrom(n->sock, packet, sizeof(packet), 0, NULL, NULL)) >= NET_HEADER)
+    {
+        int count = packet[10];
+        if (packet[0] != 'S' || packet[1] != 'I' || len < NET_HEADER + count)
+            continue;
+
+        uint32_t ack = get32(&(packet[2]));
+        if (ack > n->remoteAck)
+            n->remoteAck = ack;
+
+        // Take inputs in order only, a gap is filled by a later resend
+        uint32_t first = get32(&(packet[6]));
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t f = first + (uint32_t)i;
+            if (f != n->remoteFrames)
+                continue;
+
+            NetFrame *slot = &(n->ring[f % NET_RING]);
+            slot->remote = packet[NET_HEADER + i];
+            if (f < n->frame && slot->used != slot->remote && f < n->rollbackFrom)
+                n->rollbackFrom = f;
+            n->remoteFrames++;
+        }
+    }
+}
+
+// Run frame f with its local input and the confirmed or predicted remote one
+static void simulate(Netplay *n, uint32_t f)
+{
+    NetFrame *slot = &(n->ring[f % NET_RING]);
+    uint8_t remote;
+    if (f < n->remoteFrames)
+        remote = slot->remote;
+    else if (n->remoteFrames > 0)
+        remote = n->ring[(n->remoteFrames - 1) % NET_RING].remote; // keep holding it
+    else
+        remote = 0;
+    slot->used = remote;
+
+    saveSnapshot(n->m, slot->snapshot);
+
+    uint8_t p1 = n->player ? remote : slot->local;
+    uint8_t p2 = n->player ? slot->local : remote;
+    uint8_t coin = (p1 | p2) & ACTION_COIN;
+    machineSetAction(n->m, 0, p1 | coin);
+    machineSetAction(n->m, 1, p2 | coin);
+    runFrame(n->m);
+}
+
+// Back to the first mispredicted frame and forward again, silently
+static void rollback(Netplay *n)
+{
+    double start = now();
+    uint32_t from = n->rollbackFrom;
+    loadSnapshot(n->m, n->ring[from % NET_RING].snapshot);
+
+    // The frames went to the capture when first run
+    Sound *sound = n->m->sound;
+    Capture *capture = n->m->capture;
+    n->m->sound = NULL;
+    n->m->capture = NULL;
+    for (uint32_t f = from; f < n->frame; f++)
+        simulate(n, f);
+    n->m->sound = sound;
+    n->m->capture = capture;
+
+    double elapsed = now() - start;
+    n->rollbacks++;
+    n->resimulated += n->frame - from;
+    n->maxDepth = (n->frame - from > n->maxDepth) ? n->frame - from : n->maxDepth;
+    n->resimTime += elapsed;
+    n->worstRollback = elapsed > n->worstRollback ? elapsed : n->worstRollback;
+}
+
+bool netAdvance(Netplay *n, uint8_t localInput)
+{
+    netReceive(n);
+    if (n->rollbackFrom < n->frame)
+        rollback(n);
+    n->rollbackFrom = UINT32_MAX;
+
+    if (n->frame >= n->remoteFrames + NET_MAX_ROLLBACK)
+    {
+        n->stalls++;
+        netSend(n);
+        return false;
+    }
+
+    n->ring[(n->frame + (uint32_t)n->delay) % NET_RING].local = localInput;
+    simulate(n, n->frame);
+    n->frame++;
+    netSend(n);
+    return true;
+}
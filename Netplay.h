@@ -0,0 +1,64 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include "Machine.h"
+#include "Snapshot.h"
+
+#define NET_RING 64          // frames of inputs and snapshots kept, power of 2
+#define NET_MAX_ROLLBACK 12  // unconfirmed frames allowed before stalling
+#define NET_MAX_DELAY 8
+#define NET_PACKET_INPUTS 48 // most inputs resent in one packet
+
+// One frame of the session, indexed by frame % NET_RING
+typedef struct
+{
+    uint8_t local;  // ACTION_ bits of this peer
+    uint8_t remote; // of the other peer, valid once confirmed
+    uint8_t used;   // remote input the frame was last simulated with
+    Snapshot *snapshot; // state before the frame
+} NetFrame;
+
+// Rollback netplay over UDP. Both peers run the same machine with player 1
+// on one side and player 2 on the other, so only inputs go over the wire.
+// Frames run straight away with the remote input predicted (the last one
+// received) and are simulated again from their snapshot when the real input
+// turns out different.
+typedef struct
+{
+    Machine *m;
+    int player; // side controlled locally, 0 or 1
+    int delay;  // frames between reading local input and using it
+
+    int sock;
+    struct sockaddr_storage peer;
+    socklen_t peerLen;
+
+    uint32_t frame;        // next frame to simulate
+    uint32_t remoteFrames; // remote inputs of frames below this are confirmed
+    uint32_t remoteAck;    // the peer has our inputs below this
+    uint32_t rollbackFrom; // earliest mispredicted frame, UINT32_MAX if none
+    NetFrame ring[NET_RING];
+
+    // Statistics
+    uint64_t rollbacks;
+    uint64_t resimulated; // frames run again
+    uint32_t maxDepth;
+    double resimTime;     // seconds spent in rollbacks
+    double worstRollback;
+    uint64_t stalls;
+} Netplay;
+
+// Binds localPort and talks to host:port. Returns NULL if the socket can't
+// be set up or host doesn't resolve.
+Netplay *initNetplay(Machine *m, int player, int delay, int localPort, const char *host, int port);
+void freeNetplay(Netplay *n);
+
+// Feed this frame's local input and advance the session by a frame. Returns
+// false when too far ahead of the peer to predict any more, then the caller
+// should just present the last frame and try again on the next tick.
+bool netAdvance(Netplay *n, uint8_t localInput);
+
+#endif
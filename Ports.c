@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include "Ports.h"
+
+// Unmapped ports read as 0 and ignore writes
+static uint8_t unmappedRead(void *ctx, uint8_t port)
+{
+    (void)ctx;
+    (void)port;
+    return 0;
+}
+
+static void unmappedWrite(void *ctx, uint8_t port, uint8_t value)
+{
+    (void)ctx;
+    (void)port;
+    (void)value;
+}
+
+void portsInit(Ports *p, void *ctx)
+{
+    for (int port = 0; port < PORT_COUNT; port++)
+    {
+        p->read[port] = unmappedRead;
+        p->write[port] = unmappedWrite;
+    }
+    p->ctx = ctx;
+}
+
+void portsMapRead(Ports *p, uint8_t port, PortRead fn)
+{
+    p->read[port] = (fn != NULL) ? fn : unmappedRead;
+}
+
+void portsMapWrite(Ports *p, uint8_t port, PortWrite fn)
+{
+    p->write[port] = (fn != NULL) ? fn : unmappedWrite;
+}
+
+void watchdogInit(Watchdog *w, int limit)
+{
+    w->limit = limit;
+    w->count = 0;
+    w->resets = 0;
+}
+
+void watchdogKick(Watchdog *w)
+{
+    w->count = 0;
+}
+
+// Call once per frame, returns true when the board should be reset
+bool watchdogTick(Watchdog *w)
+{
+    if (w->limit <= 0 || ++(w->count) < w->limit)
+        return false;
+
+    w->count = 0;
+    w->resets++;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef PORTS_H
+#define PORTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PORT_COUNT 256
+
+typedef uint8_t (*PortRead)(void *ctx, uint8_t port);
+typedef void (*PortWrite)(void *ctx, uint8_t port, uint8_t value);
+
+// IN/OUT dispatch, every port always has a handler so the CPU never checks
+typedef struct
+{
+    PortRead read[PORT_COUNT];
+    PortWrite write[PORT_COUNT];
+    void *ctx; // board passed to every handler
+} Ports;
+
+// Reset the watchdog by writing its port, the board resets when it expires
+typedef struct
+{
+    int limit; // frames without a kick before reset
+    int count;
+    int resets;
+} Watchdog;
+
+void portsInit(Ports *p, void *ctx);
+void portsMapRead(Ports *p, uint8_t port, PortRead fn);
+void portsMapWrite(Ports *p, uint8_t port, PortWrite fn);
+
+static inline uint8_t portRead(const Ports *p, uint8_t port)
+{
+    return p->read[port](p->ctx, port);
+}
+
+static inline void portWrite(const Ports *p, uint8_t port, uint8_t value)
+{
+    p->write[port](p->ctx, port, value);
+}
+
+void watchdogInit(Watchdog *w, int limit);
+void watchdogKick(Watchdog *w);
+bool watchdogTick(Watchdog *w);
+
+#endif
@@ -0,0 +1,400 @@
+#include "Ref8080.h"
+
+// Decoded by the opcode's bit fields rather than one case per opcode, so it
+// shares as little as possible with 8080.c
+enum { B, C, D, E, H, L, M, A };
+
+static uint8_t fetch(Ref8080 *cpu)
+{
+    return cpu->mem[cpu->pc++];
+}
+
+static uint16_t fetch16(Ref8080 *cpu)
+{
+    uint8_t lo = fetch(cpu);
+    return (uint16_t)(lo | (fetch(cpu) << 8));
+}
+
+static void store(Ref8080 *cpu, uint16_t addr, uint8_t value)
+{
+    cpu->mem[addr] = value;
+    if (cpu->writeCount < REF_MAX_WRITES)
+    {
+        cpu->writeAddr[cpu->writeCount] = addr;
+        cpu->writeValue[cpu->writeCount] = value;
+    }
+    cpu->writeCount++;
+}
+
+static uint16_t hl(const Ref8080 *cpu)
+{
+    return (uint16_t)((cpu->reg[H] << 8) | cpu->reg[L]);
+}
+
+static uint8_t getReg(const Ref8080 *cpu, int r)
+{
+    return r == M ? cpu->mem[hl(cpu)] : cpu->reg[r];
+}
+
+static void setReg(Ref8080 *cpu, int r, uint8_t value)
+{
+    if (r == M)
+        store(cpu, hl(cpu), value);
+    else
+        cpu->reg[r] = value;
+}
+
+// Register pair field: BC DE HL SP
+static uint16_t getPair(const Ref8080 *cpu, int rp)
+{
+    if (rp == 3)
+        return cpu->sp;
+    return (uint16_t)((cpu->reg[2 * rp] << 8) | cpu->reg[2 * rp + 1]);
+}
+
+static void setPair(Ref8080 *cpu, int rp, uint16_t value)
+{
+    if (rp == 3)
+        cpu->sp = value;
+    else
+    {
+        cpu->reg[2 * rp] = (uint8_t)(value >> 8);
+        cpu->reg[2 * rp + 1] = (uint8_t)value;
+    }
+}
+
+static void push(Ref8080 *cpu, uint16_t value)
+{
+    store(cpu, --cpu->sp, (uint8_t)(value >> 8));
+    store(cpu, --cpu->sp, (uint8_t)value);
+}
+
+static uint16_t pop(Ref8080 *cpu)
+{
+    uint8_t lo = cpu->mem[cpu->sp++];
+    return (uint16_t)(lo | (cpu->mem[cpu->sp++] << 8));
+}
+
+static uint8_t szp(uint8_t v)
+{
+    int bits = 0;
+    for (int i = 0; i < 8; i++)
+        bits += (v >> i) & 1;
+
+    return (uint8_t)((v & REF_S) | (v == 0 ? REF_Z : 0) | ((bits & 1) ? 0 : REF_P));
+}
+
+// Condition field: NZ Z NC C PO PE P M
+static bool condition(const Ref8080 *cpu, int cc)
+{
+    static const uint8_t flag[4] = {REF_Z, REF_CY, REF_P, REF_S};
+    bool set = (cpu->flags & flag[cc >> 1]) != 0;
+    return (cc & 1) ? set : !set;
+}
+
+// A + value + carryIn, flags of the addition. Subtraction adds the
+// complement with the borrow inverted, and inverts the carry out, like
+// the chip does.
+static uint8_t addFlags(Ref8080 *cpu, uint8_t value, int carryIn, bool borrow)
+{
+    uint8_t a = cpu->reg[A];
+    int sum = a + value + carryIn;
+    bool ac = ((a & 0x0F) + (value & 0x0F) + carryIn) > 0x0F;
+    bool cy = (sum > 0xFF) != borrow;
+
+    cpu->flags = szp((uint8_t)sum) | (ac ? REF_AC : 0) | (cy ? REF_CY : 0) | REF_FLAGS_FIXED;
+    return (uint8_t)sum;
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP
+static void alu(Ref8080 *cpu, int op, uint8_t value)
+{
+    int cy = cpu->flags & REF_CY;
+    uint8_t a = cpu->reg[A];
+
+    switch (op)
+    {
+        case 0: cpu->reg[A] = addFlags(cpu, value, 0, false); break;
+        case 1: cpu->reg[A] = addFlags(cpu, value, cy, false); break;
+        case 2: cpu->reg[A] = addFlags(cpu, (uint8_t)~value, 1, true); break;
+        case 3: cpu->reg[A] = addFlags(cpu, (uint8_t)~value, !cy, true); break;
+        case 4:
+        {
+            // AC is the OR of bit 3 of the operands
+            cpu->reg[A] = a & value;
+            cpu->flags = szp(cpu->reg[A]) | (((a | value) & 0x08) ? REF_AC : 0) | REF_FLAGS_FIXED;
+            break;
+        }
+        case 5: cpu->reg[A] = a ^ value; cpu->flags = szp(cpu->reg[A]) | REF_FLAGS_FIXED; break;
+        case 6: cpu->reg[A] = a | value; cpu->flags = szp(cpu->reg[A]) | REF_FLAGS_FIXED; break;
+        default: addFlags(cpu, (uint8_t)~value, 1, true); break;
+    }
+}
+
+static void daa(Ref8080 *cpu)
+{
+    uint8_t a = cpu->reg[A];
+    uint8_t lo = a & 0x0F;
+    uint8_t hi = a >> 4;
+    uint8_t correction = 0;
+    bool cy = (cpu->flags & REF_CY) != 0;
+
+    if (lo > 9 || (cpu->flags & REF_AC))
+        correction |= 0x06;
+    if (hi > 9 || cy || (hi == 9 && lo > 9))
+    {
+        correction |= 0x60;
+        cy = true;
+    }
+
+    cpu->reg[A] = addFlags(cpu, correction, 0, false);
+    cpu->flags = (uint8_t)((cpu->flags & ~REF_CY) | (cy ? REF_CY : 0));
+}
+
+// RLC RRC RAL RAR DAA CMA STC CMC
+static void accumulator(Ref8080 *cpu, int op)
+{
+    uint8_t a = cpu->reg[A];
+    int cy = cpu->flags & REF_CY;
+
+    switch (op)
+    {
+        case 0: cy = a >> 7; a = (uint8_t)((a << 1) | cy); break;
+        case 1: cy = a & 1; a = (uint8_t)((a >> 1) | (cy << 7)); break;
+        case 2: { int out = a >> 7; a = (uint8_t)((a << 1) | cy); cy = out; break; }
+        case 3: { int out = a & 1; a = (uint8_t)((a >> 1) | (cy << 7)); cy = out; break; }
+        case 4: daa(cpu); return;
+        case 5: a = (uint8_t)~a; break;
+        case 6: cy = 1; break;
+        default: cy = !cy; break;
+    }
+
+    cpu->reg[A] = a;
+    cpu->flags = (uint8_t)((cpu->flags & ~REF_CY) | cy);
+}
+
+// 0x00 - 0x3F
+static int group0(Ref8080 *cpu, uint8_t op)
+{
+    int r = (op >> 3) & 7;
+    int rp = (op >> 4) & 3;
+
+    switch (op & 7)
+    {
+        case 0: return 4; // NOP and its undocumented copies
+
+        case 1:
+        {
+            if (op & 0x08)
+            {
+                // DAD
+                uint32_t sum = (uint32_t)getPair(cpu, 2) + getPair(cpu, rp);
+                setPair(cpu, 2, (uint16_t)sum);
+                cpu->flags = (uint8_t)((cpu->flags & ~REF_CY) | (sum >> 16));
+                return 10;
+            }
+            setPair(cpu, rp, fetch16(cpu)); // LXI
+            return 10;
+        }
+
+        case 2:
+        {
+            switch (op)
+            {
+                case 0x22: { uint16_t addr = fetch16(cpu); store(cpu, addr, cpu->reg[L]); store(cpu, (uint16_t)(addr + 1), cpu->reg[H]); return 16; }
+                case 0x2A: { uint16_t addr = fetch16(cpu); cpu->reg[L] = cpu->mem[addr]; cpu->reg[H] = cpu->mem[(uint16_t)(addr + 1)]; return 16; }
+                case 0x32: store(cpu, fetch16(cpu), cpu->reg[A]); return 13;
+                case 0x3A: cpu->reg[A] = cpu->mem[fetch16(cpu)]; return 13;
+            }
+            // STAX, LDAX
+            if (op & 0x08)
+                cpu->reg[A] = cpu->mem[getPair(cpu, rp)];
+            else
+                store(cpu, getPair(cpu, rp), cpu->reg[A]);
+            return 7;
+        }
+
+        case 3:
+        {
+            // INX, DCX
+            setPair(cpu, rp, (uint16_t)(getPair(cpu, rp) + ((op & 0x08) ? -1 : 1)));
+            return 5;
+        }
+
+        case 4:
+        case 5:
+        {
+            // INR, DCR: AC is the carry out of the low nibble, the carry flag
+            // is kept
+            uint8_t v = getReg(cpu, r);
+            bool dec = (op & 7) == 5;
+            uint8_t res = (uint8_t)(dec ? v - 1 : v + 1);
+            bool ac = dec ? (v & 0x0F) != 0 : (v & 0x0F) == 0x0F;
+            setReg(cpu, r, res);
+            cpu->flags = szp(res) | (ac ? REF_AC : 0) | (cpu->flags & REF_CY) | REF_FLAGS_FIXED;
+            return r == M ? 10 : 5;
+        }
+
+        case 6:
+        {
+            // MVI
+            setReg(cpu, r, fetch(cpu));
+            return r == M ? 10 : 7;
+        }
+
+        default:
+            accumulator(cpu, r);
+            return 4;
+    }
+}
+
+static int jumpIf(Ref8080 *cpu, bool taken)
+{
+    uint16_t addr = fetch16(cpu);
+    if (taken)
+        cpu->pc = addr;
+    return 10;
+}
+
+static int callIf(Ref8080 *cpu, bool taken)
+{
+    uint16_t addr = fetch16(cpu);
+    if (!taken)
+        return 11;
+
+    push(cpu, cpu->pc);
+    cpu->pc = addr;
+    return 17;
+}
+
+// 0xC0 - 0xFF
+static int group3(Ref8080 *cpu, uint8_t op)
+{
+    int cc = (op >> 3) & 7;
+    int rp = (op >> 4) & 3;
+
+    switch (op & 7)
+    {
+        case 0:
+        {
+            // Rcc
+            if (!condition(cpu, cc))
+                return 5;
+            cpu->pc = pop(cpu);
+            return 11;
+        }
+
+        case 1:
+        {
+            switch (op)
+            {
+                case 0xC9: case 0xD9: cpu->pc = pop(cpu); return 10; // RET
+                case 0xE9: cpu->pc = hl(cpu); return 5;              // PCHL
+                case 0xF9: cpu->sp = hl(cpu); return 5;              // SPHL
+                case 0xF1:
+                {
+                    // POP PSW
+                    uint16_t psw = pop(cpu);
+                    cpu->reg[A] = (uint8_t)(psw >> 8);
+                    cpu->flags = (uint8_t)((psw & 0xD5) | REF_FLAGS_FIXED);
+                    return 10;
+                }
+            }
+            setPair(cpu, rp, pop(cpu));
+            return 10;
+        }
+
+        case 2: return jumpIf(cpu, condition(cpu, cc));
+
+        case 3:
+        {
+            switch (op)
+            {
+                case 0xC3: case 0xCB: return jumpIf(cpu, true);
+                case 0xD3: { uint8_t port = fetch(cpu); cpu->out(cpu->ctx, port, cpu->reg[A]); return 10; }
+                case 0xDB: cpu->reg[A] = cpu->in(cpu->ctx, fetch(cpu)); return 10;
+                case 0xE3:
+                {
+                    // XTHL
+                    uint8_t lo = cpu->mem[cpu->sp];
+                    uint8_t hi = cpu->mem[(uint16_t)(cpu->sp + 1)];
+                    store(cpu, cpu->sp, cpu->reg[L]);
+                    store(cpu, (uint16_t)(cpu->sp + 1), cpu->reg[H]);
+                    cpu->reg[L] = lo;
+                    cpu->reg[H] = hi;
+                    return 18;
+                }
+                case 0xEB:
+                {
+                    // XCHG
+                    uint16_t de = getPair(cpu, 1);
+                    setPair(cpu, 1, hl(cpu));
+                    setPair(cpu, 2, de);
+                    return 4;
+                }
+                case 0xF3: cpu->inte = false; return 4;
+                default: cpu->inte = true; return 4;
+            }
+        }
+
+        case 4: return callIf(cpu, condition(cpu, cc));
+
+        case 5:
+        {
+            if (op & 0x08)
+                return callIf(cpu, true); // CALL and its undocumented copies
+            if (op == 0xF5)
+                push(cpu, (uint16_t)((cpu->reg[A] << 8) | cpu->flags));
+            else
+                push(cpu, getPair(cpu, rp));
+            return 11;
+        }
+
+        case 6:
+            alu(cpu, cc, fetch(cpu));
+            return 7;
+
+        default:
+        {
+            // RST
+            push(cpu, cpu->pc);
+            cpu->pc = (uint16_t)(cc * 8);
+            return 11;
+        }
+    }
+}
+
+int refStep(Ref8080 *cpu)
+{
+    cpu->writeCount = 0;
+    if (cpu->halted)
+        return 4;
+
+    uint8_t op = fetch(cpu);
+    switch (op >> 6)
+    {
+        case 0: return group0(cpu, op);
+
+        case 1:
+        {
+            if (op == 0x76)
+            {
+                cpu->halted = true;
+                return 7;
+            }
+            // MOV
+            int dst = (op >> 3) & 7;
+            int src = op & 7;
+            setReg(cpu, dst, getReg(cpu, src));
+            return (dst == M || src == M) ? 7 : 5;
+        }
+
+        case 2:
+        {
+            alu(cpu, (op >> 3) & 7, getReg(cpu, op & 7));
+            return (op & 7) == M ? 7 : 4;
+        }
+
+        default: return group3(cpu, op);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef REF8080_H
+#define REF8080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A second 8080, written from the data sheet independently of 8080.c, for
+// checking it. Plain 64KiB of RAM, no memory map, flags kept packed the way
+// PUSH PSW stores them.
+#define REF_S 0x80
+#define REF_Z 0x40
+#define REF_AC 0x10
+#define REF_P 0x04
+#define REF_CY 0x01
+#define REF_FLAGS_FIXED 0x02 // bit 1 always reads 1, bits 3 and 5 always 0
+
+#define REF_MAX_WRITES 4
+
+typedef struct
+{
+    uint8_t reg[8]; // B C D E H L - A, indexed like the opcode's register fields
+    uint8_t flags;
+    uint16_t sp;
+    uint16_t pc;
+    bool inte;
+    bool halted;
+
+    uint8_t mem[0x10000];
+
+    // Writes of the last refStep(), in order
+    int writeCount;
+    uint16_t writeAddr[REF_MAX_WRITES];
+    uint8_t writeValue[REF_MAX_WRITES];
+
+    uint8_t (*in)(void *ctx, uint8_t port);
+    void (*out)(void *ctx, uint8_t port, uint8_t value);
+    void *ctx;
+} Ref8080;
+
+// Execute one instruction, returns its cycle count
+int refStep(Ref8080 *cpu);
+
+#endif
@@ -0,0 +1,53 @@
+#include <string.h>
+#include "Replay.h"
+
+static const char magic[8] = "8080INP";
+
+Replay *initReplay(const char *path, const MachineDesc *desc, bool record)
+{
+    char name[REPLAY_NAME_BYTES] = {0};
+    strncpy(name, desc->name, sizeof(name) - 1);
+
+    FILE *file = fopen(path, record ? "wb" : "rb");
+    if (file == NULL)
+        return NULL;
+
+    if (record)
+    {
+        fwrite(magic, 1, sizeof(magic), file);
+        fwrite(name, 1, sizeof(name), file);
+    }
+    else
+    {
+        char header[sizeof(magic) + REPLAY_NAME_BYTES];
+        if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, magic, sizeof(magic))
+            || memcmp(&(header[sizeof(magic)]), name, sizeof(name)))
+        {
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    Replay *r = calloc(1, sizeof(Replay));
+    if (r == NULL)
+        exit(EXIT_FAILURE);
+    r->file = file;
+    r->recording = record;
+    return r;
+}
+
+void freeReplay(Replay *r)
+{
+    fclose(r->file);
+    free(r);
+}
+
+bool replayFrame(Replay *r, Machine *m)
+{
+    if (r->recording)
+        fwrite(m->inputs, 1, MACHINE_INPUT_PORTS, r->file);
+    else if (fread(m->inputs, 1, MACHINE_INPUT_PORTS, r->file) != MACHINE_INPUT_PORTS)
+        return false;
+    r->frames++;
+    return true;
+}
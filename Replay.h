@@ -0,0 +1,32 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "Machine.h"
+
+// Inputs of a session, recorded by si -record and played back by headless
+// -replay. The machine is deterministic, so the same ROM and inputs from
+// reset give the same game. File layout:
+//   "8080INP" '\0', machine name padded with zeros to 16 bytes
+//   per frame, the board's input ports before it runs
+#define REPLAY_NAME_BYTES 16
+
+typedef struct
+{
+    FILE *file;
+    bool recording;
+    uint64_t frames;
+} Replay;
+
+// NULL if path can't be created (record) or isn't a replay of this board
+Replay *initReplay(const char *path, const MachineDesc *desc, bool record);
+void freeReplay(Replay *r);
+
+// Before each frame, records m's inputs or sets them from the file. False
+// once the replay has run out.
+bool replayFrame(Replay *r, Machine *m);
+
+#endif
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Rom.h"
+
+// make EMBED_ROM=file puts the image in read-only data of the binary
+#ifdef EMBED_ROM
+#if defined(__APPLE__)
+#define ROM_SECTION ".const_data"
+#define ROM_SYMBOL(name) "_" #name
+#else
+#define ROM_SECTION ".section .rodata"
+#define ROM_SYMBOL(name) #name
+#endif
+
+__asm__(ROM_SECTION "\n"
+        ".balign 16\n"
+        ".globl " ROM_SYMBOL(embeddedRom) "\n"
+        ROM_SYMBOL(embeddedRom) ":\n"
+        ".incbin \"" EMBED_ROM "\"\n"
+        ".globl " ROM_SYMBOL(embeddedRomEnd) "\n"
+        ROM_SYMBOL(embeddedRomEnd) ":\n"
+        ".text\n");
+
+extern const uint8_t embeddedRom[];
+extern const uint8_t embeddedRomEnd[];
+#endif
+
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void initCrc(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+uint32_t crc32(const uint8_t *data, size_t length)
+{
+    pthread_once(&crcOnce, initCrc);
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+        c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+bool embeddedROM(void)
+{
+#ifdef EMBED_ROM
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Whole regular file of 1 byte to 64KiB, mapped read-only
+static const uint8_t *mapFile(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= MEM_SIZE)
+    {
+        *size = (size_t)st.st_size;
+        data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+static void addSpan(RomImage *rom, uint16_t addr, const uint8_t *data, size_t size)
+{
+    memcpy(&(rom->data[addr]), data, size);
+    rom->spans[rom->spanCount++] = (RomSpan){addr, (uint32_t)size};
+}
+
+static void addChip(RomImage *rom, const RomFile *file, const uint8_t *data)
+{
+    uint32_t crc = crc32(data, file->size);
+    if (file->crc != 0 && crc != file->crc)
+    {
+        printf("%s has CRC %08X instead of %08X, running it anyway\n", file->name, crc, file->crc);
+        rom->verified = false;
+    }
+    addSpan(rom, file->addr, data, file->size);
+}
+
+// A merged set, or anything else as a raw image at address 0
+static void addImage(RomImage *rom, const MachineDesc *desc, const uint8_t *data, size_t size)
+{
+    size_t setSize = 0;
+    for (int i = 0; i < desc->romCount; i++)
+        setSize += desc->romFiles[i].size;
+
+    if (desc->romCount > 0 && size == setSize)
+    {
+        for (int i = 0; i < desc->romCount; i++)
+        {
+            addChip(rom, &(desc->romFiles[i]), data);
+            data += desc->romFiles[i].size;
+        }
+        return;
+    }
+
+    rom->verified = false;
+    addSpan(rom, 0, data, size);
+}
+
+static bool addDirectory(RomImage *rom, const MachineDesc *desc, const char *path)
+{
+    if (desc->romCount == 0)
+    {
+        printf("No ROM set is known for %s, give it an image file\n", desc->name);
+        return false;
+    }
+
+    for (int i = 0; i < desc->romCount; i++)
+    {
+        const RomFile *file = &(desc->romFiles[i]);
+        char chip[4096];
+        snprintf(chip, sizeof(chip), "%s/%s", path, file->name);
+
+        size_t size = 0;
+        const uint8_t *data = mapFile(chip, &size);
+        if (data == NULL || size != file->size)
+        {
+            printf("%s is missing or not %u bytes\n", chip, file->size);
+            if (data != NULL)
+                munmap((void *)data, size);
+            return false;
+        }
+        addChip(rom, file, data);
+        munmap((void *)data, size);
+    }
+    return true;
+}
+
+RomImage *openROM(const MachineDesc *desc, const char *path)
+{
+    RomImage *rom = calloc(1, sizeof(RomImage));
+    if (rom == NULL || (rom->data = calloc(1, MEM_SIZE)) == NULL || desc->romCount > ROM_MAX_SPANS)
+        exit(EXIT_FAILURE);
+    rom->verified = desc->romCount > 0;
+
+    bool ok = true;
+    struct stat st;
+    bool exists = stat(path, &st) == 0;
+    if (!strcmp(path, "-"))
+    {
+#ifdef EMBED_ROM
+        addImage(rom, desc, embeddedRom, (size_t)(embeddedRomEnd - embeddedRom));
+#else
+        printf("No ROM is built in, see EMBED_ROM in the Makefile\n");
+        ok = false;
+#endif
+    }
+    else if (exists && S_ISDIR(st.st_mode))
+        ok = addDirectory(rom, desc, path);
+    else if (exists && st.st_size > MEM_SIZE)
+    {
+        printf("%s is larger than the 64KiB address space\n", path);
+        ok = false;
+    }
+    else
+    {
+        size_t size = 0;
+        const uint8_t *data = mapFile(path, &size);
+        ok = data != NULL;
+        if (ok)
+        {
+            addImage(rom, desc, data, size);
+            munmap((void *)data, size);
+        }
+    }
+
+    if (!ok)
+    {
+        freeROM(rom);
+        return NULL;
+    }
+    return rom;
+}
+
+void freeROM(RomImage *rom)
+{
+    free(rom->data);
+    free(rom);
+}
+
+void applyROM(Machine *m, const RomImage *rom)
+{
+    for (int i = 0; i < rom->spanCount; i++)
+        memcpy(&(m->state8080->mem[rom->spans[i].addr]), &(rom->data[rom->spans[i].addr]), rom->spans[i].size);
+    m->aot = aotFind(m->desc->name, m->state8080->mem);
+}
@@ -0,0 +1,44 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Machine.h"
+
+// A board's ROM, read and checked once and then copied into as many
+// machines as needed. path can be:
+//   a directory  holding the split set under the chip names (invaders.h...)
+//   a file       the size of the whole set: the chips back to back, in
+//                address order, or else a raw image loaded at address 0
+//   "-"          the image built into the binary with EMBED_ROM, read the
+//                same way as a file
+// Files are mmapped rather than read. Chips that don't match their CRC are
+// reported but still loaded, so hacks and bootlegs run.
+#define ROM_MAX_SPANS 8
+
+typedef struct
+{
+    uint16_t addr;
+    uint32_t size;
+} RomSpan;
+
+typedef struct
+{
+    uint8_t *data; // MEM_SIZE, the spans filled in at their addresses
+    RomSpan spans[ROM_MAX_SPANS];
+    int spanCount;
+    bool verified; // a complete set, every CRC checked matched
+} RomImage;
+
+// Returns NULL (and says why) if path doesn't hold a usable ROM
+RomImage *openROM(const MachineDesc *desc, const char *path);
+void freeROM(RomImage *rom);
+void applyROM(Machine *m, const RomImage *rom);
+
+// True when EMBED_ROM was given at build time
+bool embeddedROM(void);
+
+uint32_t crc32(const uint8_t *data, size_t length);
+
+#endif
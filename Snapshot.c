@@ -0,0 +1,123 @@
+#include <string.h>
+#include "Snapshot.h"
+
+Snapshot *initSnapshot(const Machine *m)
+{
+    size_t ramSize = 0;
+    for (int i = 0; i < m->desc->regionCount; i++)
+    {
+        const MemRegion *r = &(m->desc->regions[i]);
+        if (r->type == PAGE_RAM)
+            ramSize += (size_t)(r->end - r->start) + 1;
+    }
+
+    Snapshot *s = calloc(1, sizeof(Snapshot) + ramSize);
+    if (s == NULL)
+    {
+        printf("Snapshot allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    s->ramSize = ramSize;
+    return s;
+}
+
+void freeSnapshot(Snapshot *s)
+{
+    free(s);
+}
+
+void saveSnapshot(const Machine *m, Snapshot *s)
+{
+    const State *state = m->state8080;
+    s->pc = state->pc;
+    s->sp = state->sp;
+    s->psw = state->psw;
+    s->bc = state->bc;
+    s->de = state->de;
+    s->hl = state->hl;
+    s->int_en = state->int_en;
+    s->halted = state->halted;
+    s->codes = *(state->codes);
+
+    s->shifter = m->shifter;
+    memcpy(s->inputs, m->inputs, sizeof(s->inputs));
+    s->interruptNum = m->interruptNum;
+    s->watchdog = m->watchdog;
+
+    uint8_t *ram = s->ram;
+    for (int i = 0; i < m->desc->regionCount; i++)
+    {
+        const MemRegion *r = &(m->desc->regions[i]);
+        if (r->type != PAGE_RAM)
+            continue;
+
+        size_t size = (size_t)(r->end - r->start) + 1;
+        memcpy(ram, &(state->mem[r->start]), size);
+        ram += size;
+    }
+}
+
+void loadSnapshot(Machine *m, const Snapshot *s)
+{
+    State *state = m->state8080;
+    state->pc = s->pc;
+    state->sp = s->sp;
+    state->psw = s->psw;
+    state->bc = s->bc;
+    state->de = s->de;
+    state->hl = s->hl;
+    state->int_en = s->int_en;
+    state->halted = s->halted;
+    *(state->codes) = s->codes;
+
+    m->shifter = s->shifter;
+    memcpy(m->inputs, s->inputs, sizeof(m->inputs));
+    m->interruptNum = s->interruptNum;
+    m->watchdog = s->watchdog;
+
+    const uint8_t *ram = s->ram;
+    for (int i = 0; i < m->desc->regionCount; i++)
+    {
+        const MemRegion *r = &(m->desc->regions[i]);
+        if (r->type != PAGE_RAM)
+            continue;
+
+        size_t size = (size_t)(r->end - r->start) + 1;
+        memcpy(&(state->mem[r->start]), ram, size);
+        ram += size;
+    }
+}
+
+void runAheadFrame(Machine *m, Snapshot *s, int ahead)
+{
+    runFrame(m);
+    renderAhead(m, s, ahead);
+}
+
+void renderAhead(Machine *m, Snapshot *s, int ahead)
+{
+    if (ahead <= 0)
+    {
+        updateBuffer(m);
+        return;
+    }
+
+    // The frames ahead are thrown away, they must not trigger sounds or
+    // show up in the trace or the capture
+    saveSnapshot(m, s);
+    Sound *sound = m->sound;
+    Trace *trace = m->trace;
+    Capture *capture = m->capture;
+    m->sound = NULL;
+    m->trace = NULL;
+    m->capture = NULL;
+
+    for (int i = 0; i < ahead; i++)
+        runFrame(m);
+    updateBuffer(m);
+
+    loadSnapshot(m, s);
+    m->sound = sound;
+    m->trace = trace;
+    m->capture = capture;
+}
@@ -0,0 +1,44 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Machine.h"
+
+// Everything that changes while a frame runs: CPU registers, the board's
+// RAM regions and latches. ROM, the memory map and port tables never change
+// so they are not part of it, which keeps save/load to an 8KiB copy.
+typedef struct
+{
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t psw;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    bool int_en;
+    bool halted;
+    Codes codes;
+
+    Shifter shifter;
+    uint8_t inputs[MACHINE_INPUT_PORTS];
+    int interruptNum;
+    Watchdog watchdog;
+
+    size_t ramSize;
+    uint8_t ram[]; // the desc's PAGE_RAM regions, back to back
+} Snapshot;
+
+// Sized for m's board, can be used with any machine of the same board
+Snapshot *initSnapshot(const Machine *m);
+void freeSnapshot(Snapshot *s);
+void saveSnapshot(const Machine *m, Snapshot *s);
+void loadSnapshot(Machine *m, const Snapshot *s);
+
+// Run-ahead: emulate the next frame for real, then render the frame that is
+// ahead frames further on with the same inputs (silently) and roll back
+void runAheadFrame(Machine *m, Snapshot *s, int ahead);
+// Only the rendering half, for frames already run
+void renderAhead(Machine *m, Snapshot *s, int ahead);
+
+#endif
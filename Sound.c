@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Sound.h"
+#include "Wav.h"
+
+// Bit -> sample for each sound port, -1 for bits that aren't a sample
+static const int port3Sounds[8] = {SOUND_UFO, SOUND_SHOT, SOUND_PLAYER_DIE, SOUND_INVADER_DIE,
+                                   SOUND_EXTRA_LIFE, -1, -1, -1};
+static const int port5Sounds[8] = {SOUND_FLEET1, SOUND_FLEET2, SOUND_FLEET3, SOUND_FLEET4,
+                                   SOUND_UFO_HIT, -1, -1, -1};
+
+#define PORT3_AMP_ENABLE 0x20
+
+_Static_assert(SYNTH_VOICES == SOUND_COUNT, "one synth circuit per sound");
+
+static Sound *newSound(void)
+{
+    Sound *new = calloc(1, sizeof(Sound));
+    if (new == NULL)
+        exit(EXIT_FAILURE);
+
+    atomic_init(&(new->eventHead), 0);
+    atomic_init(&(new->eventTail), 0);
+    atomic_init(&(new->pcmHead), 0);
+    atomic_init(&(new->pcmTail), 0);
+    atomic_init(&(new->running), false);
+    new->latency = SOUND_DEFAULT_LATENCY;
+    return new;
+}
+
+Sound *initSound(const char *sampleDir)
+{
+    Sound *new = newSound();
+    for (int i = 0; i < SOUND_COUNT; i++)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%d.wav", sampleDir, i);
+        new->samples[i].data = wavLoad(path, SOUND_RATE, &(new->samples[i].length));
+        if (new->samples[i].data == NULL)
+            printf("Sample %s could not be loaded\n", path);
+    }
+    return new;
+}
+
+Sound *initSynthSound(void)
+{
+    Sound *new = newSound();
+    new->synth = initSynth(SOUND_RATE);
+    return new;
+}
+
+void freeSound(Sound *s)
+{
+    soundStop(s);
+    for (int i = 0; i < SOUND_COUNT; i++)
+        free(s->samples[i].data);
+    if (s->synth != NULL)
+        freeSynth(s->synth);
+    free(s);
+}
+
+static void pushEvent(Sound *s, uint8_t type, uint8_t id)
+{
+    unsigned head = atomic_load_explicit(&(s->eventHead), memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&(s->eventTail), memory_order_acquire);
+
+    // drop the trigger rather than ever block emulation
+    if (head - tail >= SOUND_EVENT_RING)
+        return;
+
+    s->events[head & (SOUND_EVENT_RING - 1)] = (SoundEvent){type, id};
+    atomic_store_explicit(&(s->eventHead), head + 1, memory_order_release);
+}
+
+void soundWritePort(Sound *s, uint8_t port, uint8_t value)
+{
+    const int *sounds;
+    uint8_t *last;
+
+    switch (port)
+    {
+        case 3: sounds = port3Sounds; last = &(s->port3); break;
+        case 5: sounds = port5Sounds; last = &(s->port5); break;
+        default: return;
+    }
+
+    uint8_t changed = value ^ *last;
+    uint8_t rising = changed & value;
+    *last = value;
+
+    if (port == 3 && (changed & PORT3_AMP_ENABLE))
+        pushEvent(s, (value & PORT3_AMP_ENABLE) ? EVENT_AMP_ON : EVENT_AMP_OFF, 0);
+
+    for (int bit = 0; bit < 8; bit++)
+    {
+        if (sounds[bit] < 0)
+            continue;
+
+        if (rising & (1 << bit))
+            pushEvent(s, EVENT_START, sounds[bit]);
+
+        // only the UFO loops, it plays for as long as its bit is held
+        else if ((changed & (1 << bit)) && sounds[bit] == SOUND_UFO)
+            pushEvent(s, EVENT_STOP, sounds[bit]);
+    }
+}
+
+static void applyEvents(Sound *s)
+{
+    unsigned tail = atomic_load_explicit(&(s->eventTail), memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&(s->eventHead), memory_order_acquire);
+
+    for (; tail != head; tail++)
+    {
+        SoundEvent e = s->events[tail & (SOUND_EVENT_RING - 1)];
+        switch (e.type)
+        {
+            case EVENT_START:
+            {
+                if (s->synth != NULL)
+                    synthTrigger(s->synth, e.id);
+                s->voices[e.id].active = true;
+                s->voices[e.id].loop = (e.id == SOUND_UFO);
+                s->voices[e.id].pos = 0;
+                break;
+            }
+
+            case EVENT_STOP:
+            {
+                if (s->synth != NULL)
+                    synthRelease(s->synth, e.id);
+                s->voices[e.id].active = false;
+                break;
+            }
+
+            case EVENT_AMP_ON: s->amp = true; break;
+            case EVENT_AMP_OFF: s->amp = false; break;
+        }
+    }
+
+    atomic_store_explicit(&(s->eventTail), tail, memory_order_release);
+}
+
+static void synthMix(Sound *s, int16_t *out, int n)
+{
+    float acc[SOUND_BLOCK];
+
+    for (int done = 0; done < n; done += SOUND_BLOCK)
+    {
+        int len = (n - done < SOUND_BLOCK) ? n - done : SOUND_BLOCK;
+        memset(acc, 0, sizeof(acc));
+        synthRender(s->synth, acc, len);
+
+        float gain = s->amp ? 32767.0f : 0.0f;
+        for (int i = 0; i < len; i++)
+        {
+            float x = acc[i] * gain;
+            out[done + i] = (int16_t)(x > 32767.0f ? 32767.0f : (x < -32768.0f ? -32768.0f : x));
+        }
+    }
+}
+
+void soundMix(Sound *s, int16_t *out, int n)
+{
+    int32_t acc[SOUND_BLOCK];
+
+    applyEvents(s);
+    if (s->synth != NULL)
+    {
+        synthMix(s, out, n);
+        return;
+    }
+
+    for (int done = 0; done < n; done += SOUND_BLOCK)
+    {
+        int len = (n - done < SOUND_BLOCK) ? n - done : SOUND_BLOCK;
+        memset(acc, 0, sizeof(acc));
+
+        for (int id = 0; id < SOUND_COUNT; id++)
+        {
+            Voice *v = &(s->voices[id]);
+            const Sample *sample = &(s->samples[id]);
+            if (!v->active || sample->data == NULL || sample->length == 0)
+                continue;
+
+            for (int i = 0; i < len; i++)
+            {
+                if (v->pos >= sample->length)
+                {
+                    if (!v->loop)
+                    {
+                        v->active = false;
+                        break;
+                    }
+                    v->pos = 0;
+                }
+                acc[i] += sample->data[v->pos++];
+            }
+        }
+
+        for (int i = 0; i < len; i++)
+        {
+            int32_t x = s->amp ? acc[i] : 0;
+            out[done + i] = (int16_t)(x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x));
+        }
+    }
+}
+
+// Keep at most latency samples queued so device output stays close to emulation
+static void *mixerThread(void *arg)
+{
+    Sound *s = arg;
+    int16_t block[SOUND_BLOCK];
+    const struct timespec nap = {0, 500000}; // 0.5 ms
+
+    while (atomic_load(&(s->running)))
+    {
+        unsigned head = atomic_load_explicit(&(s->pcmHead), memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&(s->pcmTail), memory_order_acquire);
+
+        if (head - tail + SOUND_BLOCK > (unsigned)s->latency)
+        {
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        soundMix(s, block, SOUND_BLOCK);
+        for (int i = 0; i < SOUND_BLOCK; i++)
+            s->pcm[(head + i) & (SOUND_PCM_RING - 1)] = block[i];
+        atomic_store_explicit(&(s->pcmHead), head + SOUND_BLOCK, memory_order_release);
+    }
+    return NULL;
+}
+
+void soundStart(Sound *s, int latency)
+{
+    if (atomic_load(&(s->running)))
+        return;
+
+    if (latency < SOUND_BLOCK)
+        latency = SOUND_BLOCK;
+    if (latency > SOUND_PCM_RING)
+        latency = SOUND_PCM_RING;
+    s->latency = latency;
+
+    atomic_store(&(s->running), true);
+    if (pthread_create(&(s->thread), NULL, mixerThread, s) != 0)
+    {
+        printf("Mixer thread could not be started\n");
+        atomic_store(&(s->running), false);
+    }
+}
+
+void soundStop(Sound *s)
+{
+    if (!atomic_load(&(s->running)))
+        return;
+
+    atomic_store(&(s->running), false);
+    pthread_join(s->thread, NULL);
+}
+
+// Audio callback side, pads with silence on underrun. Returns the number of
+// mixed samples that were available.
+int soundRead(Sound *s, int16_t *out, int n)
+{
+    unsigned tail = atomic_load_explicit(&(s->pcmTail), memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&(s->pcmHead), memory_order_acquire);
+    int avail = (int)(head - tail);
+    int count = avail < n ? avail : n;
+
+    for (int i = 0; i < count; i++)
+        out[i] = s->pcm[(tail + i) & (SOUND_PCM_RING - 1)];
+    memset(out + count, 0, sizeof(int16_t) * (n - count));
+
+    atomic_store_explicit(&(s->pcmTail), tail + count, memory_order_release);
+    return count;
+}
@@ -0,0 +1,104 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "Synth.h"
+
+#define SOUND_RATE 44100
+#define SOUND_FRAME_SAMPLES (SOUND_RATE / 60) // 735 samples per video frame
+
+#define SOUND_BLOCK 64          // mixer granularity in samples
+#define SOUND_EVENT_RING 256    // both rings must be powers of 2
+#define SOUND_PCM_RING 4096
+#define SOUND_DEFAULT_LATENCY 1024
+
+// Sample numbering follows the usual invaders sample set (0.wav - 9.wav)
+typedef enum
+{
+    SOUND_UFO,
+    SOUND_SHOT,
+    SOUND_PLAYER_DIE,
+    SOUND_INVADER_DIE,
+    SOUND_FLEET1,
+    SOUND_FLEET2,
+    SOUND_FLEET3,
+    SOUND_FLEET4,
+    SOUND_UFO_HIT,
+    SOUND_EXTRA_LIFE,
+    SOUND_COUNT
+} SoundId;
+
+typedef enum
+{
+    EVENT_START,
+    EVENT_STOP,
+    EVENT_AMP_ON,
+    EVENT_AMP_OFF,
+} SoundEventType;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t id;
+} SoundEvent;
+
+typedef struct
+{
+    int16_t *data;
+    uint32_t length;
+} Sample;
+
+typedef struct
+{
+    bool active;
+    bool loop;
+    uint32_t pos;
+} Voice;
+
+typedef struct
+{
+    Sample samples[SOUND_COUNT];
+
+    // emulation thread side: last port values for edge detection
+    uint8_t port3;
+    uint8_t port5;
+
+    // mixer side
+    Voice voices[SOUND_COUNT];
+    Synth *synth; // synthesised circuits instead of samples when set
+    bool amp;
+
+    // emulation -> mixer, single producer single consumer
+    SoundEvent events[SOUND_EVENT_RING];
+    atomic_uint eventHead;
+    atomic_uint eventTail;
+
+    // mixer -> audio device, single producer single consumer
+    int16_t pcm[SOUND_PCM_RING];
+    atomic_uint pcmHead;
+    atomic_uint pcmTail;
+
+    pthread_t thread;
+    atomic_bool running;
+    int latency; // samples the mixer keeps queued ahead of the device
+} Sound;
+
+Sound *initSound(const char *sampleDir);
+Sound *initSynthSound(void);
+void freeSound(Sound *s);
+
+// Emulation thread: decode an OUT to port 3 or 5 into sample triggers
+void soundWritePort(Sound *s, uint8_t port, uint8_t value);
+
+// Apply pending triggers and mix n samples (headless output, mixer thread)
+void soundMix(Sound *s, int16_t *out, int n);
+
+// Mixer thread feeding soundRead() from the audio callback
+void soundStart(Sound *s, int latency);
+void soundStop(Sound *s);
+int soundRead(Sound *s, int16_t *out, int n);
+
+#endif
@@ -1,155 +1,227 @@
+#include <string.h>
 #include "SpaceInvaders.h"
 
 
-static void out(SpaceInvaders *si, uint8_t port)
-{
-    switch (port)
-    {
-        // lowest 3 bits set the shift offset
-        case 2:
-        {
-            si->shiftOffset = (si->state8080->a) & 0x7;
-            break;
-        }
+/* Port handlers, registered in the board's port table */
 
-        // Set shift register value
-        case 4:
-        {
-            si->shiftLSB = si->shiftMSB;
-            si->shiftMSB = si->state8080->a;
-            break;
-        }
-    }
-    return;
+// Shifted result of the shift register
+static uint8_t readShift(void *ctx, uint8_t port)
+{
+    Shifter *shifter = &(((Machine *)ctx)->shifter);
+    (void)port;
+    uint16_t v = ((shifter->msb) << 8) | shifter->lsb;
+    return ((v >> (8-(shifter->offset))) & 0xFF);
 }
 
-static void in(SpaceInvaders *si, uint8_t port)
+// lowest 3 bits set the shift offset
+static void writeShiftOffset(void *ctx, uint8_t port, uint8_t value)
 {
-    uint8_t val = 0;
-    switch (port)
-    {
-        case 1:
-        {
-            val = si->port1;
-            break;
-        }
-
-        case 2:
-        {
-            val = si->port2;
-            break;
-        }
-
-        case 3:
-        {
-            uint16_t v = ((si->shiftMSB) << 8) | si->shiftLSB;
-            val = ((v >> (8-(si->shiftOffset))) & 0xFF);
-            break;
-        }
-    }
-
-    si->state8080->a = val;
-    return;
+    (void)port;
+    ((Machine *)ctx)->shifter.offset = value & 0x7;
 }
 
-// returns 1 if IN or OUT is called
-static int emulateINOUT(SpaceInvaders *si)
+// Set shift register value
+static void writeShiftData(void *ctx, uint8_t port, uint8_t value)
 {
-    unsigned char *code = &(si->state8080->mem[si->state8080->pc]);
-    int success = 0;
-
-    switch (code[0])
-    {
-        case 0xD3:
-        {
-            out(si, code[1]);
-            success = 1;
-            si->state8080->pc += 2;
-            break;
-        }
-
-        case 0xDB:
-        {
-            in(si, code[1]);
-            success = 1;
-            si->state8080->pc += 2;
-            break;
-        }
-    }
+    Shifter *shifter = &(((Machine *)ctx)->shifter);
+    (void)port;
+    shifter->lsb = shifter->msb;
+    shifter->msb = value;
+}
 
-    return success;
+// Sound triggers (ports 3 and 5)
+static void writeSound(void *ctx, uint8_t port, uint8_t value)
+{
+    Machine *m = ctx;
+    if (m->sound != NULL)
+        soundWritePort(m->sound, port, value);
 }
 
-SpaceInvaders *initSpaceInvaders()
+static void writeWatchdog(void *ctx, uint8_t port, uint8_t value)
 {
-    SpaceInvaders *new = malloc(sizeof(SpaceInvaders));
-    new->state8080 = init8080();
-    new->interruptNum = 1;
-    new->shiftLSB = 0;
-    new->shiftMSB = 0;
-    new->shiftOffset = 0;
-    new->port1 = 0;
-    new->port2 = 0;
-    return new;
+    (void)port;
+    (void)value;
+    watchdogKick(&(((Machine *)ctx)->watchdog));
 }
 
-void runFrame(SpaceInvaders *si)
+// 1bpp VRAM, stored with the screen rotated 90 degrees counter-clockwise.
+// Decoded one displayed row at a time so each row's overlay colours (and
+// the background) are applied as the bits are expanded.
+static void updateVideo(Machine *m)
 {
-    int cycles = 0;
-    int interruptCycles = CYCLES_PER_FRAME / 2;
+    int width = m->desc->screenWidth;
+    int height = m->desc->screenHeight;
+    int lineBytes = height / 8; // VRAM bytes per displayed column
+    const uint8_t *vram = &(m->state8080->mem[m->desc->vramAddr]);
+    uint32_t *screen = (uint32_t *)m->screenBuffer;
 
-    while (cycles < CYCLES_PER_FRAME)
+    for (int y = 0; y < height; y++)
     {
-        if (!emulateINOUT(si))
-            cycles += emulate8080(si->state8080);
-        
-        else //update cycles for INOUT success
-            cycles += 10;
-        
-        // Check if time for an interrupt
-        if (cycles >= interruptCycles)
+        int pos = height - 1 - y;
+        const uint8_t *column = &(vram[pos >> 3]);
+        int shift = pos & 7;
+        uint32_t *out = &(screen[y * width]);
+
+        if (m->background != NULL)
         {
-            interruptCycles *= 2;
-            GenerateInterrupt(si->state8080, si->interruptNum);
-            si->interruptNum = (si->interruptNum & 1) ? 2 : 1;
+            const uint32_t *unlit = &(m->background[y * width]);
+            const uint32_t *lit = &(m->backgroundLit[y * width]);
+            for (int x = 0; x < width; x++)
+                out[x] = ((column[x * lineBytes] >> shift) & 1) ? lit[x] : unlit[x];
+            continue;
+        }
+
+        int x = 0;
+        for (const OverlaySpan *span = m->overlay[y]; x < width; span++)
+        {
+            for (; x < span->end; x++)
+                out[x] = span->colour & (0u - ((column[x * lineBytes] >> shift) & 1));
         }
     }
 }
 
-void updateBuffer(SpaceInvaders *si)
+// Same rotation, to the 1bpp rows the capture stores
+static void packVideo(const Machine *m, uint8_t *bits)
 {
-    // Each byte holds 8 pixels of the screen
-    for (int i = 0; i < SCREEN_HEIGHT * SCREEN_WIDTH / 8; i++)
+    int width = m->desc->screenWidth;
+    int height = m->desc->screenHeight;
+    int lineBytes = height / 8;
+    int stride = (width + 7) / 8;
+    const uint8_t *vram = &(m->state8080->mem[m->desc->vramAddr]);
+
+    memset(bits, 0, (size_t)stride * height);
+    for (int y = 0; y < height; y++)
     {
-        int y = i * 8 / SCREEN_HEIGHT;
-        int x = (i * 8) % SCREEN_HEIGHT;
-        uint8_t curr_byte = si->state8080->mem[VRAM_ADDR + i];
+        int pos = height - 1 - y;
+        const uint8_t *column = &(vram[pos >> 3]);
+        int shift = pos & 7;
+        uint8_t *out = &(bits[y * stride]);
 
-        // Go through each pixel in current byte
-        for (int bit = 0; bit < 8; bit++)
-        {
-            uint8_t r = 0;
-            uint8_t g = 0;
-            uint8_t b = 0;
-            
-            int byte_x = x + bit;
-            int byte_y = y;
-
-            if (((curr_byte) >> bit) & 1)
-            {
-                r = 255;
-                g = 255;
-                b = 255;
-            }
-
-            int tmp = byte_x;
-            byte_x = byte_y;
-            byte_y = SCREEN_HEIGHT - (tmp + 1);
-
-            si->screenBuffer[byte_y][byte_x][0] = r;
-            si->screenBuffer[byte_y][byte_x][1] = g;
-            si->screenBuffer[byte_y][byte_x][2] = b;
-            si->screenBuffer[byte_y][byte_x][3] = (uint8_t)0;
-        }
+        for (int x = 0; x < width; x++)
+            out[x >> 3] |= (uint8_t)(((column[x * lineBytes] >> shift) & 1) << (7 - (x & 7)));
     }
 }
+
+/* Board descriptions */
+
+// A15 is not decoded and RAM is mirrored at 0x6000
+static const MemRegion invadersRegions[] = {
+    {ROM_ADDR, RAM_ADDR - 1, PAGE_ROM},
+    {RAM_ADDR, RAM_END, PAGE_RAM},
+};
+
+// Lunar Rescue has a second ROM bank at 0x4000
+static const MemRegion lrescueRegions[] = {
+    {ROM_ADDR, RAM_ADDR - 1, PAGE_ROM},
+    {RAM_ADDR, RAM_END, PAGE_RAM},
+    {EXTRA_ROM_ADDR, MIRROR_ADDR - 1, PAGE_ROM},
+};
+
+static const MemAlias midwayAliases[] = {
+    {MIRROR_ADDR, 0x7FFF, RAM_ADDR},
+    {0x8000, 0xFFFF, 0x0000},
+};
+
+static const PortHandler invadersPorts[] = {
+    {1, machineReadInputs, NULL},
+    {2, machineReadInputs, writeShiftOffset},
+    {3, readShift, writeSound},
+    {4, NULL, writeShiftData},
+    {5, NULL, writeSound},
+    {6, NULL, writeWatchdog},
+};
+
+// Same wiring without the invaders sound board
+static const PortHandler lrescuePorts[] = {
+    {1, machineReadInputs, NULL},
+    {2, machineReadInputs, writeShiftOffset},
+    {3, readShift, NULL},
+    {4, NULL, writeShiftData},
+    {6, NULL, writeWatchdog},
+};
+
+#define MIDWAY_INPUTS \
+    { \
+        [INPUT_COIN] = {1, 0x01}, \
+        [INPUT_START2] = {1, 0x02}, \
+        [INPUT_START1] = {1, 0x04}, \
+        [INPUT_FIRE] = {1, 0x10}, \
+        [INPUT_LEFT] = {1, 0x20}, \
+        [INPUT_RIGHT] = {1, 0x40}, \
+        [INPUT_TILT] = {2, 0x04}, \
+        [INPUT_P2_FIRE] = {2, 0x10}, \
+        [INPUT_P2_LEFT] = {2, 0x20}, \
+        [INPUT_P2_RIGHT] = {2, 0x40}, \
+    }
+
+// Four 2KiB chips, as in MAME's invaders set
+static const RomFile invadersRoms[] = {
+    {"invaders.h", 0x0000, 0x0800, 0x734F5AD8},
+    {"invaders.g", 0x0800, 0x0800, 0x6BFACA4A},
+    {"invaders.f", 0x1000, 0x0800, 0x0CCEAD96},
+    {"invaders.e", 0x1800, 0x0800, 0x14E538B0},
+};
+
+// The second bank sits at 0x4000, no CRCs on record here
+static const RomFile lrescueRoms[] = {
+    {"lrescue.1", 0x0000, 0x0800, 0},
+    {"lrescue.2", 0x0800, 0x0800, 0},
+    {"lrescue.3", 0x1000, 0x0800, 0},
+    {"lrescue.4", 0x1800, 0x0800, 0},
+    {"lrescue.5", 0x4000, 0x0800, 0},
+    {"lrescue.6", 0x4800, 0x0800, 0},
+};
+
+// Red strip over the saucer, green over the shields, the base and the
+// reserve ships to the left of the credits
+static const OverlayBand invadersOverlay[] = {
+    {32, 63, 0, SCREEN_WIDTH - 1, 255, 32, 32},
+    {184, 239, 0, SCREEN_WIDTH - 1, 32, 255, 32},
+    {240, 255, 24, 135, 32, 255, 32},
+};
+
+const MachineDesc spaceInvadersDesc = {
+    .name = "invaders",
+    .screenWidth = SCREEN_WIDTH,
+    .screenHeight = SCREEN_HEIGHT,
+    .vramAddr = VRAM_ADDR,
+    .cyclesPerFrame = CYCLES_PER_FRAME,
+    .interrupts = {1, 2},
+    .watchdogFrames = WATCHDOG_FRAMES,
+    .regions = invadersRegions,
+    .regionCount = sizeof(invadersRegions) / sizeof(invadersRegions[0]),
+    .aliases = midwayAliases,
+    .aliasCount = sizeof(midwayAliases) / sizeof(midwayAliases[0]),
+    .ports = invadersPorts,
+    .portCount = sizeof(invadersPorts) / sizeof(invadersPorts[0]),
+    .inputMap = MIDWAY_INPUTS,
+    .inputDefaults = {0, 0, 0, 0},
+    .romFiles = invadersRoms,
+    .romCount = sizeof(invadersRoms) / sizeof(invadersRoms[0]),
+    .overlay = invadersOverlay,
+    .overlayCount = sizeof(invadersOverlay) / sizeof(invadersOverlay[0]),
+    .video = updateVideo,
+    .packVideo = packVideo,
+};
+
+const MachineDesc lunarRescueDesc = {
+    .name = "lrescue",
+    .screenWidth = SCREEN_WIDTH,
+    .screenHeight = SCREEN_HEIGHT,
+    .vramAddr = VRAM_ADDR,
+    .cyclesPerFrame = CYCLES_PER_FRAME,
+    .interrupts = {1, 2},
+    .watchdogFrames = WATCHDOG_FRAMES,
+    .regions = lrescueRegions,
+    .regionCount = sizeof(lrescueRegions) / sizeof(lrescueRegions[0]),
+    .aliases = midwayAliases,
+    .aliasCount = sizeof(midwayAliases) / sizeof(midwayAliases[0]),
+    .ports = lrescuePorts,
+    .portCount = sizeof(lrescuePorts) / sizeof(lrescuePorts[0]),
+    .inputMap = MIDWAY_INPUTS,
+    .inputDefaults = {0, 0, 0, 0},
+    .romFiles = lrescueRoms,
+    .romCount = sizeof(lrescueRoms) / sizeof(lrescueRoms[0]),
+    .video = updateVideo,
+    .packVideo = packVideo,
+};
@@ -1,35 +1,31 @@
+#ifndef SPACE_INVADERS_H
+#define SPACE_INVADERS_H
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <SDL2/SDL.h>
-#include "8080.h"
+#include "Machine.h"
+
+/* Midway/Taito 8080 B&W board (Space Invaders and its derivatives) */
 
 #define SCREEN_WIDTH 224
 #define SCREEN_HEIGHT 256
 
 #define CYCLES_PER_FRAME (int)2e6 / 60 // 2Mhz at 60 fps
 
+#define ROM_ADDR 0x0000
+#define RAM_ADDR 0x2000
 #define VRAM_ADDR 0x2400
+#define RAM_END 0x3FFF
+#define EXTRA_ROM_ADDR 0x4000 // lrescue's second ROM bank
+#define MIRROR_ADDR 0x6000    // of RAM, A15 not decoded
 
-typedef struct
-{
-    State *state8080;
-    uint8_t shiftLSB;
-    uint8_t shiftMSB;
-    uint8_t shiftOffset;
-    
-    uint8_t port1;
-    uint8_t port2;
-
-    int interruptNum;
-
-    uint8_t screenBuffer[SCREEN_HEIGHT][SCREEN_WIDTH][4]; // RGBA format
+#define WATCHDOG_FRAMES 255 // vblanks without a port 6 write before reset
 
-} SpaceInvaders;
+extern const MachineDesc spaceInvadersDesc;
+extern const MachineDesc lunarRescueDesc;
 
-SpaceInvaders *initSpaceInvaders();
-void runFrame(SpaceInvaders *si);
-void updateBuffer(SpaceInvaders *si);
\ No newline at end of file
+#endif
@@ -0,0 +1,446 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "Stream.h"
+#include "Capture.h"
+#include "Bytes.h"
+
+#define LISTENER STREAM_MAX_CLIENTS // epoll tag of the listening socket
+
+static const char magic[8] = "8080STR";
+
+uint32_t streamHash(const uint8_t *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static bool getVarint(const uint8_t *src, size_t length, size_t *at, size_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35 && *at < length; shift += 7)
+    {
+        uint8_t c = src[(*at)++];
+        *value |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Frame header and payload into dst, the payload encoded as in the capture
+// delta stream (previous NULL for a key frame)
+static size_t encodeMessage(const uint8_t *vram, const uint8_t *previous, size_t size, uint32_t frame,
+                            uint32_t hash, uint8_t *dst)
+{
+    size_t out = STREAM_FRAME_HEADER + encodeDelta(vram, previous, size, &(dst[STREAM_FRAME_HEADER]));
+
+    dst[0] = previous != NULL ? 'D' : 'K';
+    put32(&(dst[1]), frame);
+    put32(&(dst[5]), hash);
+    put32(&(dst[9]), (uint32_t)(out - STREAM_FRAME_HEADER));
+    return out;
+}
+
+/* Server thread */
+
+static void dropClient(Stream *s, StreamClient *c)
+{
+    epoll_ctl(s->epoll, EPOLL_CTL_DEL, c->sock, NULL);
+    close(c->sock);
+    c->sock = -1;
+}
+
+static void watchWritable(Stream *s, StreamClient *c, bool writable)
+{
+    if (c->writable == writable)
+        return;
+    struct epoll_event event = {.events = EPOLLIN | (writable ? EPOLLOUT : 0), .data.u32 = (uint32_t)(c - s->clients)};
+    epoll_ctl(s->epoll, EPOLL_CTL_MOD, c->sock, &event);
+    c->writable = writable;
+}
+
+// Send as much of the client's queue as the socket takes
+static void flushClient(Stream *s, StreamClient *c)
+{
+    while (c->sent < c->length)
+    {
+        ssize_t n = send(c->sock, &(c->buffer[c->sent]), c->length - c->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            c->sent += (size_t)n;
+            atomic_fetch_add_explicit(&(s->bytesSent), (uint64_t)n, memory_order_relaxed);
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else if (!(n < 0 && errno == EINTR))
+        {
+            dropClient(s, c);
+            return;
+        }
+    }
+
+    if (c->sent == c->length)
+        c->length = c->sent = 0;
+    watchWritable(s, c, c->sent < c->length);
+}
+
+static bool append(StreamClient *c, const uint8_t *data, size_t length)
+{
+    if (c->length + length > STREAM_CLIENT_BUFFER && c->sent > 0)
+    {
+        memmove(c->buffer, &(c->buffer[c->sent]), c->length - c->sent);
+        c->length -= c->sent;
+        c->sent = 0;
+    }
+    if (c->length + length > STREAM_CLIENT_BUFFER)
+        return false;
+    memcpy(&(c->buffer[c->length]), data, length);
+    c->length += length;
+    return true;
+}
+
+static void acceptClients(Stream *s)
+{
+    for (;;)
+    {
+        int sock = accept(s->listener, NULL, NULL);
+        if (sock < 0)
+            return;
+
+        StreamClient *c = NULL;
+        for (int i = 0; i < STREAM_MAX_CLIENTS && c == NULL; i++)
+        {
+            if (s->clients[i].sock < 0)
+                c = &(s->clients[i]);
+        }
+        int one = 1;
+        struct epoll_event event = {.events = EPOLLIN};
+        if (c == NULL || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0
+            || setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0
+            || (event.data.u32 = (uint32_t)(c - s->clients), epoll_ctl(s->epoll, EPOLL_CTL_ADD, sock, &event)) != 0)
+        {
+            close(sock);
+            continue;
+        }
+
+        uint8_t header[STREAM_HEADER_SIZE];
+        memcpy(header, magic, sizeof(magic));
+        put16(&(header[8]), s->width);
+        put16(&(header[10]), s->height);
+        put32(&(header[12]), (uint32_t)s->vramSize);
+
+        c->sock = sock;
+        c->length = c->sent = 0;
+        c->writable = false;
+        c->lagging = false;
+        c->needsKey = true;
+        append(c, header, sizeof(header));
+        flushClient(s, c);
+    }
+}
+
+// Spectators don't send anything, reads only notice them leaving
+static void readClient(Stream *s, StreamClient *c)
+{
+    uint8_t discard[256];
+    for (;;)
+    {
+        ssize_t n = recv(c->sock, discard, sizeof(discard), MSG_DONTWAIT);
+        if (n > 0 || (n < 0 && errno == EINTR))
+            continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            dropClient(s, c);
+        return;
+    }
+}
+
+static void sendFrame(Stream *s, const uint8_t *vram)
+{
+    uint32_t frame = s->frame++;
+    uint32_t hash = streamHash(vram, s->vramSize);
+    size_t deltaLength = encodeMessage(vram, s->previous, s->vramSize, frame, hash, s->delta);
+    size_t keyLength = 0; // encoded when a client first needs it
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        StreamClient *c = &(s->clients[i]);
+        if (c->sock < 0)
+            continue;
+
+        // A lagging client resumes with a key frame once it has caught up
+        if (c->lagging && c->sent < c->length)
+            continue;
+        if (c->lagging)
+        {
+            c->lagging = false;
+            c->needsKey = true;
+        }
+
+        if (c->needsKey && keyLength == 0)
+            keyLength = encodeMessage(vram, NULL, s->vramSize, frame, hash, s->key);
+        if (!append(c, c->needsKey ? s->key : s->delta, c->needsKey ? keyLength : deltaLength))
+        {
+            c->lagging = true;
+            continue;
+        }
+        c->needsKey = false;
+        atomic_fetch_add_explicit(&(s->framesSent), 1, memory_order_relaxed);
+        flushClient(s, c);
+    }
+    memcpy(s->previous, vram, s->vramSize);
+}
+
+static void *serverThread(void *arg)
+{
+    Stream *s = arg;
+    struct epoll_event events[STREAM_MAX_CLIENTS + 1];
+
+    for (;;)
+    {
+        // The 1 ms timeout doubles as the nap between polls of the queue
+        int n = epoll_wait(s->epoll, events, STREAM_MAX_CLIENTS + 1, 1);
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t tag = events[i].data.u32;
+            if (tag == LISTENER)
+            {
+                acceptClients(s);
+                continue;
+            }
+
+            StreamClient *c = &(s->clients[tag]);
+            if (c->sock >= 0 && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                readClient(s, c);
+            if (c->sock >= 0 && (events[i].events & EPOLLOUT))
+                flushClient(s, c);
+        }
+
+        unsigned tail = atomic_load_explicit(&(s->tail), memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&(s->head), memory_order_acquire);
+        for (; tail != head; tail++)
+        {
+            sendFrame(s, &(s->queue[(tail & (STREAM_QUEUE - 1)) * s->vramSize]));
+            atomic_store_explicit(&(s->tail), tail + 1, memory_order_release);
+        }
+        if (!atomic_load(&(s->running)))
+            break;
+    }
+    return NULL;
+}
+
+/* Emulation side */
+
+Stream *initStream(int port, int width, int height, size_t vramSize)
+{
+    int one = 1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 8) != 0
+        || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        if (sock >= 0)
+            close(sock);
+        return NULL;
+    }
+
+    Stream *s = calloc(1, sizeof(Stream));
+    if (s == NULL)
+        exit(EXIT_FAILURE);
+
+    s->listener = sock;
+    s->epoll = epoll_create1(0);
+    s->width = (uint16_t)width;
+    s->height = (uint16_t)height;
+    s->vramSize = vramSize;
+    s->queue = malloc(STREAM_QUEUE * vramSize);
+    s->previous = calloc(1, vramSize);
+    s->delta = malloc(STREAM_FRAME_HEADER + 2 * vramSize + 16);
+    s->key = malloc(STREAM_FRAME_HEADER + 2 * vramSize + 16);
+    if (s->epoll < 0 || s->queue == NULL || s->previous == NULL || s->delta == NULL || s->key == NULL)
+    {
+        printf("Stream allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        s->clients[i].sock = -1;
+        s->clients[i].buffer = malloc(STREAM_CLIENT_BUFFER);
+        if (s->clients[i].buffer == NULL)
+        {
+            printf("Stream allocation failure\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = LISTENER};
+    if (epoll_ctl(s->epoll, EPOLL_CTL_ADD, sock, &event) != 0)
+    {
+        printf("Stream epoll failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_store(&(s->running), true);
+    if (pthread_create(&(s->thread), NULL, serverThread, s) != 0)
+    {
+        printf("Stream server thread could not be started\n");
+        exit(EXIT_FAILURE);
+    }
+    return s;
+}
+
+void freeStream(Stream *s)
+{
+    atomic_store(&(s->running), false);
+    pthread_join(s->thread, NULL);
+
+    // Let the kernel deliver what is already in its buffers
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (s->clients[i].sock >= 0)
+        {
+            shutdown(s->clients[i].sock, SHUT_WR);
+            close(s->clients[i].sock);
+        }
+        free(s->clients[i].buffer);
+    }
+    close(s->listener);
+    close(s->epoll);
+    free(s->queue);
+    free(s->previous);
+    free(s->delta);
+    free(s->key);
+    free(s);
+}
+
+void streamFrame(Stream *s, const uint8_t *vram)
+{
+    unsigned head = atomic_load_explicit(&(s->head), memory_order_relaxed);
+    if (head - atomic_load_explicit(&(s->tail), memory_order_acquire) >= STREAM_QUEUE)
+    {
+        // Spectators see a repeated frame rather than the game slowing down
+        atomic_fetch_add_explicit(&(s->dropped), 1, memory_order_relaxed);
+        return;
+    }
+
+    memcpy(&(s->queue[(head & (STREAM_QUEUE - 1)) * s->vramSize]), vram, s->vramSize);
+    atomic_store_explicit(&(s->head), head + 1, memory_order_release);
+}
+
+/* Reading */
+
+static bool receiveAll(StreamReader *r, uint8_t *dst, size_t length)
+{
+    for (size_t at = 0; at < length;)
+    {
+        ssize_t n = recv(r->sock, &(dst[at]), length - at, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        at += (size_t)n;
+        r->bytes += (uint64_t)n;
+    }
+    return true;
+}
+
+StreamReader *openStream(const char *host, int port)
+{
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *found = NULL;
+    if (getaddrinfo(host, service, &hints, &found) != 0)
+        return NULL;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    bool connected = sock >= 0 && connect(sock, found->ai_addr, found->ai_addrlen) == 0;
+    freeaddrinfo(found);
+    if (!connected)
+    {
+        if (sock >= 0)
+            close(sock);
+        return NULL;
+    }
+
+    StreamReader *r = calloc(1, sizeof(StreamReader));
+    if (r == NULL)
+        exit(EXIT_FAILURE);
+    r->sock = sock;
+
+    uint8_t header[STREAM_HEADER_SIZE];
+    if (!receiveAll(r, header, sizeof(header)) || memcmp(header, magic, sizeof(magic)))
+    {
+        close(sock);
+        free(r);
+        return NULL;
+    }
+    r->width = get16(&(header[8]));
+    r->height = get16(&(header[10]));
+    r->vramSize = get32(&(header[12]));
+    r->vram = calloc(1, r->vramSize);
+    r->payload = malloc(2 * r->vramSize + 16);
+    if (r->vram == NULL || r->payload == NULL)
+    {
+        printf("Stream allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+    return r;
+}
+
+void closeStream(StreamReader *r)
+{
+    close(r->sock);
+    free(r->vram);
+    free(r->payload);
+    free(r);
+}
+
+bool streamNext(StreamReader *r)
+{
+    uint8_t header[STREAM_FRAME_HEADER];
+    if (!receiveAll(r, header, sizeof(header)) || (header[0] != 'K' && header[0] != 'D'))
+        return false;
+    size_t length = get32(&(header[9]));
+    if (length > 2 * r->vramSize + 16 || !receiveAll(r, r->payload, length))
+        return false;
+
+    r->key = header[0] == 'K';
+    r->frame = get32(&(header[1]));
+    if (r->key)
+        memset(r->vram, 0, r->vramSize);
+
+    size_t in = 0;
+    size_t at = 0;
+    while (at < r->vramSize)
+    {
+        size_t same;
+        size_t literals;
+        if (!getVarint(r->payload, length, &in, &same) || !getVarint(r->payload, length, &in, &literals)
+            || same + literals > r->vramSize - at || literals > length - in)
+            return false;
+
+        at += same;
+        for (size_t end = at + literals; at < end; at++)
+            r->vram[at] ^= r->payload[in++];
+    }
+
+    r->hashOk = streamHash(r->vram, r->vramSize) == get32(&(header[5]));
+    return true;
+}
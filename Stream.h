@@ -0,0 +1,96 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Frames streamed to spectators over TCP by a server thread running an
+// epoll loop. The emulation thread only copies VRAM into a queue, and drops
+// the frame if the queue is full. Each client has its own send queue; one
+// that falls STREAM_CLIENT_BUFFER behind skips frames until it has caught
+// up and then gets a key frame.
+//   "8080STR" '\0', u16 width, u16 height, u32 VRAM bytes
+//   per frame: u8 'K' (key, XORed with zeros) or 'D' (delta, XORed with the
+//   frame before), u32 frame number, u32 FNV-1a hash of the decoded VRAM,
+//   u32 payload bytes, then the payload: pairs of LEB128 counts (unchanged
+//   bytes, literal bytes) followed by the XORed literals
+// Everything is little endian.
+#define STREAM_QUEUE 8 // frames between emulation and server, power of 2
+#define STREAM_MAX_CLIENTS 16
+#define STREAM_CLIENT_BUFFER (256 * 1024)
+#define STREAM_HEADER_SIZE 16
+#define STREAM_FRAME_HEADER 13
+
+typedef struct
+{
+    int sock; // -1 when the slot is free
+    uint8_t *buffer;
+    size_t length;
+    size_t sent;
+    bool writable; // EPOLLOUT is armed
+    bool lagging;  // skipping frames until the buffer drains
+    bool needsKey;
+} StreamClient;
+
+typedef struct
+{
+    int listener;
+    int epoll;
+    size_t vramSize;
+    uint16_t width;
+    uint16_t height;
+
+    // Emulation copies into slot head of the queue, the server drains
+    // from tail
+    uint8_t *queue;
+    atomic_uint head;
+    atomic_uint tail;
+    uint32_t frame;
+    atomic_uint_fast64_t dropped; // frames the queue had no room for
+
+    // Server thread
+    uint8_t *previous;
+    uint8_t *delta; // encoded messages of the current frame
+    uint8_t *key;
+    StreamClient clients[STREAM_MAX_CLIENTS];
+    atomic_uint_fast64_t bytesSent;
+    atomic_uint_fast64_t framesSent; // messages queued, over all clients
+    pthread_t thread;
+    atomic_bool running;
+} Stream;
+
+// Listens on port on every interface, NULL if it can't
+Stream *initStream(int port, int width, int height, size_t vramSize);
+// Sends what is queued (without waiting on slow clients) and disconnects
+void freeStream(Stream *s);
+
+// Queue the next frame's VRAM, never waits
+void streamFrame(Stream *s, const uint8_t *vram);
+
+typedef struct
+{
+    int sock;
+    int width;
+    int height;
+    size_t vramSize;
+    uint8_t *vram; // decoded frame
+    uint8_t *payload;
+    uint32_t frame;
+    bool key;
+    bool hashOk; // the decoded VRAM matches the hash the server sent
+    uint64_t bytes; // received so far
+} StreamReader;
+
+// Returns NULL if it can't connect or the other end isn't a stream
+StreamReader *openStream(const char *host, int port);
+void closeStream(StreamReader *r);
+// Decodes the next frame into r->vram, false when the stream ends
+bool streamNext(StreamReader *r);
+
+uint32_t streamHash(const uint8_t *data, size_t length);
+
+#endif
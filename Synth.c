@@ -0,0 +1,222 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Synth.h"
+
+// The inner loops below are written without per-sample branches or
+// loop-carried state so the compiler vectorises them: envelopes come from a
+// precomputed r^i table, oscillator phase is closed form within a block and
+// filtered noise is read from shared pre-filtered tables.
+
+#define NOISE_LEN 16384
+
+typedef enum
+{
+    SRC_TRIANGLE,
+    SRC_SQUARE,
+    SRC_NOISE_WHITE,
+    SRC_NOISE_MID,
+    SRC_NOISE_LOW,
+} Source;
+
+typedef struct
+{
+    Source source;
+    float freq;    // oscillator centre frequency (Hz)
+    float sweep;   // frequency deviation of the modulation (Hz)
+    float lfoRate; // modulation rate (Hz)
+    float gain;
+    float decay;   // seconds to fall 60dB, 0 sustains
+    float length;  // seconds until the voice stops, 0 plays while held
+} Circuit;
+
+// Indexed by SoundId
+static const Circuit circuits[SYNTH_VOICES] = {
+    {SRC_TRIANGLE,    700.0f, 300.0f,  6.0f, 0.25f, 0.0f,  0.0f},  // UFO siren
+    {SRC_NOISE_WHITE,   0.0f,   0.0f,  0.0f, 0.35f, 0.35f, 0.5f},  // shot
+    {SRC_NOISE_LOW,     0.0f,   0.0f,  0.0f, 0.60f, 1.5f,  2.0f},  // player explosion
+    {SRC_NOISE_MID,     0.0f,   0.0f,  0.0f, 0.45f, 0.3f,  0.4f},  // invader explosion
+    {SRC_SQUARE,       98.0f,   0.0f,  0.0f, 0.30f, 0.12f, 0.15f}, // fleet step 1
+    {SRC_SQUARE,       87.0f,   0.0f,  0.0f, 0.30f, 0.12f, 0.15f}, // fleet step 2
+    {SRC_SQUARE,       78.0f,   0.0f,  0.0f, 0.30f, 0.12f, 0.15f}, // fleet step 3
+    {SRC_SQUARE,       69.0f,   0.0f,  0.0f, 0.30f, 0.12f, 0.15f}, // fleet step 4
+    {SRC_SQUARE,      500.0f, 250.0f, 12.0f, 0.25f, 1.0f,  1.2f},  // UFO hit
+    {SRC_TRIANGLE,   1200.0f, 400.0f, 10.0f, 0.20f, 1.0f,  1.0f},  // extra life
+};
+
+// Shared by every instance, padded so a block never wraps inside a loop
+static float noiseTables[3][NOISE_LEN + SYNTH_BLOCK];
+static float ramp[SYNTH_BLOCK];  // i
+static float ramp2[SYNTH_BLOCK]; // i * i
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static void normalise(float *table)
+{
+    float peak = 0.0f;
+    for (int i = 0; i < NOISE_LEN; i++)
+        peak = fmaxf(peak, fabsf(table[i]));
+    for (int i = 0; i < NOISE_LEN; i++)
+        table[i] /= peak;
+}
+
+static void initTables(void)
+{
+    // 17-bit LFSR like the noise generator on the sound board
+    uint32_t lfsr = 1;
+    float mid = 0.0f, low1 = 0.0f, low2 = 0.0f;
+    for (int i = 0; i < NOISE_LEN; i++)
+    {
+        uint32_t bit = ((lfsr >> 0) ^ (lfsr >> 3)) & 1;
+        lfsr = (lfsr >> 1) | (bit << 16);
+        float white = (lfsr & 1) ? 1.0f : -1.0f;
+
+        mid += 0.25f * (white - mid);
+        low1 += 0.04f * (white - low1);
+        low2 += 0.04f * (low1 - low2);
+
+        noiseTables[0][i] = white;
+        noiseTables[1][i] = mid;
+        noiseTables[2][i] = low2;
+    }
+
+    for (int t = 0; t < 3; t++)
+    {
+        if (t > 0)
+            normalise(noiseTables[t]);
+        memcpy(&(noiseTables[t][NOISE_LEN]), noiseTables[t], sizeof(float) * SYNTH_BLOCK);
+    }
+
+    for (int i = 0; i < SYNTH_BLOCK; i++)
+    {
+        ramp[i] = (float)i;
+        ramp2[i] = (float)(i * i);
+    }
+}
+
+Synth *initSynth(int rate)
+{
+    pthread_once(&tablesOnce, initTables);
+
+    Synth *new = calloc(1, sizeof(Synth));
+    if (new == NULL)
+        exit(EXIT_FAILURE);
+    new->rate = rate;
+
+    for (int id = 0; id < SYNTH_VOICES; id++)
+    {
+        const Circuit *c = &(circuits[id]);
+        double r = (c->decay > 0.0f) ? pow(0.001, 1.0 / (c->decay * rate)) : 1.0;
+        for (int i = 0; i <= SYNTH_BLOCK; i++)
+            new->decay[id][i] = (float)pow(r, i);
+        new->length[id] = (uint32_t)(c->length * rate);
+    }
+    return new;
+}
+
+void freeSynth(Synth *s)
+{
+    free(s);
+}
+
+void synthTrigger(Synth *s, int id)
+{
+    SynthVoice *v = &(s->voices[id]);
+    v->active = true;
+    v->held = true;
+    v->env = 1.0f;
+    v->age = 0;
+}
+
+void synthRelease(Synth *s, int id)
+{
+    s->voices[id].held = false;
+}
+
+// Triangle LFO in [-1, 1]
+static float lfo(float phase)
+{
+    return 1.0f - 4.0f * fabsf(phase - 0.5f);
+}
+
+static void renderNoise(const float *restrict noise, const float *restrict decay, float gain,
+                        float *restrict out, int len)
+{
+    for (int i = 0; i < len; i++)
+        out[i] += gain * decay[i] * noise[i];
+}
+
+// Phase at sample i is ph0 + inc * i + dinc * i^2 (frequency ramps linearly
+// across the block)
+static void renderTriangle(float ph0, float inc, float dinc, const float *restrict decay, float gain,
+                           float *restrict out, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        float ph = ph0 + inc * ramp[i] + dinc * ramp2[i];
+        float frac = ph - (float)(int)ph;
+        out[i] += gain * decay[i] * (1.0f - 4.0f * fabsf(frac - 0.5f));
+    }
+}
+
+static void renderSquare(float ph0, float inc, float dinc, const float *restrict decay, float gain,
+                         float *restrict out, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        float ph = ph0 + inc * ramp[i] + dinc * ramp2[i];
+        float frac = ph - (float)(int)ph;
+        out[i] += gain * decay[i] * (frac < 0.5f ? 1.0f : -1.0f);
+    }
+}
+
+static void renderVoice(Synth *s, int id, float *out, int len)
+{
+    const Circuit *c = &(circuits[id]);
+    SynthVoice *v = &(s->voices[id]);
+    const float *decay = s->decay[id];
+    float gain = c->gain * v->env;
+
+    if (c->source >= SRC_NOISE_WHITE)
+    {
+        renderNoise(&(noiseTables[c->source - SRC_NOISE_WHITE][v->noise]), decay, gain, out, len);
+        v->noise = (v->noise + len) % NOISE_LEN;
+    }
+    else
+    {
+        float lfoStep = c->lfoRate * len / s->rate;
+        float f0 = c->freq + c->sweep * lfo(v->lfoPhase);
+        v->lfoPhase += lfoStep;
+        v->lfoPhase -= (float)(int)v->lfoPhase;
+        float f1 = c->freq + c->sweep * lfo(v->lfoPhase);
+
+        float inc = f0 / s->rate;
+        float dinc = (f1 - f0) / s->rate / (2.0f * len);
+        if (c->source == SRC_SQUARE)
+            renderSquare(v->phase, inc, dinc, decay, gain, out, len);
+        else
+            renderTriangle(v->phase, inc, dinc, decay, gain, out, len);
+
+        v->phase += inc * len + dinc * len * len;
+        v->phase -= (float)(int)v->phase;
+    }
+
+    v->env *= decay[len];
+    v->age += len;
+    if (s->length[id] ? v->age >= s->length[id] : !v->held)
+        v->active = false;
+}
+
+void synthRender(Synth *s, float *out, int n)
+{
+    for (int done = 0; done < n; done += SYNTH_BLOCK)
+    {
+        int len = (n - done < SYNTH_BLOCK) ? n - done : SYNTH_BLOCK;
+        for (int id = 0; id < SYNTH_VOICES; id++)
+        {
+            if (s->voices[id].active)
+                renderVoice(s, id, out + done, len);
+        }
+    }
+}
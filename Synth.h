@@ -0,0 +1,39 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SYNTH_BLOCK 64 // samples processed per inner loop, keep a multiple of the vector width
+#define SYNTH_VOICES 10 // one circuit per SoundId
+
+// One discrete sound circuit of the cabinet, approximated by an oscillator or
+// a filtered noise source through an envelope
+typedef struct
+{
+    bool active;
+    bool held;      // the UFO plays for as long as its bit is set
+    float env;      // current envelope level
+    float phase;    // oscillator phase in cycles [0, 1)
+    float lfoPhase; // modulation phase in cycles [0, 1)
+    uint32_t noise; // offset into the shared noise table
+    uint32_t age;   // samples since trigger
+} SynthVoice;
+
+typedef struct
+{
+    int rate;
+    SynthVoice voices[SYNTH_VOICES]; // indexed by SoundId
+    float decay[SYNTH_VOICES][SYNTH_BLOCK + 1]; // per circuit envelope decay r^i
+    uint32_t length[SYNTH_VOICES];             // voice length in samples, 0 = held
+} Synth;
+
+Synth *initSynth(int rate);
+void freeSynth(Synth *s);
+void synthTrigger(Synth *s, int id);
+void synthRelease(Synth *s, int id);
+
+// Mix n samples of every active circuit into out (accumulating)
+void synthRender(Synth *s, float *out, int n);
+
+#endif
@@ -0,0 +1,380 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+#include "Trace.h"
+#include "Bytes.h"
+
+static const char magic[8] = "8080TRC";
+
+#define PACKED_BYTES (TRACE_BLOCK_BYTES + TRACE_BLOCK_BYTES / 128 + 64)
+
+/* LZ4-style block compression: sequences of
+ *   token (literal count << 4 | match length - 4), longer counts continue in
+ *   extra bytes of up to 255, literals, u16 match offset
+ * The last sequence has literals only, the decoder knows the raw size. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static size_t putLength(uint8_t *dst, size_t out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        dst[out++] = 255;
+    dst[out++] = (uint8_t)length;
+    return out;
+}
+
+static size_t putSequence(uint8_t *dst, size_t out, const uint8_t *literals, size_t literalCount,
+                          size_t offset, size_t matchLength)
+{
+    size_t extraMatch = matchLength >= LZ_MIN_MATCH ? matchLength - LZ_MIN_MATCH : 0;
+    size_t token = out++;
+    dst[token] = (uint8_t)(((literalCount < 15 ? literalCount : 15) << 4) | (extraMatch < 15 ? extraMatch : 15));
+
+    if (literalCount >= 15)
+        out = putLength(dst, out, literalCount - 15);
+    memcpy(&(dst[out]), literals, literalCount);
+    out += literalCount;
+
+    if (matchLength == 0)
+        return out;
+
+    put16(&(dst[out]), (uint16_t)offset);
+    out += 2;
+    if (extraMatch >= 15)
+        out = putLength(dst, out, extraMatch - 15);
+    return out;
+}
+
+static size_t lzCompress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    uint32_t table[1 << LZ_HASH_BITS] = {0}; // position + 1 of the last 4 bytes with that hash
+    size_t anchor = 0;
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i + LZ_MIN_MATCH <= n)
+    {
+        uint32_t seq = read32(&(src[i]));
+        uint32_t hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)i + 1;
+
+        if (candidate == 0 || i - (candidate - 1) > 0xFFFF || read32(&(src[candidate - 1])) != seq)
+        {
+            i++;
+            continue;
+        }
+
+        candidate--;
+        size_t length = LZ_MIN_MATCH;
+        while (i + length < n && src[candidate + length] == src[i + length])
+            length++;
+
+        out = putSequence(dst, out, &(src[anchor]), i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+    return putSequence(dst, out, &(src[anchor]), n - anchor, 0, 0);
+}
+
+// Adds the extra bytes of a count to length, false if src ends first
+static bool getLength(const uint8_t *src, size_t n, size_t *in, size_t *length)
+{
+    uint8_t more;
+    do
+    {
+        if (*in >= n)
+            return false;
+        more = src[(*in)++];
+        *length += more;
+    } while (more == 255);
+    return true;
+}
+
+// Returns false on corrupt input
+static bool lzDecompress(const uint8_t *src, size_t n, uint8_t *dst, size_t rawSize)
+{
+    size_t in = 0;
+    size_t out = 0;
+    while (in < n)
+    {
+        uint8_t token = src[in++];
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(src, n, &in, &literals))
+            return false;
+        if (in + literals > n || out + literals > rawSize)
+            return false;
+
+        memcpy(&(dst[out]), &(src[in]), literals);
+        in += literals;
+        out += literals;
+        if (out == rawSize)
+            return true;
+
+        if (in + 2 > n)
+            return false;
+        size_t offset = get16(&(src[in]));
+        in += 2;
+        size_t length = token & 0x0F;
+        if (length == 15 && !getLength(src, n, &in, &length))
+            return false;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || out + length > rawSize)
+            return false;
+
+        // Overlapping copies repeat the last offset bytes
+        for (size_t k = 0; k < length; k++, out++)
+            dst[out] = dst[out - offset];
+    }
+    return out == rawSize;
+}
+
+static void writeBlock(Trace *t, uint8_t *block, uint32_t count)
+{
+    size_t raw = (size_t)count * TRACE_RECORD_SIZE;
+    const uint8_t *data = block;
+    size_t stored = raw;
+
+    if (t->compress)
+    {
+        // Neighbouring records mostly differ in PC, opcode and cycle, the
+        // XOR leaves long runs of zeros
+        for (size_t r = count; r-- > 1;)
+        {
+            uint8_t *rec = &(block[r * TRACE_RECORD_SIZE]);
+            for (int k = 0; k < TRACE_RECORD_SIZE; k++)
+                rec[k] ^= rec[k - TRACE_RECORD_SIZE];
+        }
+
+        size_t packed = lzCompress(block, raw, t->packed);
+        if (packed < raw)
+        {
+            data = t->packed;
+            stored = packed;
+        }
+        else
+        {
+            // Not worth it, undo the XOR
+            for (size_t r = 1; r < count; r++)
+            {
+                uint8_t *rec = &(block[r * TRACE_RECORD_SIZE]);
+                for (int k = 0; k < TRACE_RECORD_SIZE; k++)
+                    rec[k] ^= rec[k - TRACE_RECORD_SIZE];
+            }
+        }
+    }
+
+    uint8_t header[8];
+    put32(header, count);
+    put32(&(header[4]), (uint32_t)stored);
+    fwrite(header, 1, sizeof(header), t->file);
+    fwrite(data, 1, stored, t->file);
+    t->bytes += sizeof(header) + stored;
+}
+
+static void *writerThread(void *arg)
+{
+    Trace *t = arg;
+    const struct timespec nap = {0, 500000}; // 0.5 ms
+
+    for (;;)
+    {
+        unsigned tail = atomic_load_explicit(&(t->tail), memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&(t->head), memory_order_acquire);
+        if (tail == head)
+        {
+            if (!atomic_load(&(t->running)))
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        writeBlock(t, t->blocks[tail & (TRACE_BLOCKS - 1)], t->count[tail & (TRACE_BLOCKS - 1)]);
+        atomic_store_explicit(&(t->tail), tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+Trace *initTrace(const char *path, bool compress)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+
+    Trace *t = calloc(1, sizeof(Trace));
+    if (t == NULL)
+        exit(EXIT_FAILURE);
+    t->blocks = malloc(TRACE_BLOCKS * sizeof(*(t->blocks)));
+    t->packed = malloc(PACKED_BYTES);
+    if (t->blocks == NULL || t->packed == NULL)
+    {
+        printf("Trace allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    t->file = file;
+    t->compress = compress;
+
+    uint8_t header[12];
+    memcpy(header, magic, sizeof(magic));
+    put32(&(header[8]), TRACE_RECORD_SIZE);
+    fwrite(header, 1, sizeof(header), file);
+    t->bytes = sizeof(header);
+
+    atomic_store(&(t->running), true);
+    if (pthread_create(&(t->thread), NULL, writerThread, t) != 0)
+    {
+        printf("Trace writer thread could not be started\n");
+        exit(EXIT_FAILURE);
+    }
+    return t;
+}
+
+// Hand the filled block to the writer, wait for a free one if it's behind
+static void queueBlock(Trace *t)
+{
+    const struct timespec nap = {0, 100000};
+    unsigned head = atomic_load_explicit(&(t->head), memory_order_relaxed);
+    t->count[head & (TRACE_BLOCKS - 1)] = (uint32_t)t->fill;
+    atomic_store_explicit(&(t->head), head + 1, memory_order_release);
+    t->fill = 0;
+
+    while (head + 1 - atomic_load_explicit(&(t->tail), memory_order_acquire) >= TRACE_BLOCKS)
+        nanosleep(&nap, NULL);
+}
+
+void freeTrace(Trace *t)
+{
+    if (t->fill > 0)
+        queueBlock(t);
+
+    atomic_store(&(t->running), false);
+    pthread_join(t->thread, NULL);
+    fclose(t->file);
+    free(t->blocks);
+    free(t->packed);
+    free(t);
+}
+
+int traceStep(Trace *t, State *state)
+{
+    unsigned head = atomic_load_explicit(&(t->head), memory_order_relaxed);
+    uint8_t *rec = &(t->blocks[head & (TRACE_BLOCKS - 1)][t->fill * TRACE_RECORD_SIZE]);
+    const Codes *codes = state->codes;
+
+    put16(&(rec[0]), state->pc);
+    put16(&(rec[2]), state->sp);
+    put16(&(rec[4]), state->bc);
+    put16(&(rec[6]), state->de);
+    put16(&(rec[8]), state->hl);
+    rec[10] = state->a;
+    rec[11] = (uint8_t)(codes->c | 0x02 | (codes->p << 2) | (codes->ac << 4) | (codes->z << 6) | (codes->s << 7));
+    rec[12] = memRead(state->map, state->pc);
+    rec[13] = memRead(state->map, (uint16_t)(state->pc + 1));
+    rec[14] = memRead(state->map, (uint16_t)(state->pc + 2));
+    rec[15] = (uint8_t)((state->int_en ? TRACE_INTE : 0) | (state->halted ? TRACE_HALTED : 0));
+    put32(&(rec[16]), (uint32_t)t->cycles);
+
+    int cycles = emulate8080(state);
+    t->cycles += (uint64_t)cycles;
+    t->records++;
+    if (++t->fill == TRACE_BLOCK_RECORDS)
+        queueBlock(t);
+    return cycles;
+}
+
+TraceReader *openTrace(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, magic, sizeof(magic))
+        || get32(&(header[8])) != TRACE_RECORD_SIZE)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    TraceReader *r = calloc(1, sizeof(TraceReader));
+    if (r == NULL)
+        exit(EXIT_FAILURE);
+    r->block = malloc(TRACE_BLOCK_BYTES);
+    r->packed = malloc(PACKED_BYTES);
+    if (r->block == NULL || r->packed == NULL)
+        exit(EXIT_FAILURE);
+    r->file = file;
+    return r;
+}
+
+void closeTrace(TraceReader *r)
+{
+    fclose(r->file);
+    free(r->block);
+    free(r->packed);
+    free(r);
+}
+
+static bool readBlock(TraceReader *r)
+{
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), r->file) != sizeof(header))
+        return false;
+
+    uint32_t count = get32(header);
+    uint32_t stored = get32(&(header[4]));
+    size_t raw = (size_t)count * TRACE_RECORD_SIZE;
+    if (count == 0 || count > TRACE_BLOCK_RECORDS || stored > PACKED_BYTES)
+        return false;
+
+    if (stored == raw)
+    {
+        if (fread(r->block, 1, raw, r->file) != raw)
+            return false;
+    }
+    else
+    {
+        if (fread(r->packed, 1, stored, r->file) != stored || !lzDecompress(r->packed, stored, r->block, raw))
+            return false;
+
+        for (size_t i = 1; i < count; i++)
+        {
+            uint8_t *rec = &(r->block[i * TRACE_RECORD_SIZE]);
+            for (int k = 0; k < TRACE_RECORD_SIZE; k++)
+                rec[k] ^= rec[k - TRACE_RECORD_SIZE];
+        }
+    }
+    r->count = count;
+    r->next = 0;
+    return true;
+}
+
+bool traceNext(TraceReader *r, TraceRecord *record)
+{
+    if (r->next == r->count && !readBlock(r))
+        return false;
+
+    const uint8_t *rec = &(r->block[r->next++ * TRACE_RECORD_SIZE]);
+    record->pc = get16(&(rec[0]));
+    record->sp = get16(&(rec[2]));
+    record->bc = get16(&(rec[4]));
+    record->de = get16(&(rec[6]));
+    record->hl = get16(&(rec[8]));
+    record->a = rec[10];
+    record->flags = rec[11];
+    record->opcode = rec[12];
+    record->operand[0] = rec[13];
+    record->operand[1] = rec[14];
+    record->status = rec[15];
+    record->cycle = get32(&(rec[16]));
+    return true;
+}
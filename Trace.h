@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "8080.h"
+
+// Execution trace: one fixed-size record per instruction, written in blocks
+// by a background thread. File layout:
+//   "8080TRC" '\0', u32 record size
+//   blocks of: u32 records, u32 stored bytes, data
+// A block's records are XORed with the one before (zeros for the first) and
+// then LZ compressed, unless stored bytes equals records * record size.
+// Everything is little endian.
+#define TRACE_RECORD_SIZE 20
+#define TRACE_BLOCK_RECORDS 8192
+#define TRACE_BLOCK_BYTES (TRACE_BLOCK_RECORDS * TRACE_RECORD_SIZE)
+#define TRACE_BLOCKS 8 // queued between emulation and writer, power of 2
+
+#define TRACE_INTE 0x01
+#define TRACE_HALTED 0x02
+
+// State before the instruction
+typedef struct
+{
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint8_t a;
+    uint8_t flags; // S Z 0 AC 0 P 1 CY, like PUSH PSW
+    uint8_t opcode;
+    uint8_t operand[2];
+    uint8_t status; // TRACE_INTE, TRACE_HALTED
+    uint32_t cycle; // cycles run before it, wraps around
+} TraceRecord;
+
+typedef struct
+{
+    FILE *file;
+    bool compress;
+    uint64_t cycles;
+    uint64_t records;
+
+    // Emulation fills blocks[head], the writer thread drains from tail
+    uint8_t (*blocks)[TRACE_BLOCK_BYTES];
+    uint32_t count[TRACE_BLOCKS];
+    int fill; // records in the block being filled
+    atomic_uint head;
+    atomic_uint tail;
+
+    // Writer thread
+    uint8_t *packed;
+    uint64_t bytes; // written to the file
+    pthread_t thread;
+    atomic_bool running;
+} Trace;
+
+// Returns NULL if path can't be created
+Trace *initTrace(const char *path, bool compress);
+// Writes out what is left and closes the file
+void freeTrace(Trace *t);
+
+// Record the instruction at PC, then execute it. Returns its cycles like
+// emulate8080().
+int traceStep(Trace *t, State *state);
+
+typedef struct
+{
+    FILE *file;
+    uint8_t *block;
+    uint8_t *packed;
+    uint32_t count; // records in the current block
+    uint32_t next;
+} TraceReader;
+
+// Returns NULL if path isn't a trace
+TraceReader *openTrace(const char *path);
+void closeTrace(TraceReader *r);
+// false at the end of the trace
+bool traceNext(TraceReader *r, TraceRecord *record);
+
+#endif
@@ -0,0 +1,264 @@
+#include <string.h>
+#include "Translate.h"
+
+static const char *regs[8] = {"s->b", "s->c", "s->d", "s->e", "s->h", "s->l", "memRead(s->map, s->hl)", "s->a"};
+static const char *pairs[4] = {"s->bc", "s->de", "s->hl", "s->sp"};
+static const char *conditions[8] = {"!s->codes->z", "s->codes->z", "!s->codes->c", "s->codes->c",
+                                    "!s->codes->p", "s->codes->p", "!s->codes->s", "s->codes->s"};
+
+// ADD ADC SUB SBB ANA XRA ORA CMP, with the operand in between
+static const char *alu[8][2] = {{"add(s, ", ", false)"}, {"add(s, ", ", s->codes->c)"}, {"sub(s, ", ", false)"},
+                                {"sub(s, ", ", s->codes->c)"}, {"and(s, ", ")"}, {"xor(s, ", ")"},
+                                {"or(s, ", ")"}, {"cmp(s, ", ")"}};
+
+// Pages the CPU can't write to, the way initMachine() maps them
+static void romPages(const MachineDesc *desc, bool *rom)
+{
+    memset(rom, 0, MEM_PAGES * sizeof(bool));
+    for (int i = 0; i < desc->regionCount; i++)
+        for (int page = desc->regions[i].start >> MEM_PAGE_SHIFT; page <= desc->regions[i].end >> MEM_PAGE_SHIFT; page++)
+            rom[page] = desc->regions[i].type == PAGE_ROM;
+    for (int i = 0; i < desc->aliasCount; i++)
+        for (int page = desc->aliases[i].start >> MEM_PAGE_SHIFT; page <= desc->aliases[i].end >> MEM_PAGE_SHIFT; page++)
+            rom[page] = false;
+}
+
+static bool translatable(const Cfg *cfg, const CfgBlock *b, const bool *rom)
+{
+    if (b->end > MEM_SIZE)
+        return false;
+    for (uint32_t addr = b->start; addr < b->end; addr++)
+        if (!rom[addr >> MEM_PAGE_SHIFT] || !(cfg->flags[addr] & CFG_ROM))
+            return false;
+    return true;
+}
+
+// Straight to the block at addr if there is one, else to the interpreter
+static void emitGoto(FILE *out, const Cfg *cfg, const bool *translated, uint16_t addr)
+{
+    const CfgBlock *b = cfgBlockAt(cfg, addr);
+    if (b != NULL && b->start == addr && translated[b - cfg->blocks])
+        fprintf(out, "goto b%04x;\n", addr);
+    else
+        fprintf(out, "AOT_EXIT(0x%04x);\n", addr);
+}
+
+// Anything that doesn't change the flow, as emulate8080() does it
+static void emitInstruction(FILE *out, const uint8_t *mem, uint16_t pc)
+{
+    uint8_t opcode = mem[pc];
+    uint8_t byte = mem[(uint16_t)(pc + 1)];
+    uint16_t word = (uint16_t)(byte | (mem[(uint16_t)(pc + 2)] << 8));
+    int dst = (opcode >> 3) & 7;
+    int src = opcode & 7;
+    int pair = (opcode >> 4) & 3;
+
+    fprintf(out, "    ");
+    if (opcode >= 0x40 && opcode <= 0x7F)
+    {
+        if (dst == 6)
+            fprintf(out, "memWrite(s->map, s->hl, %s);\n", regs[src]);
+        else
+            fprintf(out, "%s = %s;\n", regs[dst], regs[src]);
+    }
+    else if (opcode >= 0x80 && opcode <= 0xBF)
+        fprintf(out, "%s(uint16_t)%s%s;\n", alu[dst][0], regs[src], alu[dst][1]);
+    else if ((opcode & 0xC7) == 0xC6)
+        fprintf(out, "%s0x%02x%s;\n", alu[dst][0], byte, alu[dst][1]);
+    else if ((opcode & 0xC7) == 0x06)
+    {
+        if (dst == 6)
+            fprintf(out, "memWrite(s->map, s->hl, 0x%02x);\n", byte);
+        else
+            fprintf(out, "%s = 0x%02x;\n", regs[dst], byte);
+    }
+    else if ((opcode & 0xC7) == 0x04 || (opcode & 0xC7) == 0x05)
+    {
+        const char *op = (opcode & 1) ? "dcr" : "inr";
+        if (dst == 6)
+            fprintf(out, "memWrite(s->map, s->hl, %s(s, memRead(s->map, s->hl)));\n", op);
+        else
+            fprintf(out, "%s = %s(s, %s);\n", regs[dst], op, regs[dst]);
+    }
+    else if ((opcode & 0xCF) == 0x01)
+        fprintf(out, "%s = 0x%04x;\n", pairs[pair], word);
+    else if ((opcode & 0xCF) == 0x03)
+        fprintf(out, "%s++;\n", pairs[pair]);
+    else if ((opcode & 0xCF) == 0x0B)
+        fprintf(out, "%s--;\n", pairs[pair]);
+    else if ((opcode & 0xCF) == 0x09)
+        fprintf(out, "dad(s, %s);\n", pairs[pair]);
+    else if ((opcode & 0xCF) == 0xC5)
+        fprintf(out, pair == 3 ? "pushPsw(s);\n" : "push(s, %s);\n", pairs[pair]);
+    else if ((opcode & 0xCF) == 0xC1)
+        fprintf(out, pair == 3 ? "popPsw(s);\n" : "%s = pop(s);\n", pairs[pair]);
+    else
+    {
+        switch (opcode)
+        {
+            case 0x02: fprintf(out, "memWrite(s->map, s->bc, s->a);\n"); break;
+            case 0x12: fprintf(out, "memWrite(s->map, s->de, s->a);\n"); break;
+            case 0x0A: fprintf(out, "s->a = memRead(s->map, s->bc);\n"); break;
+            case 0x1A: fprintf(out, "s->a = memRead(s->map, s->de);\n"); break;
+            case 0x22: fprintf(out, "memWrite16(s->map, 0x%04x, s->hl);\n", word); break;
+            case 0x2A: fprintf(out, "s->hl = memRead16(s->map, 0x%04x);\n", word); break;
+            case 0x32: fprintf(out, "memWrite(s->map, 0x%04x, s->a);\n", word); break;
+            case 0x3A: fprintf(out, "s->a = memRead(s->map, 0x%04x);\n", word); break;
+            case 0x07: fprintf(out, "rlc(s);\n"); break;
+            case 0x0F: fprintf(out, "rrc(s);\n"); break;
+            case 0x17: fprintf(out, "ral(s);\n"); break;
+            case 0x1F: fprintf(out, "rar(s);\n"); break;
+            case 0x27: fprintf(out, "daa(s);\n"); break;
+            case 0x2F: fprintf(out, "s->a = ~(s->a);\n"); break;
+            case 0x37: fprintf(out, "s->codes->c = 1;\n"); break;
+            case 0x3F: fprintf(out, "s->codes->c = !(s->codes->c);\n"); break;
+            case 0xD3: fprintf(out, "portWrite(s->io, 0x%02x, s->a);\n", byte); break;
+            case 0xDB: fprintf(out, "s->a = portRead(s->io, 0x%02x);\n", byte); break;
+            case 0xE3: fprintf(out, "{ uint16_t top = pop(s); push(s, s->hl); s->hl = top; }\n"); break;
+            case 0xEB: fprintf(out, "{ uint16_t de = s->de; s->de = s->hl; s->hl = de; }\n"); break;
+            case 0xF3: fprintf(out, "s->int_en = false;\n"); break;
+            case 0xFB: fprintf(out, "s->int_en = true;\n"); break;
+            case 0xF9: fprintf(out, "s->sp = s->hl;\n"); break;
+            default: fprintf(out, "// NOP %02x\n", opcode); break;
+        }
+    }
+}
+
+static void emitBlock(FILE *out, const Cfg *cfg, const CfgBlock *b, const bool *translated)
+{
+    const uint8_t *mem = cfg->mem;
+    uint8_t opcode = mem[b->last];
+    uint16_t next = (uint16_t)b->end;
+    bool conditional = b->kind == BLOCK_RETURN_IF || (b->kind == BLOCK_CALL && (opcode & 0xC7) == 0xC4);
+
+    // Conditional calls and returns add their own cycles, HLT is left to
+    // the interpreter
+    uint32_t most = b->cycles - (b->kind == BLOCK_HALT ? (uint32_t)cycles8080(opcode) : 0);
+    uint32_t fixed = most - (conditional ? (uint32_t)cycles8080(opcode) : 0);
+
+    fprintf(out, "\nb%04x:\n", b->start);
+    if (b->kind == BLOCK_HALT && b->count == 1)
+    {
+        fprintf(out, "    AOT_EXIT(0x%04x);\n", b->last);
+        return;
+    }
+    fprintf(out, "    AOT_BLOCK(0x%04x, %u);\n    cycles += %u;\n", b->start, most, fixed);
+    for (uint16_t pc = b->start; pc != b->last; pc = (uint16_t)(pc + length8080(mem[pc])))
+        emitInstruction(out, mem, pc);
+
+    const char *cond = conditions[(opcode >> 3) & 7];
+    switch (b->kind)
+    {
+        case BLOCK_FALLS:
+        case BLOCK_OUTSIDE:
+            emitInstruction(out, mem, b->last);
+            fprintf(out, "    ");
+            emitGoto(out, cfg, translated, next);
+            break;
+        case BLOCK_JUMP:
+            fprintf(out, "    ");
+            emitGoto(out, cfg, translated, b->target);
+            break;
+        case BLOCK_BRANCH:
+            fprintf(out, "    if (%s)\n        ", cond);
+            emitGoto(out, cfg, translated, b->target);
+            fprintf(out, "    ");
+            emitGoto(out, cfg, translated, next);
+            break;
+        case BLOCK_CALL:
+            if (conditional)
+            {
+                fprintf(out, "    if (%s)\n    {\n        cycles += %d;\n        push(s, 0x%04x);\n        ", cond,
+                        cycles8080(opcode), next);
+                emitGoto(out, cfg, translated, b->target);
+                fprintf(out, "    }\n    cycles += %d;\n    ", notTakenCycles8080(opcode));
+                emitGoto(out, cfg, translated, next);
+            }
+            else
+            {
+                fprintf(out, "    push(s, 0x%04x);\n    ", next);
+                emitGoto(out, cfg, translated, b->target);
+            }
+            break;
+        case BLOCK_RETURN:
+            fprintf(out, "    s->pc = pop(s);\n    goto dispatch;\n");
+            break;
+        case BLOCK_RETURN_IF:
+            fprintf(out, "    if (%s)\n    {\n        cycles += %d;\n        s->pc = pop(s);\n        goto dispatch;\n    }\n"
+                         "    cycles += %d;\n    ", cond, cycles8080(opcode), notTakenCycles8080(opcode));
+            emitGoto(out, cfg, translated, next);
+            break;
+        case BLOCK_INDIRECT:
+            fprintf(out, "    s->pc = s->hl;\n    goto dispatch;\n");
+            break;
+        case BLOCK_HALT:
+            fprintf(out, "    AOT_EXIT(0x%04x);\n", b->last);
+            break;
+    }
+}
+
+int translateROM(const Cfg *cfg, const MachineDesc *desc, const char *source, FILE *out)
+{
+    bool rom[MEM_PAGES];
+    romPages(desc, rom);
+    bool *translated = calloc((size_t)cfg->blockCount + 1, sizeof(bool));
+    if (translated == NULL)
+        exit(EXIT_FAILURE);
+    int count = 0;
+    int last = -1;
+    for (int i = 0; i < cfg->blockCount; i++)
+        if ((translated[i] = translatable(cfg, &(cfg->blocks[i]), rom)))
+        {
+            count++;
+            last = cfg->blocks[i].start;
+        }
+
+    fprintf(out, "// Generated by romcfg -c from %s for %s, do not edit. %d blocks,\n// see Aot.h\n", source,
+            desc->name, count);
+    fprintf(out, "#include \"Aot.h\"\n#include \"8080Ops.h\"\n\n");
+    fprintf(out, "static int run(State *s, int cycles, int limit)\n{\n    goto dispatch;\n");
+    for (int i = 0; i < cfg->blockCount; i++)
+        if (translated[i])
+            emitBlock(out, cfg, &(cfg->blocks[i]), translated);
+
+    fprintf(out, "\ndispatch:\n    switch (s->pc)\n    {\n");
+    for (int i = 0; i < cfg->blockCount; i++)
+        if (translated[i])
+            fprintf(out, "        case 0x%04x: goto b%04x;\n", cfg->blocks[i].start, cfg->blocks[i].start);
+    fprintf(out, "    }\n    return cycles;\n}\n\n");
+
+    // The ROM as translated, checked before the machine uses it
+    fprintf(out, "static const AotSpan spans[] = {\n");
+    int spanCount = 0;
+    uint32_t addr = 0;
+    while (addr < MEM_SIZE)
+    {
+        if (!(cfg->flags[addr] & CFG_ROM) || !rom[addr >> MEM_PAGE_SHIFT])
+        {
+            addr++;
+            continue;
+        }
+        uint32_t start = addr;
+        while (addr < MEM_SIZE && (cfg->flags[addr] & CFG_ROM) && rom[addr >> MEM_PAGE_SHIFT])
+            addr++;
+        fprintf(out, "    {0x%04x, 0x%04x, 0x%08x},\n", start, addr - start, crc32(&(cfg->mem[start]), addr - start));
+        spanCount++;
+    }
+    if (spanCount == 0)
+        fprintf(out, "    {0, 0, 0},\n");
+    fprintf(out, "};\n\n");
+
+    // So the machine can tell without calling run() whether PC has a block
+    uint8_t starts[MEM_SIZE / 8 + 1] = {0};
+    for (int i = 0; i < cfg->blockCount; i++)
+        if (translated[i])
+            starts[cfg->blocks[i].start >> 3] |= (uint8_t)(1 << (cfg->blocks[i].start & 7));
+    fprintf(out, "static const uint8_t starts[] = {");
+    for (int i = 0; i <= (last < 0 ? 0 : last >> 3); i++)
+        fprintf(out, "%s0x%02x,", (i % 16) ? " " : "\n    ", starts[i]);
+    fprintf(out, "\n};\n\nconst AotEngine aotRom = {\"%s\", spans, %d, %d, starts, %d, run};\n", desc->name,
+            spanCount, count, last);
+
+    free(translated);
+    return count;
+}
@@ -0,0 +1,12 @@
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include <stdio.h>
+#include "Cfg.h"
+
+// Writes the blocks of cfg as C, the AotEngine aotRom (see Aot.h). Only
+// blocks wholly inside the board's ROM pages are translated, code the CPU
+// could overwrite is left to the interpreter. Returns the blocks written.
+int translateROM(const Cfg *cfg, const MachineDesc *desc, const char *source, FILE *out);
+
+#endif
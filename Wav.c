@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Wav.h"
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+int16_t *wavLoad(const char *path, int rate, uint32_t *length)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return NULL;
+
+    uint8_t header[12];
+    if (fread(header, sizeof(header), 1, f) != 1 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    uint16_t channels = 0, bits = 0;
+    uint32_t srcRate = 0, dataSize = 0;
+    uint8_t *data = NULL;
+
+    // Walk the chunks until both fmt and data have been seen
+    uint8_t chunk[8];
+    while (data == NULL && fread(chunk, sizeof(chunk), 1, f) == 1)
+    {
+        uint32_t size = le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4) && size >= 16)
+        {
+            uint8_t fmt[16];
+            if (fread(fmt, sizeof(fmt), 1, f) != 1 || le16(fmt) != 1) // PCM only
+                break;
+            channels = le16(fmt + 2);
+            srcRate = le32(fmt + 4);
+            bits = le16(fmt + 14);
+            fseek(f, (long)(size - 16 + (size & 1)), SEEK_CUR);
+        }
+        else if (!memcmp(chunk, "data", 4) && channels != 0)
+        {
+            data = malloc(size);
+            dataSize = size;
+            if (data == NULL || fread(data, size, 1, f) != 1)
+            {
+                free(data);
+                data = NULL;
+                break;
+            }
+        }
+        else
+            fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+    }
+    fclose(f);
+
+    if (data == NULL || (bits != 8 && bits != 16) || channels == 0 || srcRate == 0)
+    {
+        free(data);
+        return NULL;
+    }
+
+    // Downmix to mono 16-bit
+    uint32_t frameSize = channels * (bits / 8);
+    uint32_t frames = dataSize / frameSize;
+    int16_t *mono = malloc(sizeof(int16_t) * (frames ? frames : 1));
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        int32_t sum = 0;
+        for (int ch = 0; ch < channels; ch++)
+        {
+            const uint8_t *p = data + i * frameSize + ch * (bits / 8);
+            sum += (bits == 8) ? ((int32_t)p[0] - 128) << 8 : (int16_t)le16(p);
+        }
+        mono[i] = (int16_t)(sum / channels);
+    }
+    free(data);
+
+    if ((int)srcRate == rate)
+    {
+        *length = frames;
+        return mono;
+    }
+
+    // Linear resample to the output rate
+    uint32_t outFrames = (uint32_t)((uint64_t)frames * rate / srcRate);
+    int16_t *out = malloc(sizeof(int16_t) * (outFrames ? outFrames : 1));
+    for (uint32_t i = 0; i < outFrames; i++)
+    {
+        uint64_t pos = (uint64_t)i * srcRate * 256 / rate;
+        uint32_t idx = (uint32_t)(pos >> 8);
+        int32_t frac = pos & 0xFF;
+        int32_t a = mono[idx];
+        int32_t b = (idx + 1 < frames) ? mono[idx + 1] : a;
+        out[i] = (int16_t)(a + (((b - a) * frac) >> 8));
+    }
+    free(mono);
+
+    *length = outFrames;
+    return out;
+}
+
+static void writeHeader(FILE *f, int rate, uint32_t dataSize)
+{
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, 36 + dataSize);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1);          // PCM
+    put16(h + 22, 1);          // mono
+    put32(h + 24, rate);
+    put32(h + 28, rate * 2);   // byte rate
+    put16(h + 32, 2);          // block align
+    put16(h + 34, 16);         // bits per sample
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, dataSize);
+    fwrite(h, sizeof(h), 1, f);
+}
+
+FILE *wavOpen(const char *path, int rate)
+{
+    FILE *f = fopen(path, "w+b");
+    if (f == NULL)
+        return NULL;
+
+    writeHeader(f, rate, 0);
+    return f;
+}
+
+void wavWrite(FILE *f, const int16_t *samples, int n)
+{
+    uint8_t buf[512];
+    while (n > 0)
+    {
+        int chunk = n < 256 ? n : 256;
+        for (int i = 0; i < chunk; i++)
+            put16(buf + i * 2, (uint16_t)samples[i]);
+        fwrite(buf, 2, chunk, f);
+        samples += chunk;
+        n -= chunk;
+    }
+}
+
+void wavClose(FILE *f)
+{
+    long size = ftell(f) - 44;
+    uint8_t rate[4];
+
+    // keep the rate written by wavOpen
+    fseek(f, 24, SEEK_SET);
+    if (fread(rate, sizeof(rate), 1, f) != 1)
+        put32(rate, 0);
+    fseek(f, 0, SEEK_SET);
+    writeHeader(f, le32(rate), (uint32_t)size);
+    fclose(f);
+}
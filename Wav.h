@@ -0,0 +1,16 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Load a PCM WAV (8/16-bit, mono or stereo) as 16-bit mono at rate,
+// resampling if needed. Returns NULL if the file can't be read.
+int16_t *wavLoad(const char *path, int rate, uint32_t *length);
+
+// Streamed 16-bit mono WAV output, the header sizes are patched on close
+FILE *wavOpen(const char *path, int rate);
+void wavWrite(FILE *f, const int16_t *samples, int n);
+void wavClose(FILE *f);
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "Capture.h"
+
+// Replay a delta stream (-capture file) into one 1-bit grayscale PNG per
+// frame. The image data is zlib with stored blocks, so no zlib is needed.
+#define STORED_MAX 65535
+
+static uint32_t crcTable[256];
+
+static void initCrc(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc(uint32_t c, const uint8_t *data, size_t length)
+{
+    c = ~c;
+    for (size_t i = 0; i < length; i++)
+        c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static void writeChunk(FILE *f, const char *type, const uint8_t *data, size_t length)
+{
+    uint8_t head[8];
+    put32(head, (uint32_t)length);
+    memcpy(&(head[4]), type, 4);
+
+    uint8_t tail[4];
+    put32(tail, crc(crc(0, &(head[4]), 4), data, length));
+
+    fwrite(head, 1, sizeof(head), f);
+    fwrite(data, 1, length, f);
+    fwrite(tail, 1, sizeof(tail), f);
+}
+
+// Rows behind a filter byte of 0, wrapped in zlib stored blocks. out must
+// hold rows * (stride + 1) plus 6 and 5 bytes per block.
+static size_t deflateStored(const CaptureReader *r, uint8_t *raw, uint8_t *out)
+{
+    size_t size = (size_t)r->height * (r->stride + 1);
+    for (int y = 0; y < r->height; y++)
+    {
+        raw[y * (r->stride + 1)] = 0;
+        memcpy(&(raw[y * (r->stride + 1) + 1]), &(r->bits[y * r->stride]), (size_t)r->stride);
+    }
+
+    size_t n = 0;
+    out[n++] = 0x78; // deflate, 32K window, no dictionary
+    out[n++] = 0x01;
+    for (size_t at = 0; at < size;)
+    {
+        size_t block = size - at < STORED_MAX ? size - at : STORED_MAX;
+        out[n++] = at + block == size; // BFINAL, BTYPE 00
+        out[n++] = (uint8_t)block;
+        out[n++] = (uint8_t)(block >> 8);
+        out[n++] = (uint8_t)~block;
+        out[n++] = (uint8_t)(~block >> 8);
+        memcpy(&(out[n]), &(raw[at]), block);
+        n += block;
+        at += block;
+    }
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(&(out[n]), (b << 16) | a);
+    return n + 4;
+}
+
+static bool writePNG(const char *path, const CaptureReader *r, uint8_t *raw, uint8_t *packed)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), f);
+
+    uint8_t ihdr[13];
+    put32(ihdr, (uint32_t)r->width);
+    put32(&(ihdr[4]), (uint32_t)r->height);
+    ihdr[8] = 1;  // bit depth
+    ihdr[9] = 0;  // grayscale
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // not interlaced
+    writeChunk(f, "IHDR", ihdr, sizeof(ihdr));
+    writeChunk(f, "IDAT", packed, deflateStored(r, raw, packed));
+    writeChunk(f, "IEND", NULL, 0);
+
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+static void usage(void)
+{
+    printf("usage: capturepng capture.vid outdir [first [count]]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+        usage();
+    unsigned long long first = argc > 3 ? strtoull(argv[3], NULL, 10) : 0;
+    unsigned long long count = argc > 4 ? strtoull(argv[4], NULL, 10) : ~0ull;
+
+    CaptureReader *r = openCapture(argv[1]);
+    if (r == NULL)
+    {
+        printf("%s is not a capture\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    initCrc();
+    size_t size = (size_t)r->height * (r->stride + 1);
+    uint8_t *raw = malloc(size);
+    uint8_t *packed = malloc(size + 6 + 5 * (size / STORED_MAX + 1));
+    if (raw == NULL || packed == NULL)
+    {
+        printf("PNG allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every frame has to be decoded, the ones before first are deltas too
+    unsigned long long frame = 0;
+    unsigned long long written = 0;
+    for (; written < count && captureNext(r); frame++)
+    {
+        if (frame < first)
+            continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/frame%06llu.png", argv[2], frame);
+        if (!writePNG(path, r, raw, packed))
+        {
+            printf("%s could not be written\n", path);
+            exit(EXIT_FAILURE);
+        }
+        written++;
+    }
+
+    printf("%llu frames in the stream read, %llu PNGs written (%dx%d, %d fps)\n", frame, written, r->width,
+           r->height, r->fps);
+    free(raw);
+    free(packed);
+    closeCapture(r);
+    return EXIT_SUCCESS;
+}
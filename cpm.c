@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "8080.h"
+#include "Trace.h"
+#include "Debugger.h"
+
+// Just enough CP/M to run the standard 8080 test programs (TST8080,
+// CPUDIAG, 8080PRE, 8080EXM...) on emulate8080(): the .COM file is loaded
+// at 0x100, BDOS calls through 0x0005 print to the console and a jump to
+// 0x0000 (warm boot) ends the run. -gdb port stops at the first
+// instruction until GDB attaches.
+#define TPA 0x0100
+#define BDOS 0x0005
+#define BDOS_ENTRY 0xFE00 // top of the TPA, programs put their stack below it
+#define BDOS_PORT 0xFF
+
+typedef struct
+{
+    State *cpu;
+    bool quiet;
+    bool exited; // BDOS function 0
+    char *output;
+    size_t length;
+    size_t capacity;
+} Cpm;
+
+static void emit(Cpm *cpm, char c)
+{
+    if (!cpm->quiet)
+        putchar(c);
+
+    if (cpm->length + 1 >= cpm->capacity)
+    {
+        cpm->capacity = cpm->capacity ? 2 * cpm->capacity : 4096;
+        cpm->output = realloc(cpm->output, cpm->capacity);
+        if (cpm->output == NULL)
+        {
+            printf("Output allocation failure\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    cpm->output[cpm->length++] = c;
+    cpm->output[cpm->length] = '\0';
+}
+
+// The BDOS entry is OUT BDOS_PORT; RET, the call number is in C
+static void bdos(void *ctx, uint8_t port, uint8_t value)
+{
+    (void)port;
+    (void)value;
+    Cpm *cpm = ctx;
+    State *cpu = cpm->cpu;
+
+    switch (cpu->c)
+    {
+        case 0: cpm->exited = true; break;
+        case 2: emit(cpm, (char)cpu->e); break;
+        case 9:
+        {
+            uint16_t addr = cpu->de;
+            for (int n = 0; n < MEM_SIZE && memRead(cpu->map, addr) != '$'; n++, addr++)
+                emit(cpm, (char)memRead(cpu->map, addr));
+            break;
+        }
+    }
+    fflush(stdout);
+}
+
+// Case insensitive strstr
+static bool contains(const char *text, const char *word)
+{
+    size_t n = strlen(word);
+    for (; *text != '\0'; text++)
+    {
+        size_t i = 0;
+        while (i < n && tolower((unsigned char)text[i]) == word[i])
+            i++;
+        if (i == n)
+            return true;
+    }
+    return false;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    printf("usage: cpm program.com [-quiet] [-cycles limit] [-trace file] [-gdb port]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage();
+
+    Cpm cpm = {0};
+    uint64_t limit = 0;
+    const char *tracePath = NULL;
+    int gdbPort = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-quiet"))
+            cpm.quiet = true;
+        else if (!strcmp(argv[i], "-cycles") && i + 1 < argc)
+            limit = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (!strcmp(argv[i], "-gdb") && i + 1 < argc)
+            gdbPort = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    State *cpu = init8080();
+    cpm.cpu = cpu;
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        printf("File could not be opened\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t size = fread(&(cpu->mem[TPA]), 1, BDOS_ENTRY - TPA, f);
+    fclose(f);
+
+    // Warm boot halts, BDOS calls trap to the port handler and return
+    cpu->mem[0x0000] = 0x76;
+    cpu->mem[BDOS] = 0xC3;
+    cpu->mem[BDOS + 1] = BDOS_ENTRY & 0xFF;
+    cpu->mem[BDOS + 2] = BDOS_ENTRY >> 8;
+    cpu->mem[BDOS_ENTRY] = 0xD3;
+    cpu->mem[BDOS_ENTRY + 1] = BDOS_PORT;
+    cpu->mem[BDOS_ENTRY + 2] = 0xC9;
+    portsInit(cpu->io, &cpm);
+    portsMapWrite(cpu->io, BDOS_PORT, bdos);
+
+    // Returning from the program is a warm boot too
+    cpu->pc = TPA;
+    cpu->sp = BDOS_ENTRY;
+    cpu->sp -= 2;
+    cpu->mem[cpu->sp] = 0;
+    cpu->mem[cpu->sp + 1] = 0;
+
+    Trace *trace = NULL;
+    if (tracePath != NULL && (trace = initTrace(tracePath, true)) == NULL)
+    {
+        printf("%s could not be created\n", tracePath);
+        exit(EXIT_FAILURE);
+    }
+
+    Debugger *dbg = NULL;
+    if (gdbPort != 0 && (dbg = initDebugger(cpu, gdbPort)) == NULL)
+    {
+        printf("Port %d could not be opened\n", gdbPort);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    double start = now();
+    while (!cpu->halted && !cpm.exited && (limit == 0 || cycles < limit))
+    {
+        if (dbg != NULL && dbg->armed)
+            debuggerBefore(dbg);
+        cycles += (uint64_t)(trace != NULL ? traceStep(trace, cpu) : emulate8080(cpu));
+        if (dbg != NULL && dbg->armed)
+            debuggerAfter(dbg);
+        instructions++;
+
+        // ^C from GDB
+        if (dbg != NULL && (instructions & 0xFFFF) == 0)
+            debuggerPoll(dbg);
+    }
+    double elapsed = now() - start;
+    if (trace != NULL)
+        freeTrace(trace);
+    if (dbg != NULL)
+        freeDebugger(dbg);
+
+    // The test programs report failures in their output, never in an exit
+    // code
+    bool finished = cpu->halted || cpm.exited;
+    bool failed = cpm.output != NULL && (contains(cpm.output, "fail") || contains(cpm.output, "error"));
+    bool passed = finished && !failed;
+
+    if (!cpm.quiet && cpm.length > 0 && cpm.output[cpm.length - 1] != '\n')
+        putchar('\n');
+    printf("%s: %zu bytes, %llu instructions, %llu cycles in %.3f s\n",
+           passed ? "PASS" : (finished ? "FAIL" : "TIMEOUT"), size, (unsigned long long)instructions,
+           (unsigned long long)cycles, elapsed);
+    printf("%.1f MHz emulated, %.0fx a 2 MHz 8080, %.1f M instructions/s\n", cycles / elapsed / 1e6,
+           cycles / elapsed / 2e6, instructions / elapsed / 1e6);
+
+    free(cpm.output);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
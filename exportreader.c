@@ -0,0 +1,88 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "Export.h"
+
+// Follows the frames an emulator publishes with -export, one line per frame
+// read. Frames it fell too far behind on are counted as skipped, the reader
+// jumps to the newest one instead. Stops after a number of frames or when
+// nothing new is published for two seconds.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int litPixels(const uint8_t *vram, uint32_t size)
+{
+    int lit = 0;
+    for (uint32_t i = 0; i < size; i++)
+        lit += __builtin_popcount(vram[i]);
+    return lit;
+}
+
+int main(int argc, char **argv)
+{
+    // exportreader name [frames]
+    if (argc < 2)
+    {
+        printf("usage: exportreader name [frames]\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long long limit = argc > 2 ? strtoull(argv[2], NULL, 10) : ~0ull;
+
+    ExportReader *r = openExport(argv[1]);
+    if (r == NULL)
+    {
+        printf("%s is not being exported\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    const ExportHeader *h = r->header;
+    printf("%s: %dx%d, %u bytes of RAM, VRAM at +0x%04X, %u slots\n", h->machine, h->screenWidth,
+           h->screenHeight, h->ramSize, h->vramOffset, h->slotCount);
+
+    const struct timespec nap = {0, 1000000};
+    uint64_t next = exportPublished(r);
+    next = next > 0 ? next - 1 : 0;
+    unsigned long long read = 0;
+    unsigned long long skipped = 0;
+    double idle = now();
+    while (read < limit)
+    {
+        uint64_t published = exportPublished(r);
+        if (next >= published)
+        {
+            if (now() - idle > 2)
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        idle = now();
+
+        if (!exportRead(r, next))
+        {
+            // Lapped by the writer
+            uint64_t newest = exportPublished(r) - 1;
+            skipped += newest - next;
+            next = newest;
+            continue;
+        }
+
+        const ExportSlot *s = r->slot;
+        printf("%llu pc %04X sp %04X af %04X bc %04X de %04X hl %04X lit %d\n", (unsigned long long)s->frame,
+               s->regs.pc, s->regs.sp, s->regs.psw, s->regs.bc, s->regs.de, s->regs.hl,
+               litPixels(&(s->ram[h->vramOffset]), h->vramSize));
+        read++;
+        next++;
+    }
+
+    printf("%llu frames read, %llu skipped, %llu torn copies retried\n", read, skipped,
+           (unsigned long long)r->retries);
+    closeExport(r);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "Filter.h"
+
+// Time of every filter on a 224x256 invaders-like frame, on the calling
+// thread alone and with the thread pool, and a check that both give the
+// same picture
+#define WIDTH 224
+#define HEIGHT 256
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Rows of 16x8 sprites and a few stray pixels on black
+static void makeFrame(uint32_t *frame)
+{
+    uint64_t seed = 1;
+    memset(frame, 0, WIDTH * HEIGHT * sizeof(uint32_t));
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        for (int x = 0; x < WIDTH; x++)
+        {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            bool sprite = (y / 8) % 3 == 1 && (x / 16) % 2 == 0 && ((seed >> 40) & 3) != 0;
+            bool speck = ((seed >> 33) & 255) == 0;
+            if (sprite || speck)
+                frame[y * WIDTH + x] = 0x00FFFFFF;
+        }
+    }
+}
+
+static double timeFilter(Filter *f, const uint32_t *frame, int frames)
+{
+    filterFrame(f, frame); // warm up
+    double start = now();
+    for (int i = 0; i < frames; i++)
+        filterFrame(f, frame);
+    return (now() - start) / frames;
+}
+
+int main(int argc, char **argv)
+{
+    // filterbench [threads] [frames]
+    int threads = argc > 1 ? atoi(argv[1]) : -1;
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+    frames = frames < 1 ? 1 : frames;
+
+    uint32_t *frame = malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    if (frame == NULL)
+        exit(EXIT_FAILURE);
+    makeFrame(frame);
+
+    static const struct
+    {
+        const char *name;
+        int scale;
+    } runs[] = {{"nearest", 2}, {"nearest", 4}, {"scale2x", 2}, {"scale3x", 3}, {"scale4x", 4}, {"crt", 3}, {"crt", 4}};
+
+    bool same = true;
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+    {
+        FilterType type = FILTER_NEAREST; // the names above all exist
+        findFilter(runs[i].name, &type);
+        Filter *one = initFilter(type, runs[i].scale, WIDTH, HEIGHT, 0);
+        Filter *pool = initFilter(type, runs[i].scale, WIDTH, HEIGHT, threads);
+
+        double single = timeFilter(one, frame, frames);
+        double multi = timeFilter(pool, frame, frames);
+        size_t bytes = (size_t)one->outWidth * one->outHeight * sizeof(uint32_t);
+        bool match = !memcmp(one->out, pool->out, bytes);
+        same = same && match;
+
+        printf("%-8s %dx %4dx%-4d  1 thread %6.3f ms  %2d threads %6.3f ms  (%.0f%% of a 60 Hz frame)%s\n",
+               runs[i].name, one->scale, one->outWidth, one->outHeight, single * 1e3, pool->threads + 1,
+               multi * 1e3, multi * 60 * 100, match ? "" : "  MISMATCH");
+        freeFilter(one);
+        freeFilter(pool);
+    }
+
+    free(frame);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
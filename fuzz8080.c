@@ -0,0 +1,257 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "8080.h"
+#include "Ref8080.h"
+
+// Differential fuzzer: random register states and instruction streams run
+// on emulate8080() and on the reference in Ref8080.c, checked after every
+// instruction (registers, flags, interrupt enable, halt, cycles, every
+// memory write and port output). Stops at the first divergence.
+#define STEPS_PER_TRIAL 32
+#define CODE_BYTES (3 * STEPS_PER_TRIAL)
+
+typedef struct
+{
+    int writes;
+    uint16_t addr[REF_MAX_WRITES];
+    int outs;
+    uint8_t outPort;
+    uint8_t outValue;
+} Effects;
+
+// Registers of the reference before a step, for the report
+typedef struct
+{
+    uint8_t reg[8];
+    uint8_t flags;
+    uint16_t sp;
+    uint16_t pc;
+    bool inte;
+} Registers;
+
+static uint64_t rngState;
+
+static uint64_t rng(void)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Both sides read the same made up value from every port
+static uint8_t fuzzIn(void *ctx, uint8_t port)
+{
+    (void)ctx;
+    return (uint8_t)(port * 7 + 0x35);
+}
+
+static void fuzzOut(void *ctx, uint8_t port, uint8_t value)
+{
+    Effects *e = ctx;
+    e->outs++;
+    e->outPort = port;
+    e->outValue = value;
+}
+
+static void coreWrite(void *ctx, uint16_t addr, uint8_t value)
+{
+    (void)value;
+    Effects *e = ctx;
+    if (e->writes < REF_MAX_WRITES)
+        e->addr[e->writes] = addr;
+    e->writes++;
+}
+
+static uint8_t coreFlags(const State *s)
+{
+    return (uint8_t)(s->codes->c | REF_FLAGS_FIXED | (s->codes->p << 2) | (s->codes->ac << 4)
+                     | (s->codes->z << 6) | (s->codes->s << 7));
+}
+
+static void randomize(State *core, Ref8080 *ref)
+{
+    uint64_t r = rng();
+    ref->pc = (uint16_t)r;
+    ref->sp = (uint16_t)(r >> 16);
+    ref->flags = (uint8_t)(((r >> 32) & 0xD5) | REF_FLAGS_FIXED);
+    ref->inte = (r >> 40) & 1;
+    ref->halted = false;
+
+    r = rng();
+    for (int i = 0; i < 8; i++)
+        ref->reg[i] = (uint8_t)(r >> (8 * i));
+
+    // Fresh code at PC, the rest of memory is whatever earlier trials left
+    for (int i = 0; i < CODE_BYTES; i++)
+    {
+        uint8_t byte = (uint8_t)rng();
+        ref->mem[(uint16_t)(ref->pc + i)] = byte;
+        core->mem[(uint16_t)(ref->pc + i)] = byte;
+    }
+
+    core->pc = ref->pc;
+    core->sp = ref->sp;
+    core->b = ref->reg[0];
+    core->c = ref->reg[1];
+    core->d = ref->reg[2];
+    core->e = ref->reg[3];
+    core->h = ref->reg[4];
+    core->l = ref->reg[5];
+    core->a = ref->reg[7];
+    core->f = ref->flags;
+    core->int_en = ref->inte;
+    core->halted = false;
+    core->codes->c = ref->flags & REF_CY;
+    core->codes->p = (ref->flags & REF_P) != 0;
+    core->codes->ac = (ref->flags & REF_AC) != 0;
+    core->codes->z = (ref->flags & REF_Z) != 0;
+    core->codes->s = (ref->flags & REF_S) != 0;
+}
+
+// What differs after a step, NULL if nothing
+static const char *compare(const State *core, const Ref8080 *ref, int coreCycles, int refCycles,
+                           const Effects *coreFx, const Effects *refFx)
+{
+    // A halted core sits on its HLT, the reference has gone past it
+    if (core->halted != ref->halted) return "halt";
+    if ((uint16_t)(core->pc + core->halted) != ref->pc) return "PC";
+    if (core->sp != ref->sp) return "SP";
+    if (core->a != ref->reg[7]) return "A";
+    if (core->b != ref->reg[0] || core->c != ref->reg[1]) return "BC";
+    if (core->d != ref->reg[2] || core->e != ref->reg[3]) return "DE";
+    if (core->h != ref->reg[4] || core->l != ref->reg[5]) return "HL";
+    if (coreFlags(core) != ref->flags) return "flags";
+    if (core->int_en != ref->inte) return "interrupt enable";
+    if (coreCycles != refCycles) return "cycles";
+    if (coreFx->outs != refFx->outs || coreFx->outPort != refFx->outPort || coreFx->outValue != refFx->outValue)
+        return "port output";
+
+    // Every byte either side wrote has to match on both
+    if (coreFx->writes != ref->writeCount)
+        return "memory writes";
+    for (int i = 0; i < ref->writeCount && i < REF_MAX_WRITES; i++)
+    {
+        uint16_t a = ref->writeAddr[i];
+        uint16_t b = coreFx->addr[i];
+        if (core->mem[a] != ref->mem[a] || core->mem[b] != ref->mem[b])
+            return "memory";
+    }
+    return NULL;
+}
+
+static void printState(const char *name, uint16_t pc, uint16_t sp, const uint8_t *reg, uint8_t flags, bool inte)
+{
+    printf("  %-9s PC %04x SP %04x A %02x BC %02x%02x DE %02x%02x HL %02x%02x flags %c%c%c%c%c %s\n", name, pc,
+           sp, reg[7], reg[0], reg[1], reg[2], reg[3], reg[4], reg[5], (flags & REF_S) ? 'S' : '-',
+           (flags & REF_Z) ? 'Z' : '-', (flags & REF_AC) ? 'A' : '-', (flags & REF_P) ? 'P' : '-',
+           (flags & REF_CY) ? 'C' : '-', inte ? "EI" : "DI");
+}
+
+static void usage(void)
+{
+    printf("usage: fuzz8080 [millions of instructions [seed]]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 3)
+        usage();
+    char *end = "";
+    double millions = argc > 1 ? strtod(argv[1], &end) : 10;
+    if (*end != '\0' || !(millions > 0 && millions < 1e12))
+        usage();
+    uint64_t seed = argc > 2 ? strtoull(argv[2], &end, 0) : 1;
+    if (*end != '\0')
+        usage();
+    uint64_t total = (uint64_t)(millions * 1e6);
+    if (total == 0)
+        usage();
+    rngState = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    State *core = init8080();
+    Ref8080 *ref = calloc(1, sizeof(Ref8080));
+    if (ref == NULL)
+    {
+        printf("Reference allocation failure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Effects coreFx;
+    Effects refFx;
+    portsInit(core->io, &coreFx);
+    for (int port = 0; port < PORT_COUNT; port++)
+    {
+        portsMapRead(core->io, (uint8_t)port, fuzzIn);
+        portsMapWrite(core->io, (uint8_t)port, fuzzOut);
+    }
+    memSetWriteHook(core->map, 0x0000, 0xFFFF, coreWrite, &coreFx);
+    ref->in = fuzzIn;
+    ref->out = fuzzOut;
+    ref->ctx = &refFx;
+
+    for (int i = 0; i < MEM_SIZE; i++)
+        core->mem[i] = ref->mem[i] = (uint8_t)rng();
+
+    double start = now();
+    uint64_t done = 0;
+    uint64_t trial = 0;
+    while (done < total)
+    {
+        randomize(core, ref);
+        for (int step = 0; step < STEPS_PER_TRIAL; step++, done++)
+        {
+            Registers before = {.flags = ref->flags, .sp = ref->sp, .pc = ref->pc, .inte = ref->inte};
+            memcpy(before.reg, ref->reg, sizeof(before.reg));
+            uint8_t bytes[3] = {ref->mem[ref->pc], ref->mem[(uint16_t)(ref->pc + 1)],
+                                ref->mem[(uint16_t)(ref->pc + 2)]};
+
+            memset(&coreFx, 0, sizeof(coreFx));
+            memset(&refFx, 0, sizeof(refFx));
+            int coreCycles = emulate8080(core);
+            int refCycles = refStep(ref);
+
+            const char *diff = compare(core, ref, coreCycles, refCycles, &coreFx, &refFx);
+            if (diff == NULL && ref->halted)
+                break; // nothing more to run without an interrupt
+            if (diff == NULL)
+                continue;
+
+            uint8_t coreReg[8] = {core->b, core->c, core->d, core->e, core->h, core->l, 0, core->a};
+            printf("Divergence in %s after %llu instructions (seed %llu, trial %llu, step %d)\n", diff,
+                   (unsigned long long)done, (unsigned long long)seed, (unsigned long long)trial, step);
+            printf("  opcode    %02x %02x %02x, cycles %d (reference %d)\n", bytes[0], bytes[1], bytes[2],
+                   coreCycles, refCycles);
+            printState("before", before.pc, before.sp, before.reg, before.flags, before.inte);
+            printState("8080.c", core->pc, core->sp, coreReg, coreFlags(core), core->int_en);
+            printState("reference", ref->pc, ref->sp, ref->reg, ref->flags, ref->inte);
+            return EXIT_FAILURE;
+        }
+        trial++;
+    }
+
+    if (done == 0)
+    {
+        printf("No instructions were compared\n");
+        return EXIT_FAILURE;
+    }
+
+    double elapsed = now() - start;
+    printf("%llu instructions in %llu trials agree, %.1f M instructions/s\n", (unsigned long long)done,
+           (unsigned long long)trial, done / elapsed / 1e6);
+    free(ref);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include "Machine.h"
+#include "GameState.h"
+#include "Snapshot.h"
+#include "Export.h"
+#include "Stream.h"
+#include "Replay.h"
+#include "Wav.h"
+
+// Runs the emulator without SDL, as fast as the host allows, for scripts,
+// benchmarks and recordings. Sound is mixed synchronously per frame so the
+// WAV output is deterministic.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    printf("usage: headless rom [-machine name] [-frames n] [-wav out.wav] [-samples dir | -synth] [-state]\n"
+           "                [-runahead n] [-trace file] [-rawtrace file] [-gdb port]\n"
+           "                [-capture file] [-nooverlay] [-background file.ppm]\n"
+           "                [-export name] [-stream port] [-noaot] [-replay file]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage();
+
+    const char *romPath = argv[1];
+    const char *wavPath = NULL;
+    const char *sampleDir = "samples";
+    const char *machineName = NULL;
+    bool synth = false;
+    bool printState = false;
+    bool aot = true;
+    int runAhead = -1;
+    long frames = -1; // 600, or all of a replay
+    const char *tracePath = NULL;
+    bool traceCompress = true;
+    int gdbPort = 0;
+    const char *capturePath = NULL;
+    bool overlay = true;
+    const char *backgroundPath = NULL;
+    const char *exportName = NULL;
+    int streamPort = 0;
+    const char *replayPath = NULL;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+            frames = strtol(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-wav") && i + 1 < argc)
+            wavPath = argv[++i];
+        else if (!strcmp(argv[i], "-samples") && i + 1 < argc)
+            sampleDir = argv[++i];
+        else if (!strcmp(argv[i], "-machine") && i + 1 < argc)
+            machineName = argv[++i];
+        else if (!strcmp(argv[i], "-synth"))
+            synth = true;
+        else if (!strcmp(argv[i], "-state"))
+            printState = true;
+        else if (!strcmp(argv[i], "-runahead") && i + 1 < argc)
+            runAhead = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-trace") || !strcmp(argv[i], "-rawtrace")) && i + 1 < argc)
+        {
+            traceCompress = !strcmp(argv[i], "-trace");
+            tracePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-gdb") && i + 1 < argc)
+            gdbPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-capture") && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (!strcmp(argv[i], "-noaot"))
+            aot = false;
+        else if (!strcmp(argv[i], "-nooverlay"))
+            overlay = false;
+        else if (!strcmp(argv[i], "-background") && i + 1 < argc)
+            backgroundPath = argv[++i];
+        else if (!strcmp(argv[i], "-export") && i + 1 < argc)
+            exportName = argv[++i];
+        else if (!strcmp(argv[i], "-stream") && i + 1 < argc)
+            streamPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-replay") && i + 1 < argc)
+            replayPath = argv[++i];
+        else
+            usage();
+    }
+
+    if (frames < 0)
+        frames = replayPath != NULL ? LONG_MAX : 600;
+
+    const MachineDesc *desc = findMachine(machineName);
+    if (desc == NULL)
+    {
+        printf("Unknown machine %s\n", machineName);
+        exit(EXIT_FAILURE);
+    }
+
+    Machine *machine = initMachine(desc);
+    if (!loadROM(machine, romPath))
+    {
+        printf("File could not be opened\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!aot)
+        machine->aot = NULL;
+    if (!overlay)
+        machineSetOverlay(machine, false);
+    if (backgroundPath != NULL && !loadBackground(machine, backgroundPath))
+    {
+        printf("%s is not a binary PPM\n", backgroundPath);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *wav = NULL;
+    if (wavPath != NULL)
+    {
+        wav = wavOpen(wavPath, SOUND_RATE);
+        if (wav == NULL)
+        {
+            printf("%s could not be created\n", wavPath);
+            exit(EXIT_FAILURE);
+        }
+        machine->sound = synth ? initSynthSound() : initSound(sampleDir);
+    }
+
+    if (tracePath != NULL)
+    {
+        machine->trace = initTrace(tracePath, traceCompress);
+        if (machine->trace == NULL)
+        {
+            printf("%s could not be created\n", tracePath);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (capturePath != NULL
+        && (machine->capture = initCapture(capturePath, desc->screenWidth, desc->screenHeight)) == NULL)
+    {
+        printf("%s could not be created\n", capturePath);
+        exit(EXIT_FAILURE);
+    }
+
+    // Speculative frames would hit breakpoints again when they're rerun
+    if (gdbPort != 0 && runAhead > 0)
+    {
+        printf("-gdb can't be combined with -runahead\n");
+        exit(EXIT_FAILURE);
+    }
+    if (gdbPort != 0 && (machine->debugger = initDebugger(machine->state8080, gdbPort)) == NULL)
+    {
+        printf("Port %d could not be opened\n", gdbPort);
+        exit(EXIT_FAILURE);
+    }
+
+    Export *export = NULL;
+    if (exportName != NULL && (export = initExport(exportName, machine)) == NULL)
+    {
+        printf("Shared memory %s could not be created\n", exportName);
+        exit(EXIT_FAILURE);
+    }
+
+    Stream *stream = NULL;
+    size_t vramSize = (size_t)desc->screenWidth * desc->screenHeight / 8;
+    if (streamPort != 0 && (stream = initStream(streamPort, desc->screenWidth, desc->screenHeight, vramSize)) == NULL)
+    {
+        printf("Port %d could not be opened\n", streamPort);
+        exit(EXIT_FAILURE);
+    }
+
+    Replay *replay = NULL;
+    if (replayPath != NULL && (replay = initReplay(replayPath, desc, false)) == NULL)
+    {
+        printf("%s is not a replay for %s\n", replayPath, desc->name);
+        exit(EXIT_FAILURE);
+    }
+
+    Snapshot *snapshot = initSnapshot(machine);
+    double frameTotal = 0;
+    double frameWorst = 0;
+    double exportTotal = 0;
+    double exportWorst = 0;
+
+    int16_t pcm[SOUND_FRAME_SAMPLES];
+    double runStart = now();
+    for (long frame = 0; frame < frames; frame++)
+    {
+        if (replay != NULL && !replayFrame(replay, machine))
+        {
+            frames = frame;
+            break;
+        }
+
+        if (runAhead >= 0)
+        {
+            double start = now();
+            runAheadFrame(machine, snapshot, runAhead);
+            double elapsed = now() - start;
+            frameTotal += elapsed;
+            frameWorst = elapsed > frameWorst ? elapsed : frameWorst;
+        }
+        else
+            runFrame(machine);
+
+        if (export != NULL)
+        {
+            double start = now();
+            exportFrame(export, machine);
+            double elapsed = now() - start;
+            exportTotal += elapsed;
+            exportWorst = elapsed > exportWorst ? elapsed : exportWorst;
+        }
+        if (stream != NULL)
+            streamFrame(stream, &(machine->state8080->mem[desc->vramAddr]));
+
+        if (wav != NULL)
+        {
+            soundMix(machine->sound, pcm, SOUND_FRAME_SAMPLES);
+            wavWrite(wav, pcm, SOUND_FRAME_SAMPLES);
+        }
+        if (printState)
+        {
+            GameState gs;
+            readGameState(machine, &gs);
+            printf("%ld score %u %u hi %u credits %u player %d ships %u x %u aliens %d shot %u %u,%u\n",
+                   frame, gs.score[0], gs.score[1], gs.highScore, gs.credits, gs.player + 1,
+                   gs.ships, gs.playerX, gs.alienCount, gs.shotStatus, gs.shot.x, gs.shot.y);
+        }
+    }
+
+    double runTime = now() - runStart;
+
+    if (wav != NULL)
+        wavClose(wav);
+
+    // Game time against wall time, for soak runs
+    if (!printState && frames > 0)
+        printf("%ld frames, %.1f minutes of game time in %.2f s: %.0fx real time%s\n", frames, frames / 3600.0,
+               runTime, frames / 60.0 / runTime, machine->aot != NULL ? ", translated ROM" : "");
+
+    if (runAhead >= 0 && frames > 0)
+    {
+        int reps = 10000;
+        double start = now();
+        for (int i = 0; i < reps; i++)
+        {
+            saveSnapshot(machine, snapshot);
+            loadSnapshot(machine, snapshot);
+        }
+        double snapTime = (now() - start) / reps;
+
+        printf("run-ahead %d: %.3f ms average, %.3f ms worst per frame (budget %.1f ms)\n",
+               runAhead, frameTotal / frames * 1e3, frameWorst * 1e3, 1e3 / 60);
+        printf("snapshot of %zu bytes: %.2f us to save and load\n", snapshot->ramSize, snapTime * 1e6);
+    }
+    freeSnapshot(snapshot);
+
+    if (export != NULL)
+    {
+        if (frames > 0)
+            printf("export: %.2f us average, %.2f us worst per frame\n", exportTotal / frames * 1e6,
+                   exportWorst * 1e6);
+        freeExport(export);
+    }
+
+    if (stream != NULL)
+    {
+        printf("stream: %llu frames sent to clients, %llu bytes, %llu dropped with the server behind\n",
+               (unsigned long long)atomic_load(&(stream->framesSent)),
+               (unsigned long long)atomic_load(&(stream->bytesSent)),
+               (unsigned long long)atomic_load(&(stream->dropped)));
+        freeStream(stream);
+    }
+
+    if (replay != NULL)
+        freeReplay(replay);
+    freeMachine(machine);
+    return 0;
+}
@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "Lockstep.h"
+#include "Rom.h"
+
+// Aggregate emulation speed of N machines run one after the other with
+// runFrame() against the same N machines in a Lockstep, then checks that both
+// ended up in exactly the same state.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Used when no ROM is given: a register heavy loop with a branch that
+// depends on a per-lane seed at 0x20C0, so lanes split and merge again
+static const uint8_t builtinProgram[] = {
+    [0x00] = 0xC3, 0x40, 0x00,       // JMP 0040
+    [0x08] = 0xFB, 0xC9,             // EI; RET
+    [0x10] = 0xFB, 0xC9,             // EI; RET
+    [0x40] = 0x31, 0x00, 0x24,       // LXI SP,2400
+    0xFB,                            // EI
+    0x3A, 0xC0, 0x20,                // LDA 20C0
+    0x4F,                            // MOV C,A
+    0x06, 0x00,                      // 0048: MVI B,00
+    0x21, 0x00, 0x00,                // LXI H,0000
+    0x78,                            // 004D: MOV A,B
+    0x81,                            // ADD C
+    0xEE, 0x5A,                      // XRI 5A
+    0x57,                            // MOV D,A
+    0x07,                            // RLC
+    0x5F,                            // MOV E,A
+    0x19,                            // DAD D
+    0x04,                            // INR B
+    0x79,                            // MOV A,C
+    0xA0,                            // ANA B
+    0xE6, 0x0F,                      // ANI 0F
+    0xC2, 0x62, 0x00,                // JNZ 0062
+    0x7D,                            // MOV A,L
+    0x32, 0x00, 0x21,                // STA 2100
+    0x0C,                            // INR C
+    0x78,                            // 0062: MOV A,B
+    0xFE, 0x00,                      // CPI 00
+    0xC2, 0x4D, 0x00,                // JNZ 004D
+    0xC3, 0x48, 0x00,                // JMP 0048
+};
+
+static uint32_t mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Coin and start early on, then a different stream of moves per lane
+static void driveInputs(Machine *m, int lane, long frame)
+{
+    uint32_t r = mix((uint32_t)lane * 2654435761u ^ (uint32_t)(frame / 8) * 40503u);
+    machineSetInput(m, INPUT_COIN, frame >= 60 && frame < 64);
+    machineSetInput(m, INPUT_START1, frame >= 120 && frame < 124);
+    machineSetInput(m, INPUT_LEFT, (r & 3) == 1);
+    machineSetInput(m, INPUT_RIGHT, (r & 3) == 2);
+    machineSetInput(m, INPUT_FIRE, (r & 4) != 0);
+}
+
+static Machine **initPool(const char *romPath, int lanes)
+{
+    Machine **pool = malloc(sizeof(Machine *) * lanes);
+    RomImage *rom = romPath != NULL ? openROM(findMachine(NULL), romPath) : NULL;
+    if (pool == NULL)
+        exit(EXIT_FAILURE);
+    if (romPath != NULL && rom == NULL)
+    {
+        printf("File could not be opened\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < lanes; i++)
+    {
+        pool[i] = initMachine(findMachine(NULL));
+        if (romPath == NULL)
+        {
+            memcpy(pool[i]->state8080->mem, builtinProgram, sizeof(builtinProgram));
+            pool[i]->state8080->mem[0x20C0] = (uint8_t)mix((uint32_t)i);
+        }
+        else
+            applyROM(pool[i], rom);
+    }
+    if (rom != NULL)
+        freeROM(rom);
+    return pool;
+}
+
+static bool sameMachine(const Machine *x, const Machine *y)
+{
+    const State *a = x->state8080;
+    const State *b = y->state8080;
+    return a->pc == b->pc && a->sp == b->sp && a->a == b->a
+        && a->bc == b->bc && a->de == b->de && a->hl == b->hl
+        && a->int_en == b->int_en && !memcmp(a->codes, b->codes, sizeof(Codes))
+        && x->interruptNum == y->interruptNum
+        && !memcmp(a->mem, b->mem, MEM_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *romPath = (argc > 1 && strcmp(argv[1], "-")) ? argv[1] : NULL;
+    int lanes = argc > 2 ? atoi(argv[2]) : 256;
+    long frames = argc > 3 ? atol(argv[3]) : 600;
+    if (lanes <= 0 || frames <= 0)
+    {
+        printf("usage: lockstepbench [rom | -] [lanes] [frames]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Machine **scalar = initPool(romPath, lanes);
+    Machine **vector = initPool(romPath, lanes);
+    Lockstep *ls = initLockstep(vector, lanes);
+    double cycles = (double)lanes * frames * scalar[0]->desc->cyclesPerFrame;
+
+    double start = now();
+    for (long frame = 0; frame < frames; frame++)
+    {
+        for (int i = 0; i < lanes; i++)
+        {
+            driveInputs(scalar[i], i, frame);
+            runFrame(scalar[i]);
+        }
+    }
+    double scalarTime = now() - start;
+
+    start = now();
+    for (long frame = 0; frame < frames; frame++)
+    {
+        for (int i = 0; i < lanes; i++)
+            driveInputs(vector[i], i, frame);
+        lockstepRunFrame(ls);
+    }
+    double vectorTime = now() - start;
+
+    int mismatches = 0;
+    for (int i = 0; i < lanes; i++)
+        mismatches += !sameMachine(scalar[i], vector[i]);
+
+    double retired = (double)(ls->vectorLanes + ls->scalarLanes);
+    printf("%d lanes x %ld frames of %s\n", lanes, frames, romPath ? romPath : "the built-in loop");
+    printf("independent: %.3f s, %.1f MHz aggregate\n", scalarTime, cycles / scalarTime / 1e6);
+    printf("lockstep:    %.3f s, %.1f MHz aggregate (x%.2f)\n", vectorTime, cycles / vectorTime / 1e6, scalarTime / vectorTime);
+    printf("vector steps: %llu, %.1f%% of instructions, %.1f lanes per step\n",
+           (unsigned long long)ls->vectorSteps, retired > 0 ? 100.0 * ls->vectorLanes / retired : 0.0,
+           ls->vectorSteps ? (double)ls->vectorLanes / ls->vectorSteps : 0.0);
+    printf("final state: %s (%d of %d lanes differ)\n", mismatches ? "MISMATCH" : "identical", mismatches, lanes);
+
+    freeLockstep(ls);
+    for (int i = 0; i < lanes; i++)
+    {
+        freeMachine(scalar[i]);
+        freeMachine(vector[i]);
+    }
+    free(scalar);
+    free(vector);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
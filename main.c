@@ -2,13 +2,99 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <SDL2/SDL.h>
-#include "SpaceInvaders.h"
+#include "Machine.h"
+#include "Rom.h"
+#include "Snapshot.h"
+#include "Export.h"
+#include "Stream.h"
+#include "Netplay.h"
+#include "Filter.h"
+#include "Replay.h"
 
 
-void handleEvents(SpaceInvaders *si, SDL_Event *event, bool *done)
+// Keyboard to cabinet controls, -1 for unmapped keys
+static int keyToInput(int sym)
+{
+    switch (sym)
+    {
+        case SDLK_c: return INPUT_COIN;       // coin
+        case SDLK_RETURN: return INPUT_START1; // 1 player game
+        case SDLK_SPACE: return INPUT_FIRE;    // shoot
+        case SDLK_LEFT: return INPUT_LEFT;
+        case SDLK_RIGHT: return INPUT_RIGHT;
+        case SDLK_t: return INPUT_TILT;        // tilt
+    }
+    return -1;
+}
+
+// The same keys as ACTION_ bits, for netplay where the inputs go over the
+// wire before reaching the machine
+static uint8_t inputToAction(int input)
+{
+    switch (input)
+    {
+        case INPUT_COIN: return ACTION_COIN;
+        case INPUT_START1: return ACTION_START;
+        case INPUT_FIRE: return ACTION_FIRE;
+        case INPUT_LEFT: return ACTION_LEFT;
+        case INPUT_RIGHT: return ACTION_RIGHT;
+    }
+    return 0;
+}
+
+// Emulation speed, changed at runtime with tab (unthrottled), - and =
+// (halve, double) and [ and ] (frame skip)
+#define SPEED_MIN 0.25
+#define SPEED_MAX 16
+#define FRAMESKIP_MAX 9
+
+typedef struct
+{
+    double multiplier; // of the cabinet's 60 frames per second
+    bool unthrottled;
+    int frameSkip; // frames not rendered after each one that is
+
+    // Pacing: frames run since base
+    uint64_t base;
+    uint64_t frames;
+    int sinceRender;
+
+    // Emulated against real speed, shown in the title once a second
+    uint64_t reportStart;
+    uint64_t reportFrames;
+} Speed;
+
+// Pacing restarts from now after any change
+static void speedKey(Speed *speed, int sym)
+{
+    switch (sym)
+    {
+        case SDLK_TAB: speed->unthrottled = !speed->unthrottled; break;
+        case SDLK_MINUS:
+            speed->multiplier = speed->multiplier / 2 < SPEED_MIN ? SPEED_MIN : speed->multiplier / 2;
+            break;
+        case SDLK_EQUALS:
+            speed->multiplier = speed->multiplier * 2 > SPEED_MAX ? SPEED_MAX : speed->multiplier * 2;
+            break;
+        case SDLK_LEFTBRACKET:
+            speed->frameSkip = speed->frameSkip > 0 ? speed->frameSkip - 1 : 0;
+            break;
+        case SDLK_RIGHTBRACKET:
+            speed->frameSkip = speed->frameSkip < FRAMESKIP_MAX ? speed->frameSkip + 1 : FRAMESKIP_MAX;
+            break;
+        default: return;
+    }
+    speed->base = SDL_GetPerformanceCounter();
+    speed->frames = 0;
+}
+
+// Keys drive the machine directly, or only update *action when it's given.
+// speed is NULL when it can't be changed.
+void handleEvents(Machine *m, SDL_Event *event, bool *done, uint8_t *action, Speed *speed)
 {
     while (SDL_PollEvent(event) != 0)
     {
@@ -16,144 +102,343 @@ void handleEvents(SpaceInvaders *si, SDL_Event *event, bool *done)
         {
             case SDL_QUIT: *done = true; break;
 
-            // Key has been pressed
+            // Key has been pressed or released
             case SDL_KEYDOWN:
-            {
-                switch (event->key.keysym.sym)
-                {
-                    // coin
-                    case SDLK_c:
-                    {
-                        printf("c pressed\n");
-                        si->port1 |= 0b00000001;
-                    }
-
-                    // 1 player game
-                    case SDLK_RETURN:
-                    {
-                        si->port1 |= 0b00000100;
-                        break;
-                    }
-
-                    // shoot
-                    case SDLK_SPACE:
-                    {
-                        si->port1 |= 0b00010000;
-                        break;
-                    }
-
-                    case SDLK_LEFT:
-                    {
-                        si->port1 |= 0b00100000;
-                        break;
-                    }
-                    
-                    case SDLK_RIGHT:
-                    {
-                        si->port1 |= 0b01000000;
-                        break;
-                    }
-
-                    // tilt
-                    case SDLK_t:
-                    {
-                        si->port2 |= 0b00000100;
-                        break;
-                    }
-                }
-                break;
-            }
-
-            // Key released
             case SDL_KEYUP:
             {
-                switch (event->key.keysym.sym)
-                {
-                    // coin
-                    case SDLK_c:
-                    {
-                        si->port1 &= ~(0b00000001);
-                    }
-
-                    // 1 player game
-                    case SDLK_RETURN:
-                    {
-                        si->port1 &= ~(0b00000100);
-                        break;
-                    }
-
-                    // shoot
-                    case SDLK_SPACE:
-                    {
-                        si->port1 &= ~(0b00010000);
-                        break;
-                    }
-
-                    // left
-                    case SDLK_LEFT:
-                    {
-                        si->port1 &= ~(0b00100000);
-                        break;
-                    }
-                    
-                    // right
-                    case SDLK_RIGHT:
-                    {
-                        si->port1 &= ~(0b01000000);
-                        break;
-                    }
-
-                    // tilt
-                    case SDLK_t:
-                    {
-                        si->port2 &= ~(0b00000100);
-                        break;
-                    }
-                }
+                if (speed != NULL && event->type == SDL_KEYDOWN && !event->key.repeat)
+                    speedKey(speed, event->key.keysym.sym);
+
+                int input = keyToInput(event->key.keysym.sym);
+                if (input < 0)
+                    break;
+
+                if (action == NULL)
+                    machineSetInput(m, (Input)input, event->type == SDL_KEYDOWN);
+                else if (event->type == SDL_KEYDOWN)
+                    *action |= inputToAction(input);
+                else
+                    *action &= (uint8_t)~inputToAction(input);
                 break;
             }
         }
     }
 }
 
-// Interface between SDL and SI struct
-void updateScreen(SpaceInvaders *si,  SDL_Texture *texture)
+// Pull mixed audio from the sound subsystem's ring buffer
+static void audioCallback(void *userdata, Uint8 *stream, int len)
+{
+    soundRead((Sound *)userdata, (int16_t *)stream, len / (int)sizeof(int16_t));
+}
+
+// Run the frames due at the current speed, then render the last one unless
+// it is to be skipped. Returns true when there is a new frame to show.
+static bool runFrames(Machine *m, Snapshot *snapshot, int runAhead, Speed *speed, Export *export, Stream *stream,
+                      Replay *replay)
+{
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+    int ran = 0;
+    for (;;)
+    {
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (!speed->unthrottled
+            && (double)(now - speed->base) * 60 * speed->multiplier < (double)(speed->frames + 1) * frequency)
+            break;
+
+        // Stop short of a display frame so the present after it still makes
+        // the next vsync. A machine too slow for the speed asked for runs as
+        // fast as it can instead of trying to catch up.
+        if (ran > 0 && now - start > frequency / 60 - frequency / 500)
+        {
+            speed->base = now;
+            speed->frames = 0;
+            break;
+        }
+
+        if (replay != NULL)
+            replayFrame(replay, m);
+        runFrame(m);
+        if (export != NULL)
+            exportFrame(export, m);
+        if (stream != NULL)
+            streamFrame(stream, &(m->state8080->mem[m->desc->vramAddr]));
+        speed->frames++;
+        speed->reportFrames++;
+        ran++;
+    }
+
+    speed->sinceRender += ran;
+    if (ran == 0 || speed->sinceRender <= speed->frameSkip)
+        return false;
+    speed->sinceRender = 0;
+    renderAhead(m, snapshot, runAhead);
+    return true;
+}
+
+// Interface between SDL and the machine's screen buffer, upscaled first
+// when a filter is set
+void updateScreen(Machine *m, Filter *filter, SDL_Texture *texture)
 {
-    const uint32_t pitch = sizeof(uint8_t) * 4 * SCREEN_WIDTH;
-    SDL_UpdateTexture(texture, NULL, (si->screenBuffer), pitch);
+    if (filter == NULL)
+    {
+        const uint32_t pitch = sizeof(uint8_t) * 4 * m->desc->screenWidth;
+        SDL_UpdateTexture(texture, NULL, (m->screenBuffer), pitch);
+        return;
+    }
+
+    filterFrame(filter, (const uint32_t *)m->screenBuffer);
+    SDL_UpdateTexture(texture, NULL, filter->out, filter->outWidth * (int)sizeof(uint32_t));
 }
 
 int main(int argc, char **argv)
 {   
-    FILE *f = fopen(argv[1], "rb");
-    if (f == NULL)
+    // si rom [samples dir | -synth] [machine], plus options anywhere after
+    // the ROM
+    const char *args[3] = {NULL, "samples", NULL};
+    int argCount = 0;
+    int runAhead = 0;
+    int netPlayer = 0; // 1 or 2 when playing over the network
+    int netPort = 0;
+    char netHost[256] = "";
+    int netDelay = 1;
+    const char *tracePath = NULL;
+    int gdbPort = 0;
+    const char *capturePath = NULL;
+    const char *filterName = NULL;
+    int filterScale = 3;
+    int filterThreads = -1;
+    bool overlay = true;
+    const char *backgroundPath = NULL;
+    const char *exportName = NULL;
+    int streamPort = 0;
+    const char *recordPath = NULL;
+    Speed speed = {.multiplier = 1};
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-runahead") && i + 1 < argc)
+            runAhead = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-netplay") && i + 3 < argc)
+        {
+            netPlayer = atoi(argv[++i]);
+            netPort = atoi(argv[++i]);
+            snprintf(netHost, sizeof(netHost), "%s", argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-delay") && i + 1 < argc)
+            netDelay = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (!strcmp(argv[i], "-gdb") && i + 1 < argc)
+            gdbPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-capture") && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (!strcmp(argv[i], "-filter") && i + 1 < argc)
+            filterName = argv[++i];
+        else if (!strcmp(argv[i], "-scale") && i + 1 < argc)
+            filterScale = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-filterthreads") && i + 1 < argc)
+            filterThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-nooverlay"))
+            overlay = false;
+        else if (!strcmp(argv[i], "-background") && i + 1 < argc)
+            backgroundPath = argv[++i];
+        else if (!strcmp(argv[i], "-export") && i + 1 < argc)
+            exportName = argv[++i];
+        else if (!strcmp(argv[i], "-stream") && i + 1 < argc)
+            streamPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-record") && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (!strcmp(argv[i], "-speed") && i + 1 < argc)
+        {
+            // 0 for as fast as possible
+            double multiplier = atof(argv[++i]);
+            speed.unthrottled = multiplier <= 0;
+            if (multiplier > 0)
+                speed.multiplier = multiplier < SPEED_MIN ? SPEED_MIN : multiplier > SPEED_MAX ? SPEED_MAX : multiplier;
+        }
+        else if (!strcmp(argv[i], "-frameskip") && i + 1 < argc)
+        {
+            int skip = atoi(argv[++i]);
+            speed.frameSkip = skip < 0 ? 0 : skip > FRAMESKIP_MAX ? FRAMESKIP_MAX : skip;
+        }
+        else if (argCount < 3)
+            args[argCount++] = argv[i];
+    }
+
+    // optional third argument picks the board, Space Invaders by default
+    const MachineDesc *desc = findMachine(args[2]);
+    if (desc == NULL)
+    {
+        printf("Unknown machine %s\n", args[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    // With EMBED_ROM the ROM argument can be left out, or given as -
+    Machine *machine = initMachine(desc);
+    if (args[0] == NULL && embeddedROM())
+        args[0] = "-";
+    if (args[0] == NULL || !loadROM(machine, args[0]))
     {
         printf("File could not be opened\n");
         exit(EXIT_FAILURE);
     }
 
-    int fd = fileno(f);
-    struct stat st;
+    // The board's colour overlay, and the picture behind the screen
+    if (!overlay)
+        machineSetOverlay(machine, false);
+    if (backgroundPath != NULL && !loadBackground(machine, backgroundPath))
+    {
+        printf("%s is not a binary PPM\n", backgroundPath);
+        exit(EXIT_FAILURE);
+    }
+
+    // -trace records every instruction of the session for tracediff.
+    // Netplay runs frames on predicted inputs before rolling them back, so
+    // the trace would hold execution that didn't stand.
+    if (tracePath != NULL && netPlayer != 0)
+    {
+        printf("-trace can't be used with -netplay\n");
+        exit(EXIT_FAILURE);
+    }
+    if (tracePath != NULL && (machine->trace = initTrace(tracePath, true)) == NULL)
+    {
+        printf("%s could not be created\n", tracePath);
+        exit(EXIT_FAILURE);
+    }
+
+    // -capture records every frame emulated, encoded on its own thread
+    if (capturePath != NULL
+        && (machine->capture = initCapture(capturePath, desc->screenWidth, desc->screenHeight)) == NULL)
+    {
+        printf("%s could not be created\n", capturePath);
+        exit(EXIT_FAILURE);
+    }
+
+    // -export name publishes every frame to shared memory for other processes
+    Export *export = NULL;
+    if (exportName != NULL && (export = initExport(exportName, machine)) == NULL)
+    {
+        printf("Shared memory %s could not be created\n", exportName);
+        exit(EXIT_FAILURE);
+    }
+
+    // -stream port serves the frames to spectators from its own thread
+    Stream *stream = NULL;
+    size_t vramSize = (size_t)desc->screenWidth * desc->screenHeight / 8;
+    if (streamPort != 0 && (stream = initStream(streamPort, desc->screenWidth, desc->screenHeight, vramSize)) == NULL)
+    {
+        printf("Port %d could not be opened\n", streamPort);
+        exit(EXIT_FAILURE);
+    }
+
+    // -record file saves the inputs of every frame for headless -replay.
+    // Netplay's inputs arrive through rollbacks, so not with -netplay.
+    Replay *replay = NULL;
+    if (recordPath != NULL && netPlayer != 0)
+    {
+        printf("-record can't be used with -netplay\n");
+        exit(EXIT_FAILURE);
+    }
+    if (recordPath != NULL && (replay = initReplay(recordPath, desc, true)) == NULL)
+    {
+        printf("%s could not be created\n", recordPath);
+        exit(EXIT_FAILURE);
+    }
+
+    // -gdb port waits for GDB before the first instruction. Speculative and
+    // rolled back frames would hit breakpoints twice, so no run-ahead and no
+    // netplay.
+    if (gdbPort != 0)
+    {
+        runAhead = 0;
+        if (netPlayer != 0 || (machine->debugger = initDebugger(machine->state8080, gdbPort)) == NULL)
+        {
+            printf("Debugger initialization failure\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // samples directory is optional, defaults to ./samples. -synth
+    // synthesises the sound circuits instead.
+    if (!strcmp(args[1], "-synth"))
+        machine->sound = initSynthSound();
+    else
+        machine->sound = initSound(args[1]);
 
-    if (fstat(fd, &st) != 0)
+    // Run-ahead hides the frame of lag between reading the inputs and
+    // showing their effect
+    Snapshot *snapshot = initSnapshot(machine);
+
+    // -netplay <1|2> <local port> <host:port>, both sides pick a different
+    // player
+    Netplay *net = NULL;
+    uint8_t netAction = 0;
+    if (netPlayer != 0 && (speed.multiplier != 1 || speed.unthrottled || speed.frameSkip != 0))
+    {
+        printf("Both netplay peers run at normal speed, -speed and -frameskip can't be used\n");
         exit(EXIT_FAILURE);
-    int size = st.st_size;
+    }
+    if (netPlayer != 0)
+    {
+        char *colon = strrchr(netHost, ':');
+        if (colon != NULL)
+            *colon = '\0';
+        if (netPlayer < 1 || netPlayer > 2 || colon == NULL
+            || (net = initNetplay(machine, netPlayer - 1, netDelay, netPort, netHost, atoi(colon + 1))) == NULL)
+        {
+            printf("Netplay initialization failure\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    SpaceInvaders *spaceInvaders = initSpaceInvaders();
-    fread(spaceInvaders->state8080->mem, size, 1, f);
-    fclose(f);
+    // -filter nearest|scale2x|scale3x|scale4x|crt upscales on the CPU, the
+    // texture is then shown at its own size
+    Filter *filter = NULL;
+    FilterType filterType;
+    if (filterName != NULL)
+    {
+        if (!findFilter(filterName, &filterType))
+        {
+            printf("Unknown filter %s\n", filterName);
+            exit(EXIT_FAILURE);
+        }
+        filter = initFilter(filterType, filterScale, desc->screenWidth, desc->screenHeight, filterThreads);
+    }
+    int textureWidth = filter != NULL ? filter->outWidth : desc->screenWidth;
+    int textureHeight = filter != NULL ? filter->outHeight : desc->screenHeight;
 
     /* SDL initialization  */
 
-    if (SDL_Init(SDL_INIT_VIDEO))
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
     {
         printf("Initialization failure\n");
         exit(EXIT_FAILURE);
     }
 
+    // Small device buffers keep sound close to the picture
+    SDL_AudioSpec want;
+    SDL_zero(want);
+    want.freq = SOUND_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 256;
+    want.callback = audioCallback;
+    want.userdata = machine->sound;
+
+    SDL_AudioDeviceID audio = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (audio == 0)
+        printf("Audio initialization failure, continuing without sound\n");
+    else
+    {
+        soundStart(machine->sound, 2 * want.samples);
+        SDL_PauseAudioDevice(audio, 0);
+    }
+
     SDL_Window *window = SDL_CreateWindow("Space Invaders", SDL_WINDOWPOS_CENTERED,
-                                          SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH * 2,
-                                          SCREEN_HEIGHT * 2, SDL_WINDOW_RESIZABLE);
+                                          SDL_WINDOWPOS_CENTERED,
+                                          filter != NULL ? textureWidth : desc->screenWidth * 2,
+                                          filter != NULL ? textureHeight : desc->screenHeight * 2,
+                                          SDL_WINDOW_RESIZABLE);
 
     if (window == NULL)
     {
@@ -161,7 +446,7 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    SDL_SetWindowMinimumSize(window, SCREEN_WIDTH, SCREEN_HEIGHT);
+    SDL_SetWindowMinimumSize(window, desc->screenWidth, desc->screenHeight);
     SDL_ShowCursor(false);
 
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
@@ -175,7 +460,7 @@ int main(int argc, char **argv)
 
     SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
                                              SDL_TEXTUREACCESS_STREAMING,
-                                             SCREEN_WIDTH, SCREEN_HEIGHT);
+                                             textureWidth, textureHeight);
 
     if (texture == NULL)
     {
@@ -186,30 +471,81 @@ int main(int argc, char **argv)
     
     /* Main routine */
     uint32_t timer = SDL_GetTicks(); // starting time
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    speed.base = speed.reportStart = SDL_GetPerformanceCounter();
     bool done = false;
     SDL_Event event;
     while (!done)
     {
         // Poll the keyboard
-        handleEvents(spaceInvaders, &event, &done);
+        handleEvents(machine, &event, &done, net != NULL ? &netAction : NULL, net != NULL ? NULL : &speed);
+
+        bool show = false;
+        if (net == NULL)
+        {
+            show = runFrames(machine, snapshot, runAhead, &speed, export, stream, replay);
+            if (show)
+                updateScreen(machine, filter, texture);
+        }
 
-        // True every 1/60 seconds
-        if (SDL_GetTicks() - timer > ((float)1 / 60) * (float)1000)
+        // Netplay stays at one frame every 1/60 seconds on both sides
+        else if (SDL_GetTicks() - timer > ((float)1 / 60) * (float)1000)
         {
             timer = SDL_GetTicks();
-            runFrame(spaceInvaders);
-            updateBuffer(spaceInvaders);
-            updateScreen(spaceInvaders, texture);
+            show = true;
+            if (netAdvance(net, netAction))
+            {
+                // Rollback already did the looking ahead
+                updateBuffer(machine);
+                updateScreen(machine, filter, texture);
+                if (export != NULL)
+                    exportFrame(export, machine);
+                if (stream != NULL)
+                    streamFrame(stream, &(machine->state8080->mem[desc->vramAddr]));
+            }
         }
 
+        // Emulated against real speed
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (net == NULL && now - speed.reportStart >= frequency)
+        {
+            char title[128];
+            double percent = speed.reportFrames / 60.0 / ((double)(now - speed.reportStart) / frequency) * 100;
+            if (speed.unthrottled)
+                snprintf(title, sizeof(title), "Space Invaders - %.0f%% (unthrottled, skip %d)", percent,
+                         speed.frameSkip);
+            else
+                snprintf(title, sizeof(title), "Space Invaders - %.0f%% (x%g, skip %d)", percent, speed.multiplier,
+                         speed.frameSkip);
+            SDL_SetWindowTitle(window, title);
+            speed.reportStart = now;
+            speed.reportFrames = 0;
+        }
+
+        // Skipped frames aren't presented either, the loop just naps
+        if (!show)
+        {
+            SDL_Delay(1);
+            continue;
+        }
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
     }
     
-    free(spaceInvaders->state8080->codes);
-    free(spaceInvaders->state8080->mem);
-    free(spaceInvaders->state8080);
-    free(spaceInvaders);
+    if (audio != 0)
+        SDL_CloseAudioDevice(audio);
+    if (net != NULL)
+        freeNetplay(net);
+    if (filter != NULL)
+        freeFilter(filter);
+    if (export != NULL)
+        freeExport(export);
+    if (stream != NULL)
+        freeStream(stream);
+    if (replay != NULL)
+        freeReplay(replay);
+    freeSnapshot(snapshot);
+    freeMachine(machine);
     return 0;
 }
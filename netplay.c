@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "Netplay.h"
+
+// Loopback test of rollback netplay: both peers run in this process and
+// talk over UDP on localhost through a relay that adds latency, jitter and
+// loss. At the end both peers and a plain replay of the same inputs must
+// agree on the state of the last confirmed frame.
+#define RELAY_QUEUE 4096
+#define RELAY_PACKET 512
+
+typedef struct
+{
+    long due; // tick the packet is delivered
+    int to;   // port
+    int len;
+    uint8_t data[RELAY_PACKET];
+} Delayed;
+
+static void usage(void)
+{
+    printf("usage: netplay rom [-frames n] [-delay d] [-latency ticks] [-jitter ticks] [-loss percent] [-port p]\n");
+    exit(EXIT_FAILURE);
+}
+
+// Deterministic stand-in for a player: inserts coins and starts a two
+// player game, then wiggles and fires
+static uint8_t scriptInput(int player, uint32_t frame)
+{
+    if (player == 0 && ((frame >= 30 && frame < 36) || (frame >= 60 && frame < 66)))
+        return ACTION_COIN;
+    if (player == 1 && frame >= 120 && frame < 126)
+        return ACTION_START;
+
+    uint32_t r = (frame / 6 + 1) * 2654435761u ^ (uint32_t)(player + 1) * 40503u;
+    r ^= r >> 13;
+    r *= 0x5bd1e995;
+    r ^= r >> 15;
+    return (uint8_t)(r & (ACTION_FIRE | ACTION_LEFT | ACTION_RIGHT));
+}
+
+// Input of each player that is in effect in frame f
+static uint8_t appliedInput(int player, uint32_t f, int delay)
+{
+    return f < (uint32_t)delay ? 0 : scriptInput(player, f - (uint32_t)delay);
+}
+
+static int udpSocket(int port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        printf("Relay socket failure\n");
+        exit(EXIT_FAILURE);
+    }
+    return sock;
+}
+
+static Delayed queue[RELAY_QUEUE];
+static int queued = 0;
+
+// Move packets from the relay sockets into the delay queue, deliver the due
+// ones
+static void relay(const int *in, const int *out, long tick, int latency, int jitter, int loss)
+{
+    for (int side = 0; side < 2; side++)
+    {
+        Delayed d;
+        while ((d.len = (int)recv(in[side], d.data, sizeof(d.data), 0)) > 0)
+        {
+            if (rand() % 100 < loss || queued == RELAY_QUEUE)
+                continue;
+            d.due = tick + latency + (jitter > 0 ? rand() % (jitter + 1) : 0);
+            d.to = out[side];
+            queue[queued++] = d;
+        }
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < queued; i++)
+    {
+        if (queue[i].due > tick)
+            continue;
+
+        addr.sin_port = htons((uint16_t)queue[i].to);
+        sendto(in[0], queue[i].data, (size_t)queue[i].len, 0, (struct sockaddr *)&addr, sizeof(addr));
+        queue[i--] = queue[--queued];
+    }
+}
+
+static bool sameSnapshot(const Snapshot *a, const Snapshot *b)
+{
+    return a->pc == b->pc && a->sp == b->sp && a->psw == b->psw && a->bc == b->bc
+        && a->de == b->de && a->hl == b->hl && a->int_en == b->int_en
+        && !memcmp(&(a->codes), &(b->codes), sizeof(Codes))
+        && !memcmp(&(a->shifter), &(b->shifter), sizeof(Shifter))
+        && a->interruptNum == b->interruptNum
+        && !memcmp(a->inputs, b->inputs, sizeof(a->inputs))
+        && !memcmp(a->ram, b->ram, a->ramSize);
+}
+
+static void report(const char *name, const Netplay *n)
+{
+    printf("%s: %llu rollbacks, %llu frames resimulated (deepest %u), %llu stalls\n", name,
+           (unsigned long long)n->rollbacks, (unsigned long long)n->resimulated, n->maxDepth,
+           (unsigned long long)n->stalls);
+    if (n->resimulated > 0)
+        printf("%s: %.1f us per resimulated frame, worst rollback %.3f ms (budget %.1f ms)\n", name,
+               n->resimTime / n->resimulated * 1e6, n->worstRollback * 1e3, 1e3 / 60);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage();
+
+    long frames = 3600;
+    int delay = 1;
+    int latency = 4;
+    int jitter = 2;
+    int loss = 5;
+    int port = 47000;
+    for (int i = 2; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            usage();
+        else if (!strcmp(argv[i], "-frames"))
+            frames = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-delay"))
+            delay = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-latency"))
+            latency = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-jitter"))
+            jitter = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-loss"))
+            loss = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-port"))
+            port = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    Machine *machines[3];
+    for (int i = 0; i < 3; i++)
+    {
+        machines[i] = initMachine(findMachine(NULL));
+        if (!loadROM(machines[i], argv[1]))
+        {
+            printf("File could not be opened\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Each peer sends to its own relay socket, which forwards to the other
+    int relayIn[2] = {udpSocket(port + 2), udpSocket(port + 3)};
+    int relayOut[2] = {port + 1, port};
+    Netplay *peers[2] = {
+        initNetplay(machines[0], 0, delay, port, "127.0.0.1", port + 2),
+        initNetplay(machines[1], 1, delay, port + 1, "127.0.0.1", port + 3),
+    };
+    if (peers[0] == NULL || peers[1] == NULL)
+    {
+        printf("Netplay socket failure\n");
+        exit(EXIT_FAILURE);
+    }
+    delay = peers[0]->delay;
+    srand(1);
+
+    // Play, then keep idling until both peers have confirmed every input
+    // of the played frames
+    uint32_t target = (uint32_t)frames;
+    long tick = 0;
+    while (peers[0]->frame <= target || peers[1]->frame <= target
+           || peers[0]->remoteFrames <= target || peers[1]->remoteFrames <= target)
+    {
+        for (int p = 0; p < 2; p++)
+        {
+            relay(relayIn, relayOut, tick, latency, jitter, loss);
+            netAdvance(peers[p], scriptInput(p, peers[p]->frame));
+        }
+        tick++;
+    }
+
+    // One more step each applies any rollback the last inputs called for
+    for (int p = 0; p < 2; p++)
+        netAdvance(peers[p], 0);
+
+    // The same game without a network in between
+    Machine *replay = machines[2];
+    for (uint32_t f = 0; f < target; f++)
+    {
+        uint8_t p1 = appliedInput(0, f, delay);
+        uint8_t p2 = appliedInput(1, f, delay);
+        uint8_t coin = (p1 | p2) & ACTION_COIN;
+        machineSetAction(replay, 0, p1 | coin);
+        machineSetAction(replay, 1, p2 | coin);
+        runFrame(replay);
+    }
+    Snapshot *expected = initSnapshot(replay);
+    saveSnapshot(replay, expected);
+
+    const Snapshot *a = peers[0]->ring[target % NET_RING].snapshot;
+    const Snapshot *b = peers[1]->ring[target % NET_RING].snapshot;
+    bool synced = sameSnapshot(a, b);
+    bool replayed = sameSnapshot(a, expected);
+
+    printf("%u frames in %ld ticks, delay %d, latency %d+%d ticks, %d%% loss\n", target, tick, delay,
+           latency, jitter, loss);
+    report("peer 1", peers[0]);
+    report("peer 2", peers[1]);
+    printf("frame %u: peers %s, replay %s\n", target, synced ? "in sync" : "DESYNCED",
+           replayed ? "matches" : "DIFFERS");
+
+    freeSnapshot(expected);
+    for (int p = 0; p < 2; p++)
+    {
+        freeNetplay(peers[p]);
+        close(relayIn[p]);
+    }
+    for (int i = 0; i < 3; i++)
+        freeMachine(machines[i]);
+    return (synced && replayed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,311 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "Cfg.h"
+#include "Trace.h"
+#include "Translate.h"
+
+// Static analysis of a board's ROM: basic blocks, functions and their call
+// graph, and which bytes are code and which data. A trace (-trace) of a
+// real run supplies the PCHL targets and checks that nothing executed was
+// missed. -c translates the blocks to C for the emulator to link (Aot.h).
+#define MAX_ENTRIES 256
+
+static const char *kindNames[] = {"falls", "jump", "branch", "call", "return", "return if", "indirect", "halt",
+                                  "outside"};
+
+static uint8_t executed[MEM_SIZE]; // TRACE_ bits below, per PC
+#define TRACE_RAN 1
+#define TRACE_ENTERED 2 // jumped to by PCHL or a return
+static uint16_t enteredOrder[MEM_SIZE]; // TRACE_ENTERED PCs, first reached first
+static int enteredCount;
+
+static void usage(void)
+{
+    printf("usage: romcfg rom [-machine name] [-entry addr]... [-trace file] [-blocks] [-calls] [-map] "
+           "[-dot out.dot] [-c out.c]\n"
+           "  -entry   also start at addr (hex), a PCHL target for instance\n"
+           "  -trace   take the jump targets of a trace (headless -trace) as entries and check coverage\n"
+           "  -blocks  list every block, disassembled\n"
+           "  -calls   call graph, each function with what it calls\n"
+           "  -map     code and data ranges of the ROM\n"
+           "  -dot     write the blocks and edges for Graphviz\n"
+           "  -c       translate the blocks to C, see AOT_ROM in the Makefile\n");
+    exit(EXIT_FAILURE);
+}
+
+static bool readTrace(const char *path)
+{
+    TraceReader *r = openTrace(path);
+    if (r == NULL)
+        return false;
+
+    // Only PCHL and returns go where the analysis can't follow. Interrupts
+    // also jump, but return into code that has run before.
+    TraceRecord record;
+    uint32_t fallsTo = MEM_SIZE;
+    bool computed = false;
+    while (traceNext(r, &record))
+    {
+        executed[record.pc] |= TRACE_RAN;
+        if (computed && record.pc != fallsTo && !(executed[record.pc] & TRACE_ENTERED))
+        {
+            executed[record.pc] |= TRACE_ENTERED;
+            enteredOrder[enteredCount++] = record.pc;
+        }
+        fallsTo = (uint16_t)(record.pc + length8080(record.opcode));
+        computed = record.opcode == 0xE9 || record.opcode == 0xC9 || record.opcode == 0xD9
+                   || (record.opcode & 0xC7) == 0xC0;
+    }
+    closeTrace(r);
+    return true;
+}
+
+static const char *functionLabel(const Cfg *cfg, int function)
+{
+    static char label[16];
+    if (function < 0)
+        return "none";
+    snprintf(label, sizeof(label), "%04x", cfg->functions[function].entry);
+    return label;
+}
+
+static void printBlocks(const Cfg *cfg, uint8_t *mem)
+{
+    for (int i = 0; i < cfg->blockCount; i++)
+    {
+        const CfgBlock *b = &(cfg->blocks[i]);
+        printf("\nblock %04x-%04x in %s, %u instructions, %u cycles, %s", b->start, (unsigned)(b->end - 1),
+               functionLabel(cfg, b->function), b->count, b->cycles, kindNames[b->kind]);
+        if (b->hasTarget)
+            printf(" to %04x", b->target);
+        if (b->hasNext && b->kind != BLOCK_FALLS)
+            printf(" or on to %04x", (unsigned)(b->end & 0xFFFF));
+        printf("\n");
+
+        for (uint32_t pc = b->start; pc < b->end; pc += (uint32_t)length8080(mem[pc]))
+            disassemble8080(mem, pc);
+    }
+}
+
+static void printCalls(const Cfg *cfg)
+{
+    bool *seen = calloc((size_t)cfg->functionCount + 1, sizeof(bool));
+    if (seen == NULL)
+        exit(EXIT_FAILURE);
+
+    for (int f = 0; f < cfg->functionCount; f++)
+    {
+        const CfgFunction *fn = &(cfg->functions[f]);
+        printf("%04x %s%d blocks, %d instructions, %d callers, calls:", fn->entry,
+               fn->vector ? "vector, " : (fn->given ? "entry, " : ""), fn->blocks, fn->instructions, fn->callers);
+        memset(seen, 0, (size_t)cfg->functionCount * sizeof(bool));
+        for (int i = 0; i < cfg->blockCount; i++)
+        {
+            const CfgBlock *b = &(cfg->blocks[i]);
+            if (b->function != f || b->kind != BLOCK_CALL)
+                continue;
+            int callee = cfgFunctionAt(cfg, b->target);
+            if (callee < 0)
+                printf(" %04x(outside)", b->target);
+            else if (!seen[callee])
+                printf(" %04x", b->target);
+            if (callee >= 0)
+                seen[callee] = true;
+        }
+        printf("\n");
+    }
+    free(seen);
+}
+
+// Runs of code, of data (from an address something loads, up to the next
+// one or to code) and of bytes nothing reaches
+static void printMap(const Cfg *cfg)
+{
+    const uint8_t *flags = cfg->flags;
+    uint32_t addr = 0;
+    while (addr < MEM_SIZE)
+    {
+        if (!(flags[addr] & CFG_ROM))
+        {
+            addr++;
+            continue;
+        }
+
+        uint32_t start = addr;
+        bool code = flags[addr] & (CFG_CODE | CFG_OPERAND);
+        bool overlapping = false;
+        do
+        {
+            overlapping |= (flags[addr] & CFG_CONFLICT) != 0;
+            addr++;
+        } while (addr < MEM_SIZE && (flags[addr] & CFG_ROM) && code == ((flags[addr] & (CFG_CODE | CFG_OPERAND)) != 0)
+                 && (code || !(flags[addr] & CFG_DATA)));
+
+        printf("%04x-%04x %5u %s%s\n", start, addr - 1, addr - start,
+               code ? "code" : ((flags[start] & CFG_DATA) ? "data" : "unreached"), overlapping ? ", overlapping" : "");
+    }
+}
+
+static void writeDot(const Cfg *cfg, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        printf("Can't write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(f, "digraph rom {\n    node [shape=box fontname=monospace];\n");
+    for (int i = 0; i < cfg->blockCount; i++)
+    {
+        const CfgBlock *b = &(cfg->blocks[i]);
+        bool entry = b->function >= 0 && cfg->functions[b->function].entry == b->start;
+        fprintf(f, "    b%04x [label=\"%04x %s\\n%u ins %u cyc\"%s];\n", b->start, b->start, kindNames[b->kind],
+                b->count, b->cycles, entry ? " style=bold" : "");
+        if (b->hasTarget && cfgBlockAt(cfg, b->target) != NULL)
+            fprintf(f, "    b%04x -> b%04x%s;\n", b->start, cfgBlockAt(cfg, b->target)->start,
+                    b->kind == BLOCK_CALL ? " [style=dashed]" : "");
+        if (b->hasNext && b->end < MEM_SIZE && cfgBlockAt(cfg, (uint16_t)b->end) != NULL)
+            fprintf(f, "    b%04x -> b%04x;\n", b->start, cfgBlockAt(cfg, (uint16_t)b->end)->start);
+    }
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage();
+
+    const char *romPath = argv[1];
+    const char *machineName = "invaders";
+    const char *tracePath = NULL;
+    const char *dotPath = NULL;
+    const char *cPath = NULL;
+    bool blocks = false;
+    bool calls = false;
+    bool map = false;
+    uint16_t *entries = malloc((MEM_SIZE + MAX_ENTRIES) * sizeof(uint16_t));
+    int entryCount = 0;
+    if (entries == NULL)
+        exit(EXIT_FAILURE);
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-machine") && i + 1 < argc)
+            machineName = argv[++i];
+        else if (!strcmp(argv[i], "-entry") && i + 1 < argc && entryCount < MAX_ENTRIES)
+            entries[entryCount++] = (uint16_t)strtol(argv[++i], NULL, 16);
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (!strcmp(argv[i], "-dot") && i + 1 < argc)
+            dotPath = argv[++i];
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            cPath = argv[++i];
+        else if (!strcmp(argv[i], "-blocks"))
+            blocks = true;
+        else if (!strcmp(argv[i], "-calls"))
+            calls = true;
+        else if (!strcmp(argv[i], "-map"))
+            map = true;
+        else
+            usage();
+    }
+
+    const MachineDesc *desc = findMachine(machineName);
+    if (desc == NULL)
+    {
+        printf("Unknown machine %s\n", machineName);
+        exit(EXIT_FAILURE);
+    }
+    RomImage *rom = openROM(desc, romPath);
+    if (rom == NULL)
+        exit(EXIT_FAILURE);
+    if (tracePath != NULL && !readTrace(tracePath))
+    {
+        printf("%s is not a trace\n", tracePath);
+        exit(EXIT_FAILURE);
+    }
+
+    // Whatever PCHL or a return took the trace to that the analysis hasn't
+    // reached becomes an entry. One at a time, the first the trace went to
+    // first, as it may well lead to the others.
+    int given = entryCount;
+    Cfg *cfg = analyseROM(desc, rom, entries, entryCount);
+    for (int i = 0; i < enteredCount; i++)
+    {
+        uint16_t pc = enteredOrder[i];
+        if (!(cfg->flags[pc] & CFG_ROM) || (cfg->flags[pc] & CFG_CODE))
+            continue;
+        entries[entryCount++] = pc;
+        freeCfg(cfg);
+        cfg = analyseROM(desc, rom, entries, entryCount);
+    }
+
+    uint32_t code = 0;
+    uint32_t data = 0;
+    for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+    {
+        if (!(cfg->flags[addr] & CFG_ROM))
+            continue;
+        if (cfg->flags[addr] & (CFG_CODE | CFG_OPERAND))
+            code++;
+        else if (cfg->flags[addr] & CFG_DATA)
+            data++;
+    }
+
+    if (blocks)
+        printBlocks(cfg, rom->data);
+    if (calls)
+        printCalls(cfg);
+    if (map)
+        printMap(cfg);
+    if (dotPath != NULL)
+        writeDot(cfg, dotPath);
+    if (cPath != NULL)
+    {
+        FILE *f = fopen(cPath, "w");
+        if (f == NULL)
+        {
+            printf("Can't write %s\n", cPath);
+            exit(EXIT_FAILURE);
+        }
+        int translated = translateROM(cfg, desc, romPath, f);
+        fclose(f);
+        printf("%d of %d blocks translated into %s\n", translated, cfg->blockCount, cPath);
+    }
+
+    printf("%s: %u ROM bytes, %u code, %u unreached (%u of them referenced as data)\n", desc->name, cfg->romBytes,
+           code, cfg->romBytes - code, data);
+    printf("%d instructions in %d blocks, %d functions, %d PCHL sites, %d targets outside the ROM, %d overlapping "
+           "bytes\n",
+           cfg->instructions, cfg->blockCount, cfg->functionCount, cfg->indirect, cfg->exits, cfg->conflicts);
+
+    if (tracePath != NULL)
+    {
+        uint32_t ran = 0;
+        uint32_t missed = 0;
+        uint32_t neverRan = 0;
+        for (uint32_t addr = 0; addr < MEM_SIZE; addr++)
+        {
+            if (!(cfg->flags[addr] & CFG_ROM))
+                continue;
+            ran += executed[addr] & TRACE_RAN;
+            if ((executed[addr] & TRACE_RAN) && !(cfg->flags[addr] & CFG_CODE))
+                missed++;
+            if (!(executed[addr] & TRACE_RAN) && (cfg->flags[addr] & CFG_CODE))
+                neverRan++;
+        }
+        printf("trace: %u instructions ran, %d jump targets added as entries, %u ran outside the graph, %u "
+               "in the graph never ran\n",
+               ran, entryCount - given, missed, neverRan);
+    }
+
+    freeCfg(cfg);
+    freeROM(rom);
+    free(entries);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "Stream.h"
+
+// Spectator for -stream: connects, rebuilds every frame from the deltas and
+// checks it against the hash the server sent. A delta must follow the frame
+// before it, a client that lagged restarts at a key frame. Fails on the
+// first frame that doesn't decode to the server's VRAM.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    // streamclient host:port [frames]
+    char host[256] = "";
+    char *colon = NULL;
+    if (argc > 1)
+    {
+        snprintf(host, sizeof(host), "%s", argv[1]);
+        colon = strrchr(host, ':');
+    }
+    if (colon == NULL)
+    {
+        printf("usage: streamclient host:port [frames]\n");
+        exit(EXIT_FAILURE);
+    }
+    *colon = '\0';
+    unsigned long long limit = argc > 2 ? strtoull(argv[2], NULL, 10) : ~0ull;
+
+    StreamReader *r = openStream(host, atoi(colon + 1));
+    if (r == NULL)
+    {
+        printf("No stream at %s:%s\n", host, colon + 1);
+        exit(EXIT_FAILURE);
+    }
+    printf("%dx%d, %zu bytes of VRAM a frame\n", r->width, r->height, r->vramSize);
+
+    unsigned long long frames = 0;
+    unsigned long long keys = 0;
+    unsigned long long skipped = 0;
+    uint32_t last = 0;
+    bool ok = true;
+    double start = now();
+    while (frames < limit && streamNext(r))
+    {
+        if (!r->key && (frames == 0 || r->frame != last + 1))
+        {
+            printf("frame %u is a delta on frame %u\n", r->frame, last);
+            ok = false;
+            break;
+        }
+        if (!r->hashOk)
+        {
+            printf("frame %u doesn't match the server's hash\n", r->frame);
+            ok = false;
+            break;
+        }
+        if (frames > 0)
+            skipped += r->frame - last - 1;
+        keys += r->key;
+        last = r->frame;
+        frames++;
+    }
+    double elapsed = now() - start;
+
+    printf("%llu frames (%llu key, %llu skipped) verified, %llu bytes, %.0f bytes a frame, %.1f frames/s\n",
+           frames, keys, skipped, (unsigned long long)r->bytes,
+           frames > 0 ? (double)r->bytes / frames : 0.0, elapsed > 0 ? frames / elapsed : 0.0);
+    closeStream(r);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "Sound.h"
+
+// Measures the per-frame cost of the synthesised sound path for a pool of
+// instances, each driven by the same busy pattern of port 3/5 writes.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Roughly the sound traffic of a busy wave: marching fleet, frequent shots
+// and explosions, a UFO pass and a player death
+static void drivePorts(Sound *s, long frame)
+{
+    uint8_t port3 = 0x20; // amp on
+    if (frame % 30 < 2) port3 |= 0x02;
+    if (frame % 45 < 2) port3 |= 0x08;
+    if (frame % 600 >= 100 && frame % 600 < 400) port3 |= 0x01;
+    if (frame % 600 == 500) port3 |= 0x04;
+
+    uint8_t port5 = (frame % 8 == 0) ? (uint8_t)(1 << ((frame / 8) % 4)) : 0;
+    if (frame % 600 == 400) port5 |= 0x10;
+
+    soundWritePort(s, 3, port3);
+    soundWritePort(s, 5, port5);
+}
+
+int main(int argc, char **argv)
+{
+    int instances = argc > 1 ? atoi(argv[1]) : 128;
+    long frames = argc > 2 ? atol(argv[2]) : 3600;
+    if (instances <= 0 || frames <= 0)
+    {
+        printf("usage: synthbench [instances] [frames]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Sound **pool = malloc(sizeof(Sound *) * instances);
+    for (int i = 0; i < instances; i++)
+        pool[i] = initSynthSound();
+
+    int16_t pcm[SOUND_FRAME_SAMPLES];
+    long checksum = 0;
+    double start = now();
+    for (long frame = 0; frame < frames; frame++)
+    {
+        for (int i = 0; i < instances; i++)
+        {
+            drivePorts(pool[i], frame);
+            soundMix(pool[i], pcm, SOUND_FRAME_SAMPLES);
+            checksum += pcm[frame % SOUND_FRAME_SAMPLES];
+        }
+    }
+    double elapsed = now() - start;
+
+    double perFrame = elapsed / ((double)frames * instances);
+    printf("%d instances x %ld frames in %.3f s (checksum %ld)\n", instances, frames, elapsed, checksum);
+    printf("synthesis cost: %.2f us per instance frame\n", perFrame * 1e6);
+    printf("real-time capacity: %.0f instances per core\n", (1.0 / 60) / perFrame);
+
+    for (int i = 0; i < instances; i++)
+        freeSound(pool[i]);
+    free(pool);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "Trace.h"
+
+// Compare two execution traces record by record and show where they part,
+// with the instructions leading up to it disassembled
+#define MAX_CONTEXT 64
+
+static uint8_t code[0x10000]; // disassemble8080() reads from a memory image
+
+static void usage(void)
+{
+    printf("usage: tracediff a.trace b.trace [context]\n");
+    exit(EXIT_FAILURE);
+}
+
+static void printRecord(const char *label, uint64_t index, const TraceRecord *r)
+{
+    printf("%s %10llu %10u  A %02x BC %04x DE %04x HL %04x SP %04x %c%c%c%c%c %s%s  ", label,
+           (unsigned long long)index, r->cycle, r->a, r->bc, r->de, r->hl, r->sp, (r->flags & 0x80) ? 'S' : '-',
+           (r->flags & 0x40) ? 'Z' : '-', (r->flags & 0x10) ? 'A' : '-', (r->flags & 0x04) ? 'P' : '-',
+           (r->flags & 0x01) ? 'C' : '-', (r->status & TRACE_INTE) ? "EI" : "DI",
+           (r->status & TRACE_HALTED) ? " HLT" : "");
+
+    code[r->pc] = r->opcode;
+    code[(uint16_t)(r->pc + 1)] = r->operand[0];
+    code[(uint16_t)(r->pc + 2)] = r->operand[1];
+    disassemble8080(code, r->pc);
+}
+
+static bool sameRecord(const TraceRecord *a, const TraceRecord *b)
+{
+    return a->pc == b->pc && a->sp == b->sp && a->bc == b->bc && a->de == b->de && a->hl == b->hl
+        && a->a == b->a && a->flags == b->flags && a->opcode == b->opcode
+        && !memcmp(a->operand, b->operand, 2) && a->status == b->status && a->cycle == b->cycle;
+}
+
+// Names of the fields that differ
+static void printDifference(const TraceRecord *a, const TraceRecord *b)
+{
+    printf("differs in:");
+    if (a->pc != b->pc) printf(" PC");
+    if (a->opcode != b->opcode || memcmp(a->operand, b->operand, 2)) printf(" code");
+    if (a->a != b->a) printf(" A");
+    if (a->flags != b->flags) printf(" flags");
+    if (a->bc != b->bc) printf(" BC");
+    if (a->de != b->de) printf(" DE");
+    if (a->hl != b->hl) printf(" HL");
+    if (a->sp != b->sp) printf(" SP");
+    if (a->status != b->status) printf(" status");
+    if (a->cycle != b->cycle) printf(" cycle");
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+        usage();
+    int context = argc > 3 ? atoi(argv[3]) : 8;
+    context = context < 0 ? 0 : (context > MAX_CONTEXT ? MAX_CONTEXT : context);
+
+    TraceReader *ra = openTrace(argv[1]);
+    TraceReader *rb = openTrace(argv[2]);
+    if (ra == NULL || rb == NULL)
+    {
+        printf("%s is not a trace\n", ra == NULL ? argv[1] : argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    TraceRecord history[MAX_CONTEXT];
+    TraceRecord a;
+    TraceRecord b;
+    uint64_t index = 0;
+    int status = EXIT_SUCCESS;
+    for (;; index++)
+    {
+        bool moreA = traceNext(ra, &a);
+        bool moreB = traceNext(rb, &b);
+        if (!moreA && !moreB)
+        {
+            printf("identical, %llu records\n", (unsigned long long)index);
+            break;
+        }
+
+        if (moreA && moreB && sameRecord(&a, &b))
+        {
+            if (context > 0)
+                history[index % (uint64_t)context] = a;
+            continue;
+        }
+
+        status = EXIT_FAILURE;
+        uint64_t first = index > (uint64_t)context ? index - (uint64_t)context : 0;
+        for (uint64_t i = first; i < index; i++)
+            printRecord("   ", i, &(history[i % (uint64_t)context]));
+
+        if (!moreA || !moreB)
+        {
+            printf("%s ends after %llu records\n", moreA ? argv[2] : argv[1], (unsigned long long)index);
+            printRecord(moreA ? "a: " : "b: ", index, moreA ? &a : &b);
+            break;
+        }
+
+        printRecord("a: ", index, &a);
+        printRecord("b: ", index, &b);
+        printf("first difference at record %llu, ", (unsigned long long)index);
+        printDifference(&a, &b);
+        break;
+    }
+
+    closeTrace(ra);
+    closeTrace(rb);
+    return status;
+}